@@ -1,7 +1,13 @@
 #!/bin/bash
 
-mkdir -p ./dist
+mkdir -p ./dist ./build
 
-cc -std=c99 -Wall $(find ./src -maxdepth 1 -name '*.c') -ledit -lm -o ./dist/kovacs.out
+sources=$(find ./src -maxdepth 1 -name '*.c')
 
-cp ./src/libs/stdlib.k ./dist
\ No newline at end of file
+# Bootstrap binary, only used to turn the stdlib into pre-parsed C data
+cc -std=c11 -O2 -Wall $sources -ledit -lm -lpthread -o ./build/kovacs-gen
+./build/kovacs-gen --no-cache --emit-stdlib ./src/libs/stdlib.k > ./build/stdlib.c
+
+cc -std=c11 -O2 -Wall -DKOVACS_EMBED_STDLIB $sources ./build/stdlib.c -ledit -lm -lpthread -o ./dist/kovacs.out
+
+cp ./src/libs/stdlib.k ./dist
@@ -0,0 +1,57 @@
+#!/bin/bash
+
+# Integer arithmetic moves to big numbers on overflow, and back to plain
+# ones when the result fits again.
+
+source "$(dirname "$0")/testlib.sh"
+tmp=$(mktemp --suffix=.kvs)
+trap 'rm -f "$tmp"' EXIT
+
+check "overflow" '
+(print (+ 9223372036854775807 1))
+(print (- -9223372036854775808 1))
+(print (* 4294967296 4294967296))
+(print (- 0 -9223372036854775808))
+(print (* -1 -9223372036854775808))
+(print (/ -9223372036854775808 -1))' \
+'9223372036854775808
+-9223372036854775809
+18446744073709551616
+9223372036854775808
+9223372036854775808
+9223372036854775808'
+
+check "big operands" '
+(print 123456789012345678901234567890)
+(print (* 99999999999999999999 99999999999999999999))
+(print (/ 100000000000000000000 10))
+(print (- (+ 9223372036854775807 1) 1))
+(print (== (- (+ 9223372036854775807 1) 1) 9223372036854775807))' \
+'123456789012345678901234567890
+9999999999999999999800000000000000000001
+10000000000000000000
+9223372036854775807
+1'
+
+check "division by zero" '
+(print (/ 1 0))
+(print (/ 99999999999999999999 0))' \
+'Error: Division by zero
+Error: Division by zero'
+
+check "comparisons" '
+(print (== (+ 9223372036854775807 1) 9223372036854775808))
+(print (> 9223372036854775808 9223372036854775807))
+(print (< -99999999999999999999 -9223372036854775808))
+(print (== 99999999999999999999 99999999999999999998))' \
+'1
+1
+1
+0'
+
+check "serialize" "
+(serialize \"$tmp\" {99999999999999999999 -99999999999999999999 1})
+(print (deserialize \"$tmp\"))" \
+'{99999999999999999999 -99999999999999999999 1}'
+
+finish
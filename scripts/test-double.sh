@@ -0,0 +1,44 @@
+#!/bin/bash
+
+# Doubles read the same through either reader, mix with integers and big
+# numbers by promotion, and print back in a form that reads the same.
+
+source "$(dirname "$0")/testlib.sh"
+tmp=$(mktemp --suffix=.kvs)
+trap 'rm -f "$tmp"' EXIT
+
+literals='
+(print 1.5 -2.25 1.5e3 2.5e-3 1.0 -0.0)
+(print 1.5E+2 0.1)
+(print {1.5 2})'
+printed='1.5 -2.25 1500.0 0.0025 1.0 -0.0
+150.0 0.1
+{1.5 2}'
+
+check "literals" "$literals" "$printed"
+check "literals with mpc" "$literals" "$printed" --mpc
+
+check "promotion" '
+(print (+ 1 0.5) (* 2 1.5) (- 1.5 2) (/ 1 2.0) (/ 7 2))
+(print (+ 0.1 0.2))
+(print (+ 99999999999999999999 0.5))
+(print (< 1 1.5) (> 2.5 2) (< 99999999999999999999 1.0e20))' \
+'1.5 3.0 -0.5 0.5 3
+0.30000000000000004
+1.0e+20
+1 1 0'
+
+check "ieee" '
+(print (/ 1.0 0) (/ -1.0 0))
+(print (* 1.0e300 1.0e300))
+(print (/ 1 0))' \
+'inf -inf
+inf
+Error: Division by zero'
+
+check "serialize" "
+(serialize \"$tmp\" {0.1 -1.5 1.0e300})
+(print (deserialize \"$tmp\"))" \
+'{0.1 -1.5 1.0e+300}'
+
+finish
@@ -0,0 +1,82 @@
+#!/bin/bash
+
+# Mutable hash tables: probing past a group, deletes and reinserts over
+# tombstones, keys of different types, sharing, and tables that would
+# end up inside themselves.
+
+source "$(dirname "$0")/testlib.sh"
+tmp=$(mktemp --suffix=.kvs)
+trap 'rm -f "$tmp"' EXIT
+
+check "basics" '
+(def {t} (hash {{"a" 1} {"b" 2}}))
+(print (hash-get t "a") (hash-len t) (hash-has t "c"))
+(hash-put! t "c" 3)
+(hash-del! t "a")
+(print (hash-len t) (hash-has t "a") (hash-get t "c"))
+(print (hash-get t "a"))
+(print (hash {}) (hash-pairs (hash {{"k" 1}})))' \
+'1 2 0
+2 0 3
+Error: Function '"'hash-get'"' key not found.
+#{} {{"k" 1}}'
+
+check "keys" '
+(def {t} (hash {}))
+(hash-put! t 1 "i")
+(hash-put! t 1.0 "d")
+(hash-put! t "1" "s")
+(print (hash-get t 1) (hash-get t 1.0) (hash-get t "1") (hash-len t))
+(hash-put! t {1} 1)' \
+'"i" "d" "s" 3
+Error: Function '"'hash-put!'"' passed a Q-Expression as a key, Expected a Number, String or Symbol.'
+
+check "growth" '
+(def {t} (hash {}))
+(map (\ {k} {hash-put! t k (* k k)}) (vec-list (vec-range 1000)))
+(print (hash-len t) (hash-get t 999) (hash-get t 0))
+(map (\ {k} {hash-del! t k}) (vec-list (vec-range 500)))
+(print (hash-len t) (hash-has t 499) (hash-has t 500))
+(map (\ {k} {hash-put! t k k}) (vec-list (vec-range 500)))
+(print (hash-len t) (hash-get t 10) (hash-get t 510))' \
+'1000 998001 0
+500 0 1
+1000 10 260100'
+
+check "shared" '
+(def {t} (hash {}))
+(def {u} t)
+(hash-put! u "d" 4)
+(print (hash-get t "d"))
+(hash-each (\ {k v} {hash-put! t "new" 1}) t)
+(hash-each (\ {k v} {hash-del! t k}) t)
+(print (hash-len t))' \
+'4
+Error: Function '"'hash-put!'"' can'"'"'t add a key to a table that hash-each is walking.
+0'
+
+# Each of these once made a cycle that print and serialize recursed through until the stack ran out
+check "cycles" "
+(def {t} (hash {{\"a\" 1}}))
+(def {u} (hash {{\"b\" 2}}))
+(hash-put! t \"self\" t)
+(hash-put! t \"l\" (list 1 (list t)))
+(hash-put! t \"m\" (assoc (hmap {}) \"k\" t))
+(hash-put! t \"s\" (sorted-put (sorted {}) 1 t))
+(hash-put! t \"f\" ((\\ {a b} {a}) t))
+(hash-put! t \"u\" u)
+(hash-put! u \"t\" t)
+(print t (== t t))
+(serialize \"$tmp\" t)
+(def {v} (deserialize \"$tmp\"))
+(print (hash-get (hash-get v \"u\") \"b\") (== v t))" \
+'Error: Function '"'hash-put!'"' can'"'"'t put a table inside itself.
+Error: Function '"'hash-put!'"' can'"'"'t put a table inside itself.
+Error: Function '"'hash-put!'"' can'"'"'t put a table inside itself.
+Error: Function '"'hash-put!'"' can'"'"'t put a table inside itself.
+Error: Function '"'hash-put!'"' can'"'"'t put a table inside itself.
+Error: Function '"'hash-put!'"' can'"'"'t put a table inside itself.
+#{"a" 1 "u" #{"b" 2}} 1
+2 1'
+
+finish
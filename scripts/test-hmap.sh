@@ -0,0 +1,61 @@
+#!/bin/bash
+
+# Persistent maps: updates leave the old map alone, whatever order keys
+# went in, and enough keys to fill several levels of the trie.
+
+source "$(dirname "$0")/testlib.sh"
+tmp=$(mktemp --suffix=.kvs)
+trap 'rm -f "$tmp"' EXIT
+
+check "basics" '
+(def {m} (hmap {{"a" 1} {"b" 2}}))
+(def {n} (assoc m "c" 3))
+(print (hmap-len m) (hmap-len n) (hmap-get n "c") (hmap-has m "c"))
+(print (hmap-get m "zz"))
+(print (hmap {}) (hmap {{1 "x"}}))
+(print (hmap-keys (hmap {{1 2}})) (hmap-vals (hmap {{1 2}})) (hmap-pairs (hmap {{1 2}})))
+(print (assoc m {1} 2))' \
+'2 3 3 0
+Error: Function '"'hmap-get'"' key not found.
+#map{} #map{1 "x"}
+{1} {2} {{1 2}}
+Error: Function '"'assoc'"' passed a Q-Expression as a key, Expected a Number, String or Symbol.'
+
+check "persistence" '
+(def {m} (hmap {{"a" 1} {"b" 2}}))
+(print (assoc m "a" 9) (hmap-get m "a"))
+(def {d} (dissoc (assoc m "c" 3) "a"))
+(print (hmap-len d) (hmap-has d "a") (hmap-has m "a"))
+(print (dissoc m "zz"))
+(print (hmap-len (assoc m "x" 1 "y" 2)) (hmap-get (assoc m "x" 1 "y" 2) "y") m)' \
+'#map{"a" 9 "b" 2} 1
+2 0 1
+#map{"a" 1 "b" 2}
+4 2 #map{"a" 1 "b" 2}'
+
+check "order" '
+(print (== (assoc (assoc (hmap {}) 1 2) 3 4) (assoc (assoc (hmap {}) 3 4) 1 2)))
+(print (== (hmap {{1 2}}) (hmap {{1 3}})))' \
+'1
+0'
+
+check "many keys" '
+(def {pairs} (map (\ {k} {list k (* k 2)}) (vec-list (vec-range 600))))
+(def {m} (hmap pairs))
+(print (hmap-len m) (hmap-get m 599) (hmap-get m 0))
+(def {d} (eval (join {dissoc m} (vec-list (vec-range 400)))))
+(print (hmap-len d) (hmap-has d 399) (hmap-get d 400) (hmap-len m))
+(def {r} (hmap (join (hmap-pairs d) (take 400 pairs))))
+(print (hmap-len r) (== r m) (== d m))
+(print (sum (vec (hmap-vals m))))' \
+'600 1198 0
+200 0 800 600
+600 1 0
+359400'
+
+check "serialize" "
+(serialize \"$tmp\" (assoc (hmap {}) \"a\" (hmap {{1 2}}) 2.5 {1 2}))
+(print (deserialize \"$tmp\"))" \
+'#map{"a" #map{1 2} 2.5 {1 2}}'
+
+finish
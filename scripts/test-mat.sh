@@ -0,0 +1,63 @@
+#!/bin/bash
+
+# Matrices, from the checks on the rows they're built from to the
+# blocked multiply, which only kicks in past a few thousand products and
+# has to handle sizes that don't fill its tiles.
+
+source "$(dirname "$0")/testlib.sh"
+
+check "build" '
+(def {m} (mat {{1 2 3} {4 5 6}}))
+(print m (mat-shape m))
+(print (mat-list m))
+(print (mat {}) (mat {{1 2 3}}))
+(print (mat-row m 1) (mat-col m 2) (mat-get m 1 0))' \
+'[[1.0 2.0 3.0] [4.0 5.0 6.0]] {2 3}
+{{1.0 2.0 3.0} {4.0 5.0 6.0}}
+[] [[1.0 2.0 3.0]]
+[4.0 5.0 6.0] [3.0 6.0] 4.0'
+
+# Rows that aren't lists or vectors once read a garbage column count
+check "bad rows" '
+(print (mat {1 2}))
+(print (mat {"a"}))
+(print (mat {{1 2} 3}))
+(print (mat {{1 2} {3}}))
+(print (mat {{1 "a"}}))' \
+'Error: Function '"'mat'"' passed incorrect type for row 0. Got Number, Expected Q-Expression or Vector.
+Error: Function '"'mat'"' passed incorrect type for row 0. Got String, Expected Q-Expression or Vector.
+Error: Function '"'mat'"' passed incorrect type for row 1. Got Number, Expected Q-Expression or Vector.
+Error: Function '"'mat'"' passed a bad row 1, Expected 2 Numbers.
+Error: Function '"'mat'"' passed a bad row 0, Expected 2 Numbers.'
+
+check "arithmetic" '
+(def {m} (mat {{1 2 3} {4 5 6}}))
+(print (transpose m) (mat-shape (transpose m)))
+(print (matmul (mat {{1 2} {3 4}}) (mat {{1 2} {3 4}})))
+(print (matmul m (vec {1 1 1})))
+(print (* m 2) (+ m m))
+(print (matmul m m))
+(print (mat-get m 2 0))' \
+'[[1.0 4.0] [2.0 5.0] [3.0 6.0]] {3 2}
+[[7.0 10.0] [15.0 22.0]]
+[6.0 15.0]
+[[2.0 4.0 6.0] [8.0 10.0 12.0]] [[2.0 4.0 6.0] [8.0 10.0 12.0]]
+Error: Function '"'matmul'"' can'"'"'t multiply 2x3 by 2x3.
+Error: Function '"'mat-get'"' index 2 0 out of range for 2x3.'
+
+# 100 is a multiple of neither tile side. Each row of a is 0..99, so row i of a times a is 4950 times it.
+blocked='
+(def {i} (mat-identity 100))
+(print (mat-shape i) (== (matmul i i) i))
+(def {a} (mat (map (\ {_} {vec-range 100}) (vec-list (vec-range 100)))))
+(def {p} (matmul a a))
+(print (mat-get p 7 99) (mat-get p 99 1) (mat-get p 0 0))
+(print (== p (* a 4950)))'
+blocked_printed='{100 100} 1
+490050.0 4950.0 0.0
+1'
+
+check "blocked" "$blocked" "$blocked_printed"
+check "blocked without simd" "$blocked" "$blocked_printed" --no-simd
+
+finish
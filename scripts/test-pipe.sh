@@ -0,0 +1,31 @@
+#!/bin/bash
+
+# Reading from a pipe frames the source a chunk at a time, so it has to
+# agree with reading the same source from a file. Run from the repo root
+# after scripts/build.sh.
+
+kovacs=${1:-./dist/kovacs.out}
+src=$(mktemp --suffix=.k)
+trap 'rm -f "$src"' EXIT
+
+# A list of doubles well past one 64KB chunk, so forms and numbers get split across refills
+awk 'BEGIN {
+    srand(3)
+    printf "(def {l} {"
+    for (i = 0; i < 40000; i++)
+    {
+        printf "%s%d.25", (i ? " " : ""), int(rand() * 200000) - 100000
+    }
+    print "})"
+    print "(print (vec-len (vec l)) (fst l) (sum (vec l)))"
+}' > "$src"
+
+expected=$("$kovacs" "$src" | tail -n 1)
+got=$(cat "$src" | "$kovacs" /dev/stdin | tail -n 1)
+
+if [[ "$got" != "$expected" || "$got" != 40000* ]]; then
+    echo "pipe: expected '$expected', got '$got'"
+    exit 1
+fi
+
+echo "pipe: ok"
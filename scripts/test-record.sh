@@ -0,0 +1,60 @@
+#!/bin/bash
+
+# defrecord, its constructors and accessors, record equality and a
+# serialize round trip.
+
+source "$(dirname "$0")/testlib.sh"
+
+tmp=$(mktemp --suffix=.kvs)
+trap 'rm -f "$tmp"' EXIT
+
+check "define" '
+(defrecord {point} {x y})
+(def {p} (point 1 2))
+(print p (point-x p) (point-y p))
+(print (point {1 2} "s") (point-x (point {1 2} "s")))
+(defrecord {dup} {dup v})
+(print (dup-dup (dup 7 8)) (dup-v (dup 7 8)))' \
+'{1 2} 1 2
+{{1 2} "s"} {1 2}
+7 8'
+
+check "errors" '
+(defrecord {point} {x y})
+(defrecord {pair} {x y})
+(print (point 1))
+(print (point 1 2 3))
+(print (point-x 5))
+(print (point-x (pair 1 2)))
+(defrecord {bad} {a a})
+(defrecord {empty} {})
+(defrecord 5 {a})
+(defrecord {a b} {c})
+(defrecord {q} {1})' \
+'Error: Function '"'point'"' passed incorrect number of arguments. Got 1, Expected 2.
+Error: Function '"'point'"' passed incorrect number of arguments. Got 3, Expected 2.
+Error: Function '"'point-x'"' passed incorrect type. Got Number, Expected point.
+Error: Function '"'point-x'"' passed incorrect type. Got pair, Expected point.
+Error: Function '"'defrecord'"' passed field '"'a'"' twice.
+Error: Function '"'defrecord'"' passed {} for argument 1.
+Error: Function '"'defrecord'"' passed incorrect type for argument 0. Got Number, Expected Q-Expression.
+Error: Function '"'defrecord'"' passed 2 names, Expected 1.
+Error: Function '"'defrecord'"' cannot define non-symbol. Got Number, Expected Symbol.'
+
+# A record is never equal to a list, nor to a record of another type
+check "equality" '
+(defrecord {point} {x y})
+(defrecord {pair} {x y})
+(print (== (point 1 2) (point 1 2)) (== (point 1 2) (point 2 1)))
+(print (== (point 1 2) {1 2}) (!= (point 1 2) {1 2}) (== (pair 1 2) (point 1 2)))' \
+'1 0
+0 1 0'
+
+check "serialize" "
+(defrecord {point} {x y})
+(serialize \"$tmp\" (list (point 1 2) (point (point 3 4) \"s\")))
+(def {l} (deserialize \"$tmp\"))
+(print l (point-x (fst l)) (== (fst l) (point 1 2)) (point-y (point-x (snd l))))" \
+'{{1 2} {{3 4} "s"}} 1 1 4'
+
+finish
@@ -0,0 +1,75 @@
+#!/bin/bash
+
+# Sets, in both their bitmap and hash table forms, and the switch from
+# one to the other. Only bitmaps list in order, so hash sets get sorted.
+
+source "$(dirname "$0")/testlib.sh"
+
+tmp=$(mktemp --suffix=.kvs)
+trap 'rm -f "$tmp"' EXIT
+
+check "basics" '
+(def {a} (set {3 1 2 3}))
+(print a (set-len a) (set-has a 2) (set-has a 4))
+(def {b} (set-add a 4 5))
+(print (set-len a) (set-len b))
+(print (set {}) (set-len (set {})) (set-list (union (set {}) (set {}))))
+(print (set {{1}}))
+(print (set (vec-f64 (vec {1 2}))))' \
+'#set{1 2 3} 3 1 0
+3 5
+#set{} 0 {}
+Error: Function '"'set'"' passed Q-Expression at 0, Expected a Number, String or Symbol.
+Error: Function '"'set'"' passed a Vector of doubles.'
+
+check "bitmap" '
+(def {a} (set {3 1 2}))
+(print (set-list (union a (set {5 4}))) (set-list (intersection a (set {2 3 9}))) (set-list (difference a (set {1}))))
+(print (set-len (set (vec-range 1000))) (set-has (set (vec-range 1000)) 999) (set-has (set (vec-range 1000)) 1000))
+(print (set-list (difference (set (vec-range 200)) (set (vec-range 190)) (set {199}))))
+(print (set-list (intersection (set {1 2 3}) (set {2 3}) (set {3}))))' \
+'{1 2 3 4 5} {2 3} {2 3}
+1000 1 0
+{190 191 192 193 194 195 196 197 198}
+{3}'
+
+check "hash" '
+(print (sort (set-list (union (set {1 2}) (set {-1})))))
+(print (sort (set-list (set {1 1000000000}))))
+(print (sort (set-list (union (set {"x" "y"}) (set {"y" "z"})))))
+(print (set-has (union (set {1 2}) (set {"a"})) "a") (set-has (union (set {1 2}) (set {"a"})) 2))
+(print (set-len (intersection (set {1 2 "a"}) (set {2 "a" "b"}))))
+(print (set {1.5}))' \
+'{-1 1 2}
+{1 1000000000}
+{"x" "y" "z"}
+1 1
+2
+#set{1.5}'
+
+check "switching" '
+(def {a} (set (vec-range 10)))
+(def {b} (set-add a -5))
+(def {c} (set-add a 1000000000))
+(print (set-len b) (set-has b -5) (set-has b 9) (set-has b 10))
+(print (set-len c) (set-has c 1000000000) (set-has c 0))
+(print (set-list a))
+(print (sort (set-list (intersection b c))) (sort (set-list (difference c b))))' \
+'11 1 1 0
+11 1 1
+{0 1 2 3 4 5 6 7 8 9}
+{0 1 2 3 4 5 6 7 8 9} {1000000000}'
+
+check "equality" '
+(print (== (set {1 2}) (set {2 1})) (== (set {1 2}) (set {1 2 "a"})))
+(print (== (set-add (set {1}) -1) (set {-1 1})))' \
+'1 0
+1'
+
+check "serialize" "
+(serialize \"$tmp\" (list (set {3 1 2}) (set {-1 \"a\"})))
+(def {l} (deserialize \"$tmp\"))
+(print (fst l) (set-len (snd l)) (set-has (snd l) -1) (set-has (snd l) \"a\"))" \
+'#set{1 2 3} 2 1 1'
+
+finish
@@ -0,0 +1,47 @@
+#!/bin/bash
+
+# sort and sort-by, including the radix path taken for large integer
+# lists and the fresh environment each comparator call gets.
+
+source "$(dirname "$0")/testlib.sh"
+
+check "sort" '
+(print (sort {3 1 2}) (sort {}) (sort {"b" "a" "c"}) (sort {1.5 -2 1}))
+(print (sort (list -1000000000 5 1000000000 -3 0)))
+(print (sort {1 "a"}))
+(print (sort {{1} {2}}))
+(print (sort 5))
+(print (sort (vec {3 1 2})))' \
+'{1 2 3} {} {"a" "b" "c"} {-2 1 1.5}
+{-1000000000 -3 0 5 1000000000}
+Error: Function '"'sort'"' passed String at 1, Expected a Number.
+Error: Function '"'sort'"' passed Q-Expression at 0, Expected a Number.
+Error: Function '"'sort'"' passed incorrect type for argument 0. Got Number, Expected Q-Expression.
+Error: Function '"'sort'"' passed incorrect type for argument 0. Got Vector, Expected Q-Expression.'
+
+check "radix" '
+(def {up} (vec-list (vec-range 40000)))
+(print (== (sort up) up))
+(def {down} (sort (vec-list (scale (vec-range 40000) -1))))
+(print (head down) (vec-len (vec down)) (vec-get (vec down) 39999))
+(def {wide} (vec (sort (join (vec-list (scale (vec-range 40000) 3)) {1000000000 -1000000000 7}))))
+(print (vec-len wide) (vec-get wide 0) (vec-get wide 1) (vec-get wide 4) (vec-get wide 40002))' \
+'1
+{-39999} 40000 0
+40003 -1000000000 0 7 1000000000'
+
+check "sort-by" '
+(print (sort-by (\ {a b} {> a b}) {3 1 2}) (sort-by (\ {a b} {< a b}) {}))
+(print (sort-by (\ {a b} {< (fst a) (fst b)}) {{1 "a"} {0 "b"} {1 "c"} {0 "d"}}))
+(print (sort-by (\ {a b} {error "boom"}) {3 1 2}))' \
+'{3 2 1} {}
+{{0 "b"} {0 "d"} {1 "a"} {1 "c"}}
+Error: boom'
+
+# A binding made with = in one comparator call must not be seen by the next
+check "no leak" '
+(def {z} 0)
+(print (sort-by (\ {a b} {do (= {z} (+ z 1)) (if (== z 1) {< a b} {error "leak"})}) {3 1 2 5 4}))' \
+'{1 2 3 4 5}'
+
+finish
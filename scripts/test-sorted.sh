@@ -0,0 +1,57 @@
+#!/bin/bash
+
+# Sorted maps: key order across types, ranges, and enough keys, put in
+# backwards, to split nodes, then enough deletes to merge them again.
+
+source "$(dirname "$0")/testlib.sh"
+tmp=$(mktemp --suffix=.kvs)
+trap 'rm -f "$tmp"' EXIT
+
+check "basics" '
+(def {s} (sorted {{3 "c"} {1 "a"} {2 "b"}}))
+(print s (sorted-len s) (sorted-get s 2) (sorted-has s 4))
+(print (sorted-first s) (sorted-last s))
+(print (sorted-keys s) (sorted-vals s) (sorted-pairs s))
+(def {t} (sorted-put s 0 "z"))
+(print (sorted-keys t) (sorted-keys s) (sorted-keys (sorted-del t 2)))
+(print (sorted-get s 9))
+(print (sorted-first (sorted {})))' \
+'#sorted{1 "a" 2 "b" 3 "c"} 3 "b" 0
+{1 "a"} {3 "c"}
+{1 2 3} {"a" "b" "c"} {{1 "a"} {2 "b"} {3 "c"}}
+{0 1 2 3} {1 2 3} {0 1 3}
+Error: Function '"'sorted-get'"' key not found.
+Error: Function '"'sorted-first'"' passed an empty sorted map.'
+
+check "key order" '
+(print (sorted {{"b" 1} {2.5 "d"} {"a" 2} {2 "i"} {-1 0}}))
+(print (sorted {{99999999999999999999 "b"}}))
+(print (sorted (list (list (/ 0.0 0) 1))))
+(print (sorted {{{1} 2}}))' \
+'#sorted{-1 0 2 "i" 2.5 "d" "a" 2 "b" 1}
+Error: Function '"'sorted'"' passed a Big Number as a key, Expected a String or a Number other than nan.
+Error: Function '"'sorted'"' passed a Double as a key, Expected a String or a Number other than nan.
+Error: Function '"'sorted'"' passed a Q-Expression as a key, Expected a String or a Number other than nan.'
+
+check "many keys" '
+(def {s} (sorted (map (\ {k} {list k (* k 10)}) (vec-list (- 999 (vec-range 1000))))))
+(print (sorted-len s) (sorted-first s) (sorted-last s) (sorted-get s 500))
+(print (== (sorted-keys s) (vec-list (vec-range 1000))))
+(print (range-from-to s 126 131))
+(print (range-from-to s 5 5) (range-from-to s 998 2000))
+(def {d} (eval (join {sorted-del s} (vec-list (* 2 (vec-range 500))))))
+(print (sorted-len d) (sorted-first d) (sorted-last d) (sorted-has d 500) (sorted-has d 501))
+(print (== (sorted-keys d) (vec-list (+ 1 (* 2 (vec-range 500))))) (sorted-len s))' \
+'1000 {0 0} {999 9990} 5000
+1
+{{126 1260} {127 1270} {128 1280} {129 1290} {130 1300}}
+{} {{998 9980} {999 9990}}
+500 {1 10} {999 9990} 0 1
+1 1000'
+
+check "serialize" "
+(serialize \"$tmp\" (sorted-put (sorted {{2 {1 2}} {\"x\" 1.5}}) 1 (sorted {{1 1}})))
+(print (deserialize \"$tmp\"))" \
+'#sorted{1 #sorted{1 1} 2 {1 2} "x" 1.5}'
+
+finish
@@ -0,0 +1,66 @@
+#!/bin/bash
+
+# Vector kernels, checked with and without SIMD since both must agree.
+# Lengths past a register's worth leave a scalar tail to handle.
+
+source "$(dirname "$0")/testlib.sh"
+
+elementwise='
+(def {a} (vec {1 2 3 4 5 6 7 8 9}))
+(def {b} (vec {9 8 7 6 5 4 3 2 1}))
+(print a (vec-len a) (vec-get a 0))
+(print (+ a b) (- a 1) (- 1 (vec {1 2})))
+(print (* a 2) (/ a 2))
+(print (* a 0.5))
+(print (+ a (vec-f64 b)))'
+elementwise_printed='[1 2 3 4 5 6 7 8 9] 9 1
+[10 10 10 10 10 10 10 10 10] [0 1 2 3 4 5 6 7 8] [0 -1]
+[2 4 6 8 10 12 14 16 18] [0 1 1 2 2 3 3 4 4]
+[0.5 1.0 1.5 2.0 2.5 3.0 3.5 4.0 4.5]
+[10.0 10.0 10.0 10.0 10.0 10.0 10.0 10.0 10.0]'
+
+reductions='
+(def {a} (vec {1 2 3 4 5 6 7 8 9}))
+(print (dot a a) (sum a) (product a) (min a) (max a))
+(print (sum (vec-range 1000)) (max (vec-range 1000)) (dot (vec-range 1000) (vec-range 1000)))
+(print (min (vec {-9223372036854775808 5})) (sum (vec {9223372036854775807 1})))
+(print (scale a 2.5))
+(print (vec> a 4) (sum (vec> a 4)))
+(print (vec< (vec {1.5 2.5}) 2) (vec== (vec {1 2}) (vec {1 3})))'
+reductions_printed='285 45 362880 1 9
+499500 999 332833500
+-9223372036854775808 9223372036854775808
+[2.5 5.0 7.5 10.0 12.5 15.0 17.5 20.0 22.5]
+[0 0 0 0 1 1 1 1 1] 5
+[1 0] [1 0]'
+
+check "elementwise" "$elementwise" "$elementwise_printed"
+check "elementwise without simd" "$elementwise" "$elementwise_printed" --no-simd
+check "reductions" "$reductions" "$reductions_printed"
+check "reductions without simd" "$reductions" "$reductions_printed" --no-simd
+
+check "empty" '
+(print (vec {}) (sum (vec {})) (vec-len (vec {})))
+(print (max (vec {})))' \
+'[] 0 0
+Error: Function '"'max'"' passed an empty vector.'
+
+check "errors" '
+(print (+ (vec {1 2 3}) (vec {1 2})))
+(print (+ (vec {9223372036854775807}) 1))
+(print (vec {1 "a"}))
+(print (vec {1 99999999999999999999}))
+(print (vec-get (vec {1 2}) 2))' \
+'Error: Vector lengths differ, 3 and 2
+Error: Integer overflow in a vector op
+Error: Function '"'vec'"' passed String at 1, Expected Number or Double.
+Error: Function '"'vec'"' passed Big Number at 1, Expected Number or Double.
+Error: Function '"'vec-get'"' index 2 out of range for length 2.'
+
+check "min and max" '
+(print (max 3 1 2) (min 3 1.5))
+(print (max {1 2}) (min "a"))' \
+'3 1.5
+{1 2} "a"'
+
+finish
@@ -0,0 +1,45 @@
+# Sourced by the scripts/test-*.sh checks. Each one calls check with a
+# name, some Kovacs source and what it must print, then finish. Run them
+# from the repo root after scripts/build.sh, or pass the executable to
+# test as the first argument.
+
+kovacs=${1:-./dist/kovacs.out}
+failures=0
+
+# Runs the source as a file of its own and compares what it prints, past
+# the banner and without trailing spaces. A crash fails whatever it printed.
+# Anything after the expected output is passed on as flags.
+check()
+{
+    local name=$1
+    local expected=$3
+    local src
+    src=$(mktemp --suffix=.k)
+    printf '%s\n' "$2" > "$src"
+
+    local got
+    got=$("$kovacs" --no-cache "${@:4}" "$src" 2>&1)
+    local status=$?
+    rm -f "$src"
+
+    got=$(printf '%s\n' "$got" | sed '1,/to Exit$/d' | sed '1{/^$/d}; s/ *$//')
+
+    if [[ $status -ne 0 || "$got" != "$expected" ]]; then
+        echo "$name: failed, exit status $status"
+        diff <(printf '%s\n' "$expected") <(printf '%s\n' "$got") | cut -c 1-120 | head -n 20 | sed 's/^/    /'
+        failures=$((failures + 1))
+    fi
+}
+
+finish()
+{
+    local suite
+    suite=$(basename "$0" .sh)
+
+    if [[ $failures -ne 0 ]]; then
+        echo "${suite#test-}: $failures failed"
+        exit 1
+    fi
+
+    echo "${suite#test-}: ok"
+}
@@ -1,10 +1,24 @@
 #include <stdbool.h>
+#include <limits.h>
 #include "errors.h"
 #include "kval.h"
 #include "builtin.h"
 #include "types.h"
 #include "kenv.h"
 #include "parser.h"
+#include "reader.h"
+#include "kser.h"
+#include "kout.h"
+#include "krope.h"
+#include "kbig.h"
+#include "kvec.h"
+#include "kmat.h"
+#include "khash.h"
+#include "kmap.h"
+#include "ksorted.h"
+#include "kset.h"
+#include "ksort.h"
+#include "krecord.h"
 
 kval *builtin(kenv *e, kval *a, char *func)
 {
@@ -33,69 +47,364 @@ kval *builtin(kenv *e, kval *a, char *func)
         return builtin_eval(e, a);
     }
 
-    if (strstr("+-/*", func))
+    if (func[0] && !func[1] && strchr("+-/*", func[0]))
     {
-        return builtin_op(e, a, func);
+        return builtin_op(e, a, func[0]);
     }
 
     kval_del(a);
     return kval_err("Unknown Function!");
 }
 
-kval *builtin_op(kenv *e, kval *kv, char *op)
+// x op y on longs, 0 if the result doesn't fit
+static int builtin_op_fixnum(char op, long x, long y, long *r)
+{
+    switch (op)
+    {
+    case '+':
+        return !__builtin_add_overflow(x, y, r);
+    case '-':
+        return !__builtin_sub_overflow(x, y, r);
+    case '*':
+        return !__builtin_mul_overflow(x, y, r);
+    case '/':
+        // LONG_MIN / -1 is the one quotient that overflows
+        if (x == LONG_MIN && y == -1)
+        {
+            return 0;
+        }
+
+        *r = x / y;
+        return 1;
+    }
+
+    return 0;
+}
+
+// The same on big numbers, once a result has outgrown a long
+static kval *builtin_op_big(char op, kval *x, kval *y)
+{
+    kbig *a = kval_to_big(x);
+    kbig *b = kval_to_big(y);
+    kbig *r = NULL;
+
+    switch (op)
+    {
+    case '+':
+        r = kbig_add(a, b);
+        break;
+    case '-':
+        r = kbig_sub(a, b);
+        break;
+    case '*':
+        r = kbig_mul(a, b);
+        break;
+    case '/':
+        r = kbig_div(a, b);
+        break;
+    }
+
+    kbig_unref(a);
+    kbig_unref(b);
+
+    return r ? kval_big(r) : kval_error(KERR_BAD_OP);
+}
+
+// And on doubles, in place on x so a chain of them never allocates
+static void builtin_op_dbl(char op, kval *x, kval *y)
+{
+    if (x->type != KVAL_DBL)
+    {
+        double d = kval_to_double(x);
+        if (x->type == KVAL_BIG)
+        {
+            kbig_unref(x->big);
+        }
+
+        x->type = KVAL_DBL;
+        x->dbl = d;
+    }
+
+    double b = kval_to_double(y);
+
+    switch (op)
+    {
+    case '+':
+        x->dbl += b;
+        break;
+    case '-':
+        x->dbl -= b;
+        break;
+    case '*':
+        x->dbl *= b;
+        break;
+    case '/':
+        x->dbl /= b;
+        break;
+    }
+}
+
+// Numeric tower, the type an op on two numbers is carried out in
+#define KNUM_RANK(type) ((type) == KVAL_NUM ? 0 : (type) == KVAL_BIG ? 1 : (type) == KVAL_DBL ? 2 : (type) == KVAL_VEC ? 3 : 4)
+
+static const int builtin_promote[5][5] = {
+    //            Num       Big       Double    Vector    Matrix
+    /* Num */    {KVAL_NUM, KVAL_BIG, KVAL_DBL, KVAL_VEC, KVAL_MAT},
+    /* Big */    {KVAL_BIG, KVAL_BIG, KVAL_DBL, KVAL_VEC, KVAL_MAT},
+    /* Double */ {KVAL_DBL, KVAL_DBL, KVAL_DBL, KVAL_VEC, KVAL_MAT},
+    /* Vector */ {KVAL_VEC, KVAL_VEC, KVAL_VEC, KVAL_VEC, KVAL_MAT},
+    /* Matrix */ {KVAL_MAT, KVAL_MAT, KVAL_MAT, KVAL_MAT, KVAL_MAT},
+};
+
+// One side of an elementwise vector op, a scalar is repeated with a stride of 0
+typedef struct
+{
+    const int64_t *i64;
+    const double *f64;
+    int stride;
+    int64_t num;
+    double dbl;
+    kvec *tmp;
+} builtin_vec_side;
+
+static int builtin_vec_kind(kval *v)
+{
+    if (v->type == KVAL_VEC)
+    {
+        return v->vec->kind;
+    }
+
+    return v->type == KVAL_DBL ? KVEC_F64 : KVEC_I64;
+}
+
+static void builtin_vec_side_init(builtin_vec_side *s, kval *v, int kind)
+{
+    s->tmp = NULL;
+
+    if (v->type != KVAL_VEC)
+    {
+        s->num = v->type == KVAL_NUM ? v->num : 0;
+        s->dbl = kval_to_double(v);
+        s->i64 = &s->num;
+        s->f64 = &s->dbl;
+        s->stride = 0;
+        return;
+    }
+
+    kvec *src = v->vec;
+    if (kind == KVEC_F64 && src->kind == KVEC_I64)
+    {
+        src = s->tmp = kvec_to_f64(src);
+    }
+
+    s->i64 = src->i64;
+    s->f64 = src->f64;
+    s->stride = 1;
+}
+
+// The operands of an elementwise op, NULL if they go together
+static kval *builtin_vec_check(kval *x, kval *y)
+{
+    if (x->type == KVAL_BIG || y->type == KVAL_BIG)
+    {
+        return kval_err_kind(KERR_BAD_NUM, "Number too big for a vector");
+    }
+
+    if (x->type == KVAL_VEC && y->type == KVAL_VEC && x->vec->len != y->vec->len)
+    {
+        return kval_err_kind(KERR_ARGS, "Vector lengths differ, %li and %li", (long)x->vec->len, (long)y->vec->len);
+    }
+
+    return NULL;
+}
+
+// x op y where either is a vector, the other a vector or a scalar. Takes x.
+static kval *builtin_op_vec(char op, kval *x, kval *y)
+{
+    kval *err = builtin_vec_check(x, y);
+    if (err)
+    {
+        kval_del(x);
+        return err;
+    }
+
+    size_t n = x->type == KVAL_VEC ? x->vec->len : y->vec->len;
+    int kind = builtin_vec_kind(x) == KVEC_F64 || builtin_vec_kind(y) == KVEC_F64 ? KVEC_F64 : KVEC_I64;
+
+    // Write the result over x when nothing else can see it
+    kvec *r;
+    if (x->type == KVAL_VEC && x->vec->refs == 1 && x->vec->kind == kind)
+    {
+        r = kvec_ref(x->vec);
+    }
+    else
+    {
+        r = kvec_alloc(kind, n);
+    }
+
+    builtin_vec_side a, b;
+    builtin_vec_side_init(&a, x, kind);
+    builtin_vec_side_init(&b, y, kind);
+
+    int code = 0;
+    if (kind == KVEC_F64)
+    {
+        kvec_f64_op(op, r->f64, a.f64, a.stride, b.f64, b.stride, n);
+    }
+    else
+    {
+        code = kvec_i64_op(op, r->i64, a.i64, a.stride, b.i64, b.stride, n);
+    }
+
+    if (a.tmp)
+    {
+        kvec_unref(a.tmp);
+    }
+
+    if (b.tmp)
+    {
+        kvec_unref(b.tmp);
+    }
+
+    kval_del(x);
+
+    if (code)
+    {
+        kvec_unref(r);
+        return code == KERR_BAD_NUM ? kval_err_kind(code, "Integer overflow in a vector op") : kval_error(code);
+    }
+
+    return kval_vec(r);
+}
+
+// x op y where either is a matrix, the other a matrix of the same shape or a number. Takes x.
+static kval *builtin_op_mat(char op, kval *x, kval *y)
+{
+    if (x->type == KVAL_VEC || y->type == KVAL_VEC)
+    {
+        kval_del(x);
+        return kval_err_kind(KERR_TYPE, "Can't mix a Vector and a Matrix in an elementwise op");
+    }
+
+    kmat *shape = x->type == KVAL_MAT ? x->mat : y->mat;
+    if (x->type == KVAL_MAT && y->type == KVAL_MAT &&
+        (x->mat->rows != y->mat->rows || x->mat->cols != y->mat->cols))
+    {
+        kval *err = kval_err_kind(KERR_ARGS, "Matrix shapes differ, %lix%li and %lix%li",
+                                  (long)x->mat->rows, (long)x->mat->cols, (long)y->mat->rows, (long)y->mat->cols);
+        kval_del(x);
+        return err;
+    }
+
+    // Write the result over x when nothing else can see it
+    kmat *r = x->type == KVAL_MAT && x->mat->refs == 1 ? kmat_ref(x->mat) : kmat_alloc(shape->rows, shape->cols);
+
+    // A number is repeated with a stride of 0
+    double dx = x->type == KVAL_MAT ? 0 : kval_to_double(x);
+    double dy = y->type == KVAL_MAT ? 0 : kval_to_double(y);
+    const double *px = x->type == KVAL_MAT ? x->mat->f64 : &dx;
+    const double *py = y->type == KVAL_MAT ? y->mat->f64 : &dy;
+
+    kvec_f64_op(op, r->f64, px, x->type == KVAL_MAT, py, y->type == KVAL_MAT, shape->rows * shape->cols);
+
+    kval_del(x);
+    return kval_mat(r);
+}
+
+kval *builtin_op(kenv *e, kval *kv, char op)
 {
     // Ensure all arguments are numbers  
     for (int i = 0; i < kv->count; i++)
     {
-        if (kv->cells[i]->type != KVAL_NUM)
+        int type = kv->cells[i]->type;
+        if (!kval_is_number(kv->cells[i]) && type != KVAL_VEC && type != KVAL_MAT)
         {
             kval_del(kv);
-            return kval_err(KERR_UNSUPPORTED_TYPE);
+            return kval_error(KERR_UNSUPPORTED_TYPE);
         }
     }
 
     kval *x = kval_pop(kv, 0);
 
     // If (- 10) -> -10
-    bool is_negation = kv->count == 0 && (strcmp(op, "-") == 0);
+    bool is_negation = kv->count == 0 && op == '-';
     if (is_negation)
     {
-        x->num *= -1;
+        if (x->type == KVAL_DBL)
+        {
+            x->dbl = -x->dbl;
+        }
+        else if (x->type == KVAL_VEC)
+        {
+            kval *r = builtin_op_vec('-', kval_num(0), x);
+            kval_del(x);
+            x = r;
+        }
+        else if (x->type == KVAL_MAT)
+        {
+            kval *r = builtin_op_mat('-', kval_num(0), x);
+            kval_del(x);
+            x = r;
+        }
+        else if (x->type == KVAL_NUM && x->num != LONG_MIN)
+        {
+            x->num = -x->num;
+        }
+        else
+        {
+            kbig *b = kval_to_big(x);
+            kval_del(x);
+            x = kval_big(kbig_neg(b));
+            kbig_unref(b);
+        }
     }
 
-    while (kv->count > 0)
+    for (int i = 0; i < kv->count; i++)
     {
-        // This is the decrementor
-        kval *y = kval_pop(kv, 0);
+        kval *y = kv->cells[i];
+        int type = builtin_promote[KNUM_RANK(x->type)][KNUM_RANK(y->type)];
 
-        switch (*op)
+        if (type == KVAL_VEC || type == KVAL_MAT)
         {
-        case '+':
-            x->num += y->num;
-            break;
-        case '-':
-            x->num -= y->num;
-            break;
-        case '*':
-            x->num *= y->num;
-            break;
-        case '/':
-            if (y->num == 0)
+            x = type == KVAL_VEC ? builtin_op_vec(op, x, y) : builtin_op_mat(op, x, y);
+            if (x->type == KVAL_ERR)
             {
-                return kval_err(KERR_DIV_ZERO);
+                break;
             }
 
-            x->num /= y->num;
-            break;
+            continue;
+        }
 
-        default:
+        if (type == KVAL_DBL)
+        {
+            builtin_op_dbl(op, x, y);
+            continue;
+        }
+
+        // Doubles divide by zero into inf/nan, integers don't
+        if (op == '/' && y->type == KVAL_NUM && y->num == 0)
+        {
             kval_del(x);
-            kval_del(y);
-            x = kval_err(KERR_BAD_OP);
-            break;
+            kval_del(kv);
+            return kval_error(KERR_DIV_ZERO);
+        }
+
+        // Numbers that fit in a long stay unboxed, only an overflow takes the slow path
+        long r;
+        if (type == KVAL_NUM && builtin_op_fixnum(op, x->num, y->num, &r))
+        {
+            x->num = r;
+            continue;
         }
 
-        kval_del(y);
+        kval *z = builtin_op_big(op, x, y);
+        kval_del(x);
+        x = z;
+
+        if (x->type == KVAL_ERR)
+        {
+            break;
+        }
     }
 
     kval_del(kv);
@@ -108,7 +417,7 @@ kval *builtin_op(kenv *e, kval *kv, char *op)
 kval *builtin_list(kenv *e, kval *a)
 {
     a->type = KVAL_QEXPR;
-    return a;
+    return kval_pack(a);
 }
 
 kval *builtin_head(kenv *e, kval *a)
@@ -126,6 +435,11 @@ kval *builtin_head(kenv *e, kval *a)
              "Function 'head' passed {}!");
 
     kval *v = kval_take(a, 0);
+    if (v->pack != KPACK_NONE)
+    {
+        return kval_packed_slice(v, 0, 1);
+    }
+
     while (v->count > 1)
     {
         kval_del(kval_pop(v, 1));
@@ -145,6 +459,11 @@ kval *builtin_tail(kenv *e, kval *a)
              "Function 'tail' passed {}!");
 
     kval *v = kval_take(a, 0);
+    if (v->pack != KPACK_NONE)
+    {
+        return kval_packed_slice(v, 1, v->count - 1);
+    }
+
     kval_del(kval_pop(v, 0));
     return v;
 }
@@ -157,7 +476,7 @@ kval *builtin_eval(kenv *e, kval *a)
     K_ASSERT(a, a->cells[0]->type == KVAL_QEXPR,
              "Function 'eval' passed incorrect type!");
 
-    kval *x = kval_take(a, 0);
+    kval *x = kval_unpack(kval_take(a, 0));
     x->type = KVAL_SEXPR;
 
     return kval_eval(e, x);
@@ -176,7 +495,22 @@ kval *builtin_join(kenv *e, kval *a)
 
     while (a->count)
     {
-        x = kval_join(x, kval_pop(a, 0));
+        kval *y = kval_pop(a, 0);
+
+        // Lists packed the same way are joined by copying their arrays
+        if (x->count == 0)
+        {
+            kval_del(x);
+            x = y;
+        }
+        else if (x->pack != KPACK_NONE && x->pack == y->pack)
+        {
+            x = kval_packed_join(x, y);
+        }
+        else
+        {
+            x = kval_join(x, y);
+        }
     }
 
     kval_del(a);
@@ -188,22 +522,22 @@ kval *builtin_join(kenv *e, kval *a)
 // #################
 kval *builtin_add(kenv *e, kval *a)
 {
-    return builtin_op(e, a, "+");
+    return builtin_op(e, a, '+');
 }
 
 kval *builtin_sub(kenv *e, kval *a)
 {
-    return builtin_op(e, a, "-");
+    return builtin_op(e, a, '-');
 }
 
 kval *builtin_mul(kenv *e, kval *a)
 {
-    return builtin_op(e, a, "*");
+    return builtin_op(e, a, '*');
 }
 
 kval *builtin_div(kenv *e, kval *a)
 {
-    return builtin_op(e, a, "/");
+    return builtin_op(e, a, '/');
 }
 
 // ########################
@@ -223,7 +557,7 @@ kval *builtin_var(kenv *e, kval *a, char *func)
 {
     K_ASSERT_TYPE(func, a, 0, KVAL_QEXPR);
 
-    kval *syms = a->cells[0];
+    kval *syms = kval_unpack(a->cells[0]);
     for (int i = 0; i < syms->count; i++)
     {
         K_ASSERT(a, (syms->cells[i]->type == KVAL_SYM),
@@ -265,6 +599,7 @@ kval *builtin_lambda(kenv *e, kval *a)
     K_ASSERT_TYPE("\\", a, 1, KVAL_QEXPR);
 
     // Check first Q-Expression contains only Symbols  
+    kval_unpack(a->cells[0]);
     for (int i = 0; i < a->cells[0]->count; i++)
     {
         K_ASSERT(a, (a->cells[0]->cells[i]->type == KVAL_SYM),
@@ -285,49 +620,78 @@ kval *builtin_lambda(kenv *e, kval *a)
 // #################
 kval *builtin_gt(kenv *e, kval *a)
 {
-    return builtin_ord(e, a, ">");
+    return builtin_ord(e, a, KORD_GT);
 }
 
 kval *builtin_lt(kenv *e, kval *a)
 {
-    return builtin_ord(e, a, "<");
+    return builtin_ord(e, a, KORD_LT);
 }
 
 kval *builtin_ge(kenv *e, kval *a)
 {
-    return builtin_ord(e, a, ">=");
+    return builtin_ord(e, a, KORD_GE);
 }
 
 kval *builtin_le(kenv *e, kval *a)
 {
-    return builtin_ord(e, a, "<=");
+    return builtin_ord(e, a, KORD_LE);
 }
 
-kval *builtin_ord(kenv *e, kval *a, char *op)
+static const char *builtin_ord_names[] = {">", "<", ">=", "<="};
+
+kval *builtin_ord(kenv *e, kval *a, int op)
 {
-    K_ASSERT_NUM(op, a, 2);
-    K_ASSERT_TYPE(op, a, 0, KVAL_NUM);
-    K_ASSERT_TYPE(op, a, 1, KVAL_NUM);
+    const char *name = builtin_ord_names[op];
+    K_ASSERT_NUM(name, a, 2);
+    K_ASSERT_NUMBER(name, a, 0);
+    K_ASSERT_NUMBER(name, a, 1);
+
+    kval *x = a->cells[0];
+    kval *y = a->cells[1];
 
     int r;
-    if (strcmp(op, ">") == 0)
+    if (builtin_promote[KNUM_RANK(x->type)][KNUM_RANK(y->type)] == KVAL_DBL)
     {
-        r = (a->cells[0]->num > a->cells[1]->num);
-    }
+        // Compared directly so a nan is unordered against everything
+        double dx = kval_to_double(x);
+        double dy = kval_to_double(y);
 
-    if (strcmp(op, "<") == 0)
-    {
-        r = (a->cells[0]->num < a->cells[1]->num);
+        switch (op)
+        {
+        case KORD_GT:
+            r = dx > dy;
+            break;
+        case KORD_LT:
+            r = dx < dy;
+            break;
+        case KORD_GE:
+            r = dx >= dy;
+            break;
+        default:
+            r = dx <= dy;
+            break;
+        }
     }
-
-    if (strcmp(op, ">=") == 0)
+    else
     {
-        r = (a->cells[0]->num >= a->cells[1]->num);
-    }
+        int c = kval_cmp_num(x, y);
 
-    if (strcmp(op, "<=") == 0)
-    {
-        r = (a->cells[0]->num <= a->cells[1]->num);
+        switch (op)
+        {
+        case KORD_GT:
+            r = c > 0;
+            break;
+        case KORD_LT:
+            r = c < 0;
+            break;
+        case KORD_GE:
+            r = c >= 0;
+            break;
+        default:
+            r = c <= 0;
+            break;
+        }
     }
 
     kval_del(a);
@@ -339,7 +703,7 @@ kval *builtin_cmp(kenv *e, kval *a, char *op)
 {
     K_ASSERT_NUM(op, a, 2);
 
-    int r;
+    int r = 0;
     if (strcmp(op, "==") == 0)
     {
         r = kval_eq(a->cells[0], a->cells[1]);
@@ -371,27 +735,45 @@ kval *builtin_if(kenv *e, kval *a)
     K_ASSERT_TYPE("if", a, 1, KVAL_QEXPR);
     K_ASSERT_TYPE("if", a, 2, KVAL_QEXPR);
 
-    // Mark Both Expressions as evaluable  
-    kval *x;
-    a->cells[1]->type = KVAL_SEXPR;
-    a->cells[2]->type = KVAL_SEXPR;
+    // If condition is true evaluate first expression, otherwise the second
+    kval *x = kval_unpack(kval_pop(a, a->cells[0]->num ? 1 : 2));
 
-    if (a->cells[0]->num)
-    {
-        // If condition is true evaluate first expression  
-        x = kval_eval(e, kval_pop(a, 1));
-    }
-    else
-    {
-        // Otherwise evaluate second expression  
-        x = kval_eval(e, kval_pop(a, 2));
-    }
+    // Mark it as evaluable
+    x->type = KVAL_SEXPR;
+    x = kval_eval(e, x);
 
     // Delete argument list and return  
     kval_del(a);
     return x;
 }
 
+// Evaluate the body, and if it raises an error call the handler with its message instead
+kval *builtin_try(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("try", a, 2);
+    K_ASSERT_TYPE("try", a, 0, KVAL_QEXPR);
+    K_ASSERT_TYPE("try", a, 1, KVAL_FUN);
+
+    kval *body = kval_unpack(kval_pop(a, 0));
+    body->type = KVAL_SEXPR;
+
+    kval *x = kval_eval(e, body);
+    if (x->type != KVAL_ERR)
+    {
+        kval_del(a);
+        return x;
+    }
+
+    kval *handler = kval_take(a, 0);
+    kval *args = kval_add(kval_sexpr(), kval_str((char *)kval_err_msg(x)));
+    kval_del(x);
+
+    x = kval_call(e, handler, args);
+    kval_del(handler);
+
+    return x;
+}
+
 // #################
 //  Strings        #
 // #################
@@ -400,7 +782,11 @@ kval *builtin_error(kenv *e, kval *a)
     K_ASSERT_NUM("error", a, 1);
     K_ASSERT_TYPE("error", a, 0, KVAL_STR);
 
-    kval *err = kval_err(a->cells[0]->str);
+    // Literal messages are interned, and outlive the error
+    kval *msg = a->cells[0];
+    kval *err = msg->interned
+                    ? kval_err_static(KERR_USER, msg->str)
+                    : kval_err_kind(KERR_USER, "%s", kval_str_flat(msg));
 
     kval_del(a);
     return err;
@@ -412,52 +798,2082 @@ kval *builtin_print(kenv *e, kval *a)
     for (int i = 0; i < a->count; i++)
     {
         kval_print(a->cells[i]);
-        putchar(' ');
+        kout_putc(' ');
     }
 
-    putchar('\n');
+    kout_newline();
     kval_del(a);
 
     return kval_sexpr();
 }
 
-// #################
-// Files           #
-// #################
-kval *builtin_load(kenv *e, kval *a)
+kval *builtin_str_len(kenv *e, kval *a)
 {
-    K_ASSERT_NUM("load", a, 1);
-    K_ASSERT_TYPE("load", a, 0, KVAL_STR);
+    K_ASSERT_NUM("str-len", a, 1);
+    K_ASSERT_TYPE("str-len", a, 0, KVAL_STR);
+
+    kval *x = kval_num(a->cells[0]->len);
+
+    kval_del(a);
+    return x;
+}
 
-    mpc_result_t r;
-    if (mpc_parse_contents(a->cells[0]->str, Kovacs, &r))
+kval *builtin_str_concat(kenv *e, kval *a)
+{
+    size_t len = 0;
+    for (int i = 0; i < a->count; i++)
     {
+        K_ASSERT_TYPE("str-concat", a, i, KVAL_STR);
+        len += a->cells[i]->len;
+    }
 
-        kval *expr = kval_read(r.output);
-        mpc_ast_delete(r.output);
+    // Short results are cheaper flat, long ones share the bytes of their parts
+    kval *x;
+    if (len <= KSTR_FLAT_MAX)
+    {
+        x = kval_str_alloc(len);
 
-        while (expr->count)
+        size_t at = 0;
+        for (int i = 0; i < a->count; i++)
         {
-            kval *x = kval_eval(e, kval_pop(expr, 0));
-            if (x->type == KVAL_ERR)
+            memcpy(x->str + at, kval_str_flat(a->cells[i]), a->cells[i]->len);
+            at += a->cells[i]->len;
+        }
+    }
+    else
+    {
+        krope *r = NULL;
+        for (int i = 0; i < a->count; i++)
+        {
+            if (a->cells[i]->len == 0)
             {
-                kval_println(x);
+                continue;
             }
-            kval_del(x);
+
+            krope *part = kval_str_to_rope(a->cells[i]);
+            r = r ? krope_concat(r, part) : part;
         }
 
-        kval_del(expr);
-        kval_del(a);
+        x = kval_str_rope(r);
+    }
+
+    kval_del(a);
+    return x;
+}
+
+kval *builtin_substr(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("substr", a, 3);
+    K_ASSERT_TYPE("substr", a, 0, KVAL_STR);
+    K_ASSERT_TYPE("substr", a, 1, KVAL_NUM);
+    K_ASSERT_TYPE("substr", a, 2, KVAL_NUM);
+
+    kval *s = a->cells[0];
+    long start = a->cells[1]->num;
+    long count = a->cells[2]->num;
+
+    K_ASSERT(a, start >= 0 && count >= 0 && (size_t)start <= s->len && (size_t)count <= s->len - start,
+             "Function 'substr' passed a range outside the string. "
+             "Got %li+%li, Length %li.",
+             start, count, (long)s->len);
+
+    kval *x = kval_str_alloc(count);
+    if (s->rope)
+    {
+        krope_copy(s->rope, start, count, x->str);
+    }
+    else
+    {
+        memcpy(x->str, s->str + start, count);
+    }
+
+    kval_del(a);
+    return x;
+}
 
-        return kval_sexpr();
+kval *builtin_str_join(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("str-join", a, 2);
+    K_ASSERT_TYPE("str-join", a, 0, KVAL_STR);
+    K_ASSERT_TYPE("str-join", a, 1, KVAL_QEXPR);
+
+    kval *sep = a->cells[0];
+    kval *list = kval_unpack(a->cells[1]);
+
+    // Size the result first, so it is built in a single allocation
+    size_t len = 0;
+    for (int i = 0; i < list->count; i++)
+    {
+        K_ASSERT(a, list->cells[i]->type == KVAL_STR,
+                 "Function 'str-join' passed incorrect type in list. "
+                 "Got %s, Expected %s.",
+                 ktype_name(list->cells[i]->type), ktype_name(KVAL_STR));
+        len += list->cells[i]->len + (i ? sep->len : 0);
     }
 
-    char *err_msg = mpc_err_string(r.error);
-    mpc_err_delete(r.error);
+    kval *x = kval_str_alloc(len);
+
+    size_t at = 0;
+    for (int i = 0; i < list->count; i++)
+    {
+        if (i)
+        {
+            memcpy(x->str + at, kval_str_flat(sep), sep->len);
+            at += sep->len;
+        }
+
+        memcpy(x->str + at, kval_str_flat(list->cells[i]), list->cells[i]->len);
+        at += list->cells[i]->len;
+    }
 
-    kval *err = kval_err("Could not load file %s", err_msg);
-    free(err_msg);
     kval_del(a);
+    return x;
+}
 
-    return err;
+// #################
+//  Vectors        #
+// #################
+
+// A vector from a list of numbers, of doubles if there are any
+kval *builtin_vec(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("vec", a, 1);
+    K_ASSERT_TYPE("vec", a, 0, KVAL_QEXPR);
+
+    kval *list = a->cells[0];
+    int kind = KVEC_I64;
+
+    if (list->pack == KPACK_NUMS)
+    {
+        kvec *v = kvec_alloc(KVEC_I64, list->count);
+        for (int i = 0; i < list->count; i++)
+        {
+            v->i64[i] = list->nums[i];
+        }
+
+        kval_del(a);
+        return kval_vec(v);
+    }
+
+    kval_unpack(list);
+    for (int i = 0; i < list->count; i++)
+    {
+        int type = list->cells[i]->type;
+        K_ASSERT_KIND(a, KERR_TYPE, type == KVAL_NUM || type == KVAL_DBL,
+                      "Function 'vec' passed %s at %i, Expected Number or Double.", ktype_name(type), i);
+
+        if (type == KVAL_DBL)
+        {
+            kind = KVEC_F64;
+        }
+    }
+
+    kvec *v = kvec_alloc(kind, list->count);
+    for (int i = 0; i < list->count; i++)
+    {
+        if (kind == KVEC_F64)
+        {
+            v->f64[i] = kval_to_double(list->cells[i]);
+        }
+        else
+        {
+            v->i64[i] = list->cells[i]->num;
+        }
+    }
+
+    kval_del(a);
+    return kval_vec(v);
+}
+
+static kval *builtin_vec_to_list(kvec *v)
+{
+    kval *x = kval_qexpr();
+
+    // Integers go straight into a packed list
+    if (v->kind == KVEC_I64 && v->len)
+    {
+        x->count = v->len;
+        x->pack = KPACK_NUMS;
+        x->nums = malloc(sizeof(long) * v->len);
+        for (size_t i = 0; i < v->len; i++)
+        {
+            x->nums[i] = v->i64[i];
+        }
+
+        return x;
+    }
+
+    x->count = v->len;
+    x->cells = malloc(sizeof(kval *) * v->len);
+    for (size_t i = 0; i < v->len; i++)
+    {
+        x->cells[i] = v->kind == KVEC_F64 ? kval_dbl(v->f64[i]) : kval_num(v->i64[i]);
+    }
+
+    return x;
+}
+
+kval *builtin_vec_list(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("vec-list", a, 1);
+    K_ASSERT_TYPE("vec-list", a, 0, KVAL_VEC);
+
+    kval *x = builtin_vec_to_list(a->cells[0]->vec);
+
+    kval_del(a);
+    return x;
+}
+
+kval *builtin_vec_len(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("vec-len", a, 1);
+    K_ASSERT_TYPE("vec-len", a, 0, KVAL_VEC);
+
+    kval *x = kval_num(a->cells[0]->vec->len);
+
+    kval_del(a);
+    return x;
+}
+
+kval *builtin_vec_get(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("vec-get", a, 2);
+    K_ASSERT_TYPE("vec-get", a, 0, KVAL_VEC);
+    K_ASSERT_TYPE("vec-get", a, 1, KVAL_NUM);
+
+    kvec *v = a->cells[0]->vec;
+    long i = a->cells[1]->num;
+    K_ASSERT(a, i >= 0 && (size_t)i < v->len, "Function 'vec-get' index %li out of range for length %li.", i, (long)v->len);
+
+    kval *x = v->kind == KVEC_F64 ? kval_dbl(v->f64[i]) : kval_num(v->i64[i]);
+
+    kval_del(a);
+    return x;
+}
+
+// 0 up to n - 1
+kval *builtin_vec_range(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("vec-range", a, 1);
+    K_ASSERT_TYPE("vec-range", a, 0, KVAL_NUM);
+
+    long n = a->cells[0]->num;
+    K_ASSERT(a, n >= 0, "Function 'vec-range' passed a negative length.");
+
+    kvec *v = kvec_alloc(KVEC_I64, n);
+    for (long i = 0; i < n; i++)
+    {
+        v->i64[i] = i;
+    }
+
+    kval_del(a);
+    return kval_vec(v);
+}
+
+kval *builtin_vec_f64(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("vec-f64", a, 1);
+    K_ASSERT_TYPE("vec-f64", a, 0, KVAL_VEC);
+
+    kvec *v = a->cells[0]->vec;
+    v = v->kind == KVEC_F64 ? kvec_ref(v) : kvec_to_f64(v);
+
+    kval_del(a);
+    return kval_vec(v);
+}
+
+kval *builtin_dot(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("dot", a, 2);
+    K_ASSERT_TYPE("dot", a, 0, KVAL_VEC);
+    K_ASSERT_TYPE("dot", a, 1, KVAL_VEC);
+
+    kval *err = builtin_vec_check(a->cells[0], a->cells[1]);
+    if (err)
+    {
+        kval_del(a);
+        return err;
+    }
+
+    kvec *x = a->cells[0]->vec;
+    kvec *y = a->cells[1]->vec;
+    kval *r;
+
+    if (x->kind == KVEC_I64 && y->kind == KVEC_I64)
+    {
+        int64_t n;
+        r = kvec_i64_dot(x->i64, y->i64, x->len, &n) ? kval_err_kind(KERR_BAD_NUM, "Integer overflow in a vector op") : kval_num(n);
+    }
+    else
+    {
+        builtin_vec_side sx, sy;
+        builtin_vec_side_init(&sx, a->cells[0], KVEC_F64);
+        builtin_vec_side_init(&sy, a->cells[1], KVEC_F64);
+
+        r = kval_dbl(kvec_f64_dot(sx.f64, sy.f64, x->len));
+
+        if (sx.tmp)
+        {
+            kvec_unref(sx.tmp);
+        }
+
+        if (sy.tmp)
+        {
+            kvec_unref(sy.tmp);
+        }
+    }
+
+    kval_del(a);
+    return r;
+}
+
+kval *builtin_scale(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("scale", a, 2);
+    K_ASSERT_KIND(a, KERR_TYPE, a->cells[0]->type == KVAL_VEC || a->cells[0]->type == KVAL_MAT,
+                  "Function 'scale' passed incorrect type for argument 0. Got %s, Expected Vector or Matrix.",
+                  ktype_name(a->cells[0]->type));
+    K_ASSERT_NUMBER("scale", a, 1);
+
+    return builtin_op(e, a, '*');
+}
+
+// Folds op over a list from unit, or reduces a vector in one go
+static kval *builtin_fold(kenv *e, kval *a, char *func, char op, long unit)
+{
+    K_ASSERT_NUM(func, a, 1);
+
+    if (a->cells[0]->type == KVAL_VEC)
+    {
+        kvec *v = a->cells[0]->vec;
+
+        if (v->kind == KVEC_F64)
+        {
+            double d = op == '+' ? kvec_f64_sum(v->f64, v->len) : kvec_f64_product(v->f64, v->len);
+            kval_del(a);
+            return kval_dbl(d);
+        }
+
+        int64_t n;
+        int code = op == '+' ? kvec_i64_sum(v->i64, v->len, &n) : kvec_i64_product(v->i64, v->len, &n);
+        if (!code)
+        {
+            kval_del(a);
+            return kval_num(n);
+        }
+
+        // Outgrew 64 bits, go round again on boxed numbers so it can become a big one
+        kval *list = builtin_vec_to_list(v);
+        kval_del(a);
+        a = kval_sexpr();
+        kval_add(a, list);
+    }
+
+    K_ASSERT_TYPE(func, a, 0, KVAL_QEXPR);
+
+    kval *list = kval_unpack(kval_take(a, 0));
+    list->cells = realloc(list->cells, sizeof(kval *) * (list->count + 1));
+    memmove(list->cells + 1, list->cells, sizeof(kval *) * list->count);
+    list->cells[0] = kval_num(unit);
+    list->count++;
+
+    return builtin_op(e, list, op);
+}
+
+kval *builtin_sum(kenv *e, kval *a)
+{
+    return builtin_fold(e, a, "sum", '+', 0);
+}
+
+kval *builtin_product(kenv *e, kval *a)
+{
+    return builtin_fold(e, a, "product", '*', 1);
+}
+
+// Smallest or largest of some numbers, or of the elements of one vector
+static kval *builtin_extreme(kenv *e, kval *a, char *func, int largest)
+{
+    K_ASSERT_KIND(a, KERR_ARGS, a->count > 0, "Function '%s' passed no arguments.", func);
+
+    if (a->count == 1 && a->cells[0]->type == KVAL_VEC)
+    {
+        kvec *v = a->cells[0]->vec;
+        K_ASSERT_KIND(a, KERR_EMPTY, v->len > 0, "Function '%s' passed an empty vector.", func);
+
+        kval *x;
+        if (v->kind == KVEC_F64)
+        {
+            x = kval_dbl(kvec_f64_extreme(v->f64, v->len, largest));
+        }
+        else
+        {
+            x = kval_num(kvec_i64_extreme(v->i64, v->len, largest));
+        }
+
+        kval_del(a);
+        return x;
+    }
+
+    // One argument is its own extreme, whatever it is, as in the stdlib versions these replaced
+    if (a->count == 1)
+    {
+        return kval_take(a, 0);
+    }
+
+    int best = 0;
+    for (int i = 0; i < a->count; i++)
+    {
+        K_ASSERT_NUMBER(func, a, i);
+
+        int c = kval_cmp_num(a->cells[i], a->cells[best]);
+        if (largest ? c > 0 : c < 0)
+        {
+            best = i;
+        }
+    }
+
+    return kval_take(a, best);
+}
+
+kval *builtin_min(kenv *e, kval *a)
+{
+    return builtin_extreme(e, a, "min", 0);
+}
+
+kval *builtin_max(kenv *e, kval *a)
+{
+    return builtin_extreme(e, a, "max", 1);
+}
+
+// Elementwise comparison into a vector of 0s and 1s
+static kval *builtin_vec_cmp(kenv *e, kval *a, char *func, int cmp)
+{
+    K_ASSERT_NUM(func, a, 2);
+
+    kval *x = a->cells[0];
+    kval *y = a->cells[1];
+    K_ASSERT_KIND(a, KERR_TYPE,
+                  (x->type == KVAL_VEC || y->type == KVAL_VEC) &&
+                      (x->type == KVAL_VEC || kval_is_number(x)) &&
+                      (y->type == KVAL_VEC || kval_is_number(y)),
+                  "Function '%s' passed %s and %s, Expected a Vector and a Vector or Number.",
+                  func, ktype_name(x->type), ktype_name(y->type));
+
+    kval *err = builtin_vec_check(x, y);
+    if (err)
+    {
+        kval_del(a);
+        return err;
+    }
+
+    size_t n = x->type == KVAL_VEC ? x->vec->len : y->vec->len;
+    int kind = builtin_vec_kind(x) == KVEC_F64 || builtin_vec_kind(y) == KVEC_F64 ? KVEC_F64 : KVEC_I64;
+
+    builtin_vec_side sx, sy;
+    builtin_vec_side_init(&sx, x, kind);
+    builtin_vec_side_init(&sy, y, kind);
+
+    kvec *r = kvec_alloc(KVEC_I64, n);
+    if (kind == KVEC_F64)
+    {
+        kvec_f64_cmp(cmp, r->i64, sx.f64, sx.stride, sy.f64, sy.stride, n);
+    }
+    else
+    {
+        kvec_i64_cmp(cmp, r->i64, sx.i64, sx.stride, sy.i64, sy.stride, n);
+    }
+
+    if (sx.tmp)
+    {
+        kvec_unref(sx.tmp);
+    }
+
+    if (sy.tmp)
+    {
+        kvec_unref(sy.tmp);
+    }
+
+    kval_del(a);
+    return kval_vec(r);
+}
+
+kval *builtin_vec_gt(kenv *e, kval *a)
+{
+    return builtin_vec_cmp(e, a, "vec>", KVEC_GT);
+}
+
+kval *builtin_vec_lt(kenv *e, kval *a)
+{
+    return builtin_vec_cmp(e, a, "vec<", KVEC_LT);
+}
+
+kval *builtin_vec_ge(kenv *e, kval *a)
+{
+    return builtin_vec_cmp(e, a, "vec>=", KVEC_GE);
+}
+
+kval *builtin_vec_le(kenv *e, kval *a)
+{
+    return builtin_vec_cmp(e, a, "vec<=", KVEC_LE);
+}
+
+kval *builtin_vec_eq(kenv *e, kval *a)
+{
+    return builtin_vec_cmp(e, a, "vec==", KVEC_EQ);
+}
+
+// #################
+//  Matrices       #
+// #################
+
+// One row of a matrix, from a list of numbers or a vector. Non zero if it won't go.
+static int builtin_mat_fill_row(kval *row, double *out, size_t cols)
+{
+    if (row->type == KVAL_VEC)
+    {
+        if (row->vec->len != cols)
+        {
+            return 1;
+        }
+
+        for (size_t j = 0; j < cols; j++)
+        {
+            out[j] = row->vec->kind == KVEC_F64 ? row->vec->f64[j] : (double)row->vec->i64[j];
+        }
+
+        return 0;
+    }
+
+    if (row->type != KVAL_QEXPR || (size_t)row->count != cols)
+    {
+        return 1;
+    }
+
+    if (row->pack == KPACK_NUMS)
+    {
+        for (size_t j = 0; j < cols; j++)
+        {
+            out[j] = (double)row->nums[j];
+        }
+
+        return 0;
+    }
+
+    kval_unpack(row);
+    for (size_t j = 0; j < cols; j++)
+    {
+        if (!kval_is_number(row->cells[j]))
+        {
+            return 1;
+        }
+
+        out[j] = kval_to_double(row->cells[j]);
+    }
+
+    return 0;
+}
+
+// From a list of rows, each a list of numbers or a vector
+kval *builtin_mat(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("mat", a, 1);
+    K_ASSERT_TYPE("mat", a, 0, KVAL_QEXPR);
+
+    kval *list = kval_unpack(a->cells[0]);
+    size_t rows = list->count;
+    size_t cols = 0;
+
+    // Only lists and vectors have a length to take the columns from
+    for (size_t i = 0; i < rows; i++)
+    {
+        int type = list->cells[i]->type;
+        K_ASSERT_KIND(a, KERR_TYPE, type == KVAL_QEXPR || type == KVAL_VEC,
+                      "Function 'mat' passed incorrect type for row %li. Got %s, Expected %s or %s.",
+                      (long)i, ktype_name(type), ktype_name(KVAL_QEXPR), ktype_name(KVAL_VEC));
+    }
+
+    if (rows)
+    {
+        kval *first = list->cells[0];
+        cols = first->type == KVAL_VEC ? first->vec->len : (size_t)first->count;
+    }
+
+    kmat *m = kmat_alloc(rows, cols);
+    for (size_t i = 0; i < rows; i++)
+    {
+        if (builtin_mat_fill_row(list->cells[i], m->f64 + i * cols, cols))
+        {
+            kval *err = kval_err_kind(KERR_TYPE, "Function 'mat' passed a bad row %li, Expected %li Numbers.",
+                                      (long)i, (long)cols);
+            kmat_unref(m);
+            kval_del(a);
+            return err;
+        }
+    }
+
+    kval_del(a);
+    return kval_mat(m);
+}
+
+kval *builtin_mat_list(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("mat-list", a, 1);
+    K_ASSERT_TYPE("mat-list", a, 0, KVAL_MAT);
+
+    kmat *m = a->cells[0]->mat;
+    kval *x = kval_qexpr();
+
+    for (size_t i = 0; i < m->rows; i++)
+    {
+        kval *row = kval_qexpr();
+        for (size_t j = 0; j < m->cols; j++)
+        {
+            kval_add(row, kval_dbl(m->f64[i * m->cols + j]));
+        }
+
+        kval_add(x, row);
+    }
+
+    kval_del(a);
+    return x;
+}
+
+// {rows cols}
+kval *builtin_mat_shape(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("mat-shape", a, 1);
+    K_ASSERT_TYPE("mat-shape", a, 0, KVAL_MAT);
+
+    kmat *m = a->cells[0]->mat;
+    kval *x = kval_qexpr();
+    kval_add(x, kval_num(m->rows));
+    kval_add(x, kval_num(m->cols));
+
+    kval_del(a);
+    return kval_pack(x);
+}
+
+kval *builtin_mat_get(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("mat-get", a, 3);
+    K_ASSERT_TYPE("mat-get", a, 0, KVAL_MAT);
+    K_ASSERT_TYPE("mat-get", a, 1, KVAL_NUM);
+    K_ASSERT_TYPE("mat-get", a, 2, KVAL_NUM);
+
+    kmat *m = a->cells[0]->mat;
+    long i = a->cells[1]->num;
+    long j = a->cells[2]->num;
+    K_ASSERT(a, i >= 0 && (size_t)i < m->rows && j >= 0 && (size_t)j < m->cols,
+             "Function 'mat-get' index %li %li out of range for %lix%li.", i, j, (long)m->rows, (long)m->cols);
+
+    kval *x = kval_dbl(m->f64[i * m->cols + j]);
+
+    kval_del(a);
+    return x;
+}
+
+// Row or column i as a vector of doubles
+static kval *builtin_mat_slice(kenv *e, kval *a, char *func, int col)
+{
+    K_ASSERT_NUM(func, a, 2);
+    K_ASSERT_TYPE(func, a, 0, KVAL_MAT);
+    K_ASSERT_TYPE(func, a, 1, KVAL_NUM);
+
+    kmat *m = a->cells[0]->mat;
+    long i = a->cells[1]->num;
+    size_t count = col ? m->cols : m->rows;
+    K_ASSERT(a, i >= 0 && (size_t)i < count, "Function '%s' index %li out of range for %li.", func, i, (long)count);
+
+    size_t len = col ? m->rows : m->cols;
+    kvec *v = kvec_alloc(KVEC_F64, len);
+    for (size_t j = 0; j < len; j++)
+    {
+        v->f64[j] = col ? m->f64[j * m->cols + i] : m->f64[i * m->cols + j];
+    }
+
+    kval_del(a);
+    return kval_vec(v);
+}
+
+kval *builtin_mat_row(kenv *e, kval *a)
+{
+    return builtin_mat_slice(e, a, "mat-row", 0);
+}
+
+kval *builtin_mat_col(kenv *e, kval *a)
+{
+    return builtin_mat_slice(e, a, "mat-col", 1);
+}
+
+kval *builtin_mat_identity(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("mat-identity", a, 1);
+    K_ASSERT_TYPE("mat-identity", a, 0, KVAL_NUM);
+
+    long n = a->cells[0]->num;
+    K_ASSERT(a, n >= 0, "Function 'mat-identity' passed a negative size.");
+
+    kmat *m = kmat_alloc(n, n);
+    memset(m->f64, 0, sizeof(double) * n * n);
+    for (long i = 0; i < n; i++)
+    {
+        m->f64[i * n + i] = 1.0;
+    }
+
+    kval_del(a);
+    return kval_mat(m);
+}
+
+// The elements of a vector or matrix, a row at a time, as a rows by cols matrix
+kval *builtin_reshape(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("reshape", a, 3);
+    K_ASSERT_KIND(a, KERR_TYPE, a->cells[0]->type == KVAL_VEC || a->cells[0]->type == KVAL_MAT,
+                  "Function 'reshape' passed incorrect type for argument 0. Got %s, Expected Vector or Matrix.",
+                  ktype_name(a->cells[0]->type));
+    K_ASSERT_TYPE("reshape", a, 1, KVAL_NUM);
+    K_ASSERT_TYPE("reshape", a, 2, KVAL_NUM);
+
+    kval *x = a->cells[0];
+    long rows = a->cells[1]->num;
+    long cols = a->cells[2]->num;
+    size_t n = x->type == KVAL_VEC ? x->vec->len : x->mat->rows * x->mat->cols;
+    K_ASSERT(a, rows >= 0 && cols >= 0 && (size_t)rows * (size_t)cols == n,
+             "Function 'reshape' can't make %li elements %lix%li.", (long)n, rows, cols);
+
+    kmat *m = kmat_alloc(rows, cols);
+    for (size_t i = 0; i < n; i++)
+    {
+        if (x->type == KVAL_MAT)
+        {
+            m->f64[i] = x->mat->f64[i];
+        }
+        else
+        {
+            m->f64[i] = x->vec->kind == KVEC_F64 ? x->vec->f64[i] : (double)x->vec->i64[i];
+        }
+    }
+
+    kval_del(a);
+    return kval_mat(m);
+}
+
+kval *builtin_transpose(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("transpose", a, 1);
+    K_ASSERT_TYPE("transpose", a, 0, KVAL_MAT);
+
+    kmat *m = kmat_transpose(a->cells[0]->mat);
+
+    kval_del(a);
+    return kval_mat(m);
+}
+
+// Matrix by matrix, or matrix by vector taken as a column
+kval *builtin_matmul(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("matmul", a, 2);
+    K_ASSERT_TYPE("matmul", a, 0, KVAL_MAT);
+    K_ASSERT_KIND(a, KERR_TYPE, a->cells[1]->type == KVAL_MAT || a->cells[1]->type == KVAL_VEC,
+                  "Function 'matmul' passed incorrect type for argument 1. Got %s, Expected Matrix or Vector.",
+                  ktype_name(a->cells[1]->type));
+
+    kmat *x = a->cells[0]->mat;
+
+    if (a->cells[1]->type == KVAL_VEC)
+    {
+        kval *y = a->cells[1];
+        K_ASSERT_KIND(a, KERR_ARGS, y->vec->len == x->cols,
+                      "Function 'matmul' can't multiply %lix%li by a Vector of %li.",
+                      (long)x->rows, (long)x->cols, (long)y->vec->len);
+
+        builtin_vec_side sy;
+        builtin_vec_side_init(&sy, y, KVEC_F64);
+
+        kvec *r = kvec_alloc(KVEC_F64, x->rows);
+        for (size_t i = 0; i < x->rows; i++)
+        {
+            r->f64[i] = kvec_f64_dot(x->f64 + i * x->cols, sy.f64, x->cols);
+        }
+
+        if (sy.tmp)
+        {
+            kvec_unref(sy.tmp);
+        }
+
+        kval_del(a);
+        return kval_vec(r);
+    }
+
+    kmat *y = a->cells[1]->mat;
+    K_ASSERT_KIND(a, KERR_ARGS, x->cols == y->rows,
+                  "Function 'matmul' can't multiply %lix%li by %lix%li.",
+                  (long)x->rows, (long)x->cols, (long)y->rows, (long)y->cols);
+
+    kmat *r = kmat_alloc(x->rows, y->cols);
+    kmat_mul(r->f64, x->f64, y->f64, x->rows, x->cols, y->cols);
+
+    kval_del(a);
+    return kval_mat(r);
+}
+
+static kval *builtin_mat_sums(kenv *e, kval *a, char *func, int cols)
+{
+    K_ASSERT_NUM(func, a, 1);
+    K_ASSERT_TYPE(func, a, 0, KVAL_MAT);
+
+    kmat *m = a->cells[0]->mat;
+    kvec *v = kvec_alloc(KVEC_F64, cols ? m->cols : m->rows);
+
+    if (cols)
+    {
+        kmat_col_sums(m, v->f64);
+    }
+    else
+    {
+        kmat_row_sums(m, v->f64);
+    }
+
+    kval_del(a);
+    return kval_vec(v);
+}
+
+kval *builtin_row_sums(kenv *e, kval *a)
+{
+    return builtin_mat_sums(e, a, "row-sums", 0);
+}
+
+kval *builtin_col_sums(kenv *e, kval *a)
+{
+    return builtin_mat_sums(e, a, "col-sums", 1);
+}
+
+// #################
+//  Hash Tables    #
+// #################
+#define K_ASSERT_KEY(func, args, index)                                                   \
+    K_ASSERT_KIND(args, KERR_TYPE, khash_hashable(args->cells[index]),                    \
+                  "Function '%s' passed a %s as a key, Expected a Number, String or Symbol.", \
+                  func, ktype_name(args->cells[index]->type))
+
+// An error unless every element of the list is a {key value} pair with a key that passes keyable
+static kval *builtin_pairs_check(char *func, kval *pairs, int (*keyable)(kval *), char *expect)
+{
+    kval_unpack(pairs);
+    for (int i = 0; i < pairs->count; i++)
+    {
+        kval *p = pairs->cells[i];
+        if (p->type != KVAL_QEXPR || p->count != 2)
+        {
+            return kval_err_kind(KERR_TYPE, "Function '%s' passed %s at %i, Expected a {key value} pair.",
+                                 func, ktype_name(p->type), i);
+        }
+
+        kval_unpack(p);
+        if (!keyable(p->cells[0]))
+        {
+            return kval_err_kind(KERR_TYPE, "Function '%s' passed a %s as a key, Expected %s.",
+                                 func, ktype_name(p->cells[0]->type), expect);
+        }
+    }
+
+    return NULL;
+}
+
+// A table from a list of {key value} pairs, like the ones lookup takes
+kval *builtin_hash(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("hash", a, 1);
+    K_ASSERT_TYPE("hash", a, 0, KVAL_QEXPR);
+
+    kval *pairs = a->cells[0];
+    kval *err = builtin_pairs_check("hash", pairs, khash_hashable, "a Number, String or Symbol");
+    if (err)
+    {
+        kval_del(a);
+        return err;
+    }
+
+    khash *h = khash_new();
+    for (int i = 0; i < pairs->count; i++)
+    {
+        kval *p = pairs->cells[i];
+        kval *key = kval_pop(p, 0);
+        khash_put(h, key, kval_pop(p, 0));
+    }
+
+    kval_del(a);
+    return kval_table(h);
+}
+
+// The value for a key, or the default when it isn't there
+kval *builtin_hash_get(kenv *e, kval *a)
+{
+    K_ASSERT_KIND(a, KERR_ARGS, a->count == 2 || a->count == 3,
+                  "Function 'hash-get' passed incorrect number of arguments. Got %i, Expected 2 or 3.", a->count);
+    K_ASSERT_TYPE("hash-get", a, 0, KVAL_TABLE);
+    K_ASSERT_KEY("hash-get", a, 1);
+
+    kval *v = khash_get(a->cells[0]->table, a->cells[1]);
+    if (v)
+    {
+        v = kval_copy(v);
+        kval_del(a);
+        return v;
+    }
+
+    K_ASSERT_KIND(a, KERR_UNBOUND, a->count == 3, "Function 'hash-get' key not found.");
+
+    return kval_take(a, 2);
+}
+
+kval *builtin_hash_put(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("hash-put!", a, 3);
+    K_ASSERT_TYPE("hash-put!", a, 0, KVAL_TABLE);
+    K_ASSERT_KEY("hash-put!", a, 1);
+
+    khash *h = a->cells[0]->table;
+
+    // Tables are shared, so one inside itself could never be printed, written out or freed
+    K_ASSERT(a, !kval_holds(a->cells[2], h), "Function 'hash-put!' can't put a table inside itself.");
+
+    kval *key = kval_pop(a, 1);
+    int code = khash_put(h, key, kval_pop(a, 1));
+
+    K_ASSERT(a, code == 0, "Function 'hash-put!' can't add a key to a table that hash-each is walking.");
+
+    kval_del(a);
+    return kval_sexpr();
+}
+
+kval *builtin_hash_del(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("hash-del!", a, 2);
+    K_ASSERT_TYPE("hash-del!", a, 0, KVAL_TABLE);
+    K_ASSERT_KEY("hash-del!", a, 1);
+
+    khash_del(a->cells[0]->table, a->cells[1]);
+
+    kval_del(a);
+    return kval_sexpr();
+}
+
+kval *builtin_hash_has(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("hash-has", a, 2);
+    K_ASSERT_TYPE("hash-has", a, 0, KVAL_TABLE);
+    K_ASSERT_KEY("hash-has", a, 1);
+
+    kval *x = kval_num(khash_get(a->cells[0]->table, a->cells[1]) != NULL);
+
+    kval_del(a);
+    return x;
+}
+
+kval *builtin_hash_len(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("hash-len", a, 1);
+    K_ASSERT_TYPE("hash-len", a, 0, KVAL_TABLE);
+
+    kval *x = kval_num(a->cells[0]->table->count);
+
+    kval_del(a);
+    return x;
+}
+
+enum
+{
+    KHASH_KEYS,
+    KHASH_VALS,
+    KHASH_PAIRS
+};
+
+// The keys, values or {key value} pairs as a list, in table order
+static kval *builtin_hash_list(kenv *e, kval *a, char *func, int what)
+{
+    K_ASSERT_NUM(func, a, 1);
+    K_ASSERT_TYPE(func, a, 0, KVAL_TABLE);
+
+    khash *h = a->cells[0]->table;
+    kval *x = kval_qexpr();
+    x->cells = malloc(sizeof(kval *) * h->count);
+
+    for (size_t i = khash_next(h, 0); i < h->cap; i = khash_next(h, i + 1))
+    {
+        kval *y;
+        if (what == KHASH_PAIRS)
+        {
+            y = kval_qexpr();
+            kval_add(y, kval_copy(h->slots[i].key));
+            kval_add(y, kval_copy(h->slots[i].val));
+        }
+        else
+        {
+            y = kval_copy(what == KHASH_KEYS ? h->slots[i].key : h->slots[i].val);
+        }
+
+        x->cells[x->count++] = y;
+    }
+
+    kval_del(a);
+    return kval_pack(x);
+}
+
+kval *builtin_hash_keys(kenv *e, kval *a)
+{
+    return builtin_hash_list(e, a, "hash-keys", KHASH_KEYS);
+}
+
+kval *builtin_hash_vals(kenv *e, kval *a)
+{
+    return builtin_hash_list(e, a, "hash-vals", KHASH_VALS);
+}
+
+kval *builtin_hash_pairs(kenv *e, kval *a)
+{
+    return builtin_hash_list(e, a, "hash-pairs", KHASH_PAIRS);
+}
+
+// Calls f with each key and value, stopping at the first error
+kval *builtin_hash_each(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("hash-each", a, 2);
+    K_ASSERT_TYPE("hash-each", a, 0, KVAL_FUN);
+    K_ASSERT_TYPE("hash-each", a, 1, KVAL_TABLE);
+
+    kval *f = a->cells[0];
+    khash *h = khash_ref(a->cells[1]->table);
+    kval *r = NULL;
+
+    // f may delete as it goes, but adding keys could move everything, see khash_put
+    h->iters++;
+    for (size_t i = khash_next(h, 0); i < h->cap; i = khash_next(h, i + 1))
+    {
+        kval *args = kval_sexpr();
+        kval_add(args, kval_copy(h->slots[i].key));
+        kval_add(args, kval_copy(h->slots[i].val));
+
+        // Calling binds into the function's environment, so each call gets a fresh one
+        kval *g = kval_copy(f);
+        kval *x = kval_call(e, g, args);
+        kval_del(g);
+
+        if (x->type == KVAL_ERR)
+        {
+            r = x;
+            break;
+        }
+
+        kval_del(x);
+    }
+    h->iters--;
+
+    khash_unref(h);
+    kval_del(a);
+    return r ? r : kval_sexpr();
+}
+
+// #################
+//  Maps           #
+// #################
+
+// A map from a list of {key value} pairs, like hash
+kval *builtin_hmap(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("hmap", a, 1);
+    K_ASSERT_TYPE("hmap", a, 0, KVAL_QEXPR);
+
+    kval *pairs = a->cells[0];
+    kval *err = builtin_pairs_check("hmap", pairs, khash_hashable, "a Number, String or Symbol");
+    if (err)
+    {
+        kval_del(a);
+        return err;
+    }
+
+    kmap *m = kmap_new();
+    for (int i = 0; i < pairs->count; i++)
+    {
+        kval *p = pairs->cells[i];
+        kval *key = kval_pop(p, 0);
+        m = kmap_assoc(m, key, kval_pop(p, 0));
+    }
+
+    kval_del(a);
+    return kval_map(m);
+}
+
+// A new map with each key set to the value after it
+kval *builtin_assoc(kenv *e, kval *a)
+{
+    K_ASSERT_KIND(a, KERR_ARGS, a->count >= 3 && a->count % 2 == 1,
+                  "Function 'assoc' passed %i arguments, Expected a Map then keys and values in pairs.", a->count);
+    K_ASSERT_TYPE("assoc", a, 0, KVAL_MAP);
+
+    for (int i = 1; i < a->count; i += 2)
+    {
+        K_ASSERT_KEY("assoc", a, i);
+    }
+
+    // A map nothing else holds is updated in place, otherwise the first
+    // assoc copies the path to its key and later ones reuse the copy
+    kval *x = kval_pop(a, 0);
+    while (a->count > 0)
+    {
+        kval *key = kval_pop(a, 0);
+        x->map = kmap_assoc(x->map, key, kval_pop(a, 0));
+    }
+
+    kval_del(a);
+    return x;
+}
+
+// A new map without the keys
+kval *builtin_dissoc(kenv *e, kval *a)
+{
+    K_ASSERT_KIND(a, KERR_ARGS, a->count >= 2,
+                  "Function 'dissoc' passed %i arguments, Expected a Map and keys.", a->count);
+    K_ASSERT_TYPE("dissoc", a, 0, KVAL_MAP);
+
+    for (int i = 1; i < a->count; i++)
+    {
+        K_ASSERT_KEY("dissoc", a, i);
+    }
+
+    kval *x = kval_pop(a, 0);
+    for (int i = 0; i < a->count; i++)
+    {
+        x->map = kmap_dissoc(x->map, a->cells[i]);
+    }
+
+    kval_del(a);
+    return x;
+}
+
+kval *builtin_hmap_get(kenv *e, kval *a)
+{
+    K_ASSERT_KIND(a, KERR_ARGS, a->count == 2 || a->count == 3,
+                  "Function 'hmap-get' passed incorrect number of arguments. Got %i, Expected 2 or 3.", a->count);
+    K_ASSERT_TYPE("hmap-get", a, 0, KVAL_MAP);
+    K_ASSERT_KEY("hmap-get", a, 1);
+
+    kval *v = kmap_get(a->cells[0]->map, a->cells[1]);
+    if (v)
+    {
+        v = kval_copy(v);
+        kval_del(a);
+        return v;
+    }
+
+    K_ASSERT_KIND(a, KERR_UNBOUND, a->count == 3, "Function 'hmap-get' key not found.");
+
+    return kval_take(a, 2);
+}
+
+kval *builtin_hmap_has(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("hmap-has", a, 2);
+    K_ASSERT_TYPE("hmap-has", a, 0, KVAL_MAP);
+    K_ASSERT_KEY("hmap-has", a, 1);
+
+    kval *x = kval_num(kmap_get(a->cells[0]->map, a->cells[1]) != NULL);
+
+    kval_del(a);
+    return x;
+}
+
+kval *builtin_hmap_len(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("hmap-len", a, 1);
+    K_ASSERT_TYPE("hmap-len", a, 0, KVAL_MAP);
+
+    kval *x = kval_num(a->cells[0]->map->count);
+
+    kval_del(a);
+    return x;
+}
+
+typedef struct
+{
+    kval *list;
+    int what;
+} builtin_hmap_collect;
+
+static int builtin_hmap_add(kval *key, kval *val, void *ctx)
+{
+    builtin_hmap_collect *c = ctx;
+    kval *y;
+
+    if (c->what == KHASH_PAIRS)
+    {
+        y = kval_qexpr();
+        kval_add(y, kval_copy(key));
+        kval_add(y, kval_copy(val));
+    }
+    else
+    {
+        y = kval_copy(c->what == KHASH_KEYS ? key : val);
+    }
+
+    c->list->cells[c->list->count++] = y;
+    return 0;
+}
+
+// The keys, values or {key value} pairs as a list, in map order
+static kval *builtin_hmap_list(kenv *e, kval *a, char *func, int what)
+{
+    K_ASSERT_NUM(func, a, 1);
+    K_ASSERT_TYPE(func, a, 0, KVAL_MAP);
+
+    kmap *m = a->cells[0]->map;
+    builtin_hmap_collect c = {kval_qexpr(), what};
+    c.list->cells = malloc(sizeof(kval *) * m->count);
+    kmap_walk(m, builtin_hmap_add, &c);
+
+    kval_del(a);
+    return kval_pack(c.list);
+}
+
+kval *builtin_hmap_keys(kenv *e, kval *a)
+{
+    return builtin_hmap_list(e, a, "hmap-keys", KHASH_KEYS);
+}
+
+kval *builtin_hmap_vals(kenv *e, kval *a)
+{
+    return builtin_hmap_list(e, a, "hmap-vals", KHASH_VALS);
+}
+
+kval *builtin_hmap_pairs(kenv *e, kval *a)
+{
+    return builtin_hmap_list(e, a, "hmap-pairs", KHASH_PAIRS);
+}
+
+// #################
+//  Sorted Maps    #
+// #################
+#define K_ASSERT_SORTED_KEY(func, args, index)                                        \
+    K_ASSERT_KIND(args, KERR_TYPE, ksorted_keyable(args->cells[index]),               \
+                  "Function '%s' passed a %s as a key, Expected a String or a Number other than nan.", \
+                  func, ktype_name(args->cells[index]->type))
+
+// A sorted map from a list of {key value} pairs, like hash
+kval *builtin_sorted(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("sorted", a, 1);
+    K_ASSERT_TYPE("sorted", a, 0, KVAL_QEXPR);
+
+    kval *pairs = a->cells[0];
+    kval *err = builtin_pairs_check("sorted", pairs, ksorted_keyable, "a String or a Number other than nan");
+    if (err)
+    {
+        kval_del(a);
+        return err;
+    }
+
+    ksorted *t = ksorted_new();
+    for (int i = 0; i < pairs->count; i++)
+    {
+        kval *p = pairs->cells[i];
+        kval *key = kval_pop(p, 0);
+        t = ksorted_put(t, key, kval_pop(p, 0));
+    }
+
+    kval_del(a);
+    return kval_sorted(t);
+}
+
+// A new sorted map with each key set to the value after it, updated in place when nothing else holds it
+kval *builtin_sorted_put(kenv *e, kval *a)
+{
+    K_ASSERT_KIND(a, KERR_ARGS, a->count >= 3 && a->count % 2 == 1,
+                  "Function 'sorted-put' passed %i arguments, Expected a Sorted Map then keys and values in pairs.", a->count);
+    K_ASSERT_TYPE("sorted-put", a, 0, KVAL_SORTED);
+
+    for (int i = 1; i < a->count; i += 2)
+    {
+        K_ASSERT_SORTED_KEY("sorted-put", a, i);
+    }
+
+    kval *x = kval_pop(a, 0);
+    while (a->count > 0)
+    {
+        kval *key = kval_pop(a, 0);
+        x->sorted = ksorted_put(x->sorted, key, kval_pop(a, 0));
+    }
+
+    kval_del(a);
+    return x;
+}
+
+// A new sorted map without the keys
+kval *builtin_sorted_del(kenv *e, kval *a)
+{
+    K_ASSERT_KIND(a, KERR_ARGS, a->count >= 2,
+                  "Function 'sorted-del' passed %i arguments, Expected a Sorted Map and keys.", a->count);
+    K_ASSERT_TYPE("sorted-del", a, 0, KVAL_SORTED);
+
+    for (int i = 1; i < a->count; i++)
+    {
+        K_ASSERT_SORTED_KEY("sorted-del", a, i);
+    }
+
+    kval *x = kval_pop(a, 0);
+    while (a->count > 0)
+    {
+        x->sorted = ksorted_del(x->sorted, kval_pop(a, 0));
+    }
+
+    kval_del(a);
+    return x;
+}
+
+kval *builtin_sorted_get(kenv *e, kval *a)
+{
+    K_ASSERT_KIND(a, KERR_ARGS, a->count == 2 || a->count == 3,
+                  "Function 'sorted-get' passed incorrect number of arguments. Got %i, Expected 2 or 3.", a->count);
+    K_ASSERT_TYPE("sorted-get", a, 0, KVAL_SORTED);
+    K_ASSERT_SORTED_KEY("sorted-get", a, 1);
+
+    kval *v = ksorted_get(a->cells[0]->sorted, a->cells[1]);
+    if (v)
+    {
+        kval_del(a);
+        return v;
+    }
+
+    K_ASSERT_KIND(a, KERR_UNBOUND, a->count == 3, "Function 'sorted-get' key not found.");
+
+    return kval_take(a, 2);
+}
+
+kval *builtin_sorted_has(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("sorted-has", a, 2);
+    K_ASSERT_TYPE("sorted-has", a, 0, KVAL_SORTED);
+    K_ASSERT_SORTED_KEY("sorted-has", a, 1);
+
+    kval *v = ksorted_get(a->cells[0]->sorted, a->cells[1]);
+    kval *x = kval_num(v != NULL);
+
+    if (v)
+    {
+        kval_del(v);
+    }
+    kval_del(a);
+    return x;
+}
+
+kval *builtin_sorted_len(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("sorted-len", a, 1);
+    K_ASSERT_TYPE("sorted-len", a, 0, KVAL_SORTED);
+
+    kval *x = kval_num(a->cells[0]->sorted->count);
+
+    kval_del(a);
+    return x;
+}
+
+static kval *builtin_sorted_end(kenv *e, kval *a, char *func, int last)
+{
+    K_ASSERT_NUM(func, a, 1);
+    K_ASSERT_TYPE(func, a, 0, KVAL_SORTED);
+    K_ASSERT_KIND(a, KERR_EMPTY, a->cells[0]->sorted->count > 0, "Function '%s' passed an empty sorted map.", func);
+
+    kval *key;
+    kval *val;
+    if (last)
+    {
+        ksorted_last(a->cells[0]->sorted, &key, &val);
+    }
+    else
+    {
+        ksorted_first(a->cells[0]->sorted, &key, &val);
+    }
+
+    kval *p = kval_qexpr();
+    kval_add(p, key);
+    kval_add(p, val);
+
+    kval_del(a);
+    return p;
+}
+
+// The {key value} pair with the smallest key
+kval *builtin_sorted_first(kenv *e, kval *a)
+{
+    return builtin_sorted_end(e, a, "sorted-first", 0);
+}
+
+kval *builtin_sorted_last(kenv *e, kval *a)
+{
+    return builtin_sorted_end(e, a, "sorted-last", 1);
+}
+
+typedef struct
+{
+    kval *list;
+    int cap;
+    int what;
+} builtin_sorted_collect;
+
+// Takes key and val from the walk
+static int builtin_sorted_add(kval *key, kval *val, void *ctx)
+{
+    builtin_sorted_collect *c = ctx;
+    kval *y;
+
+    if (c->what == KHASH_PAIRS)
+    {
+        y = kval_qexpr();
+        kval_add(y, key);
+        kval_add(y, val);
+    }
+    else if (c->what == KHASH_KEYS)
+    {
+        y = key;
+        kval_del(val);
+    }
+    else
+    {
+        y = val;
+        kval_del(key);
+    }
+
+    if (c->list->count == c->cap)
+    {
+        c->cap = c->cap ? c->cap * 2 : 16;
+        c->list->cells = realloc(c->list->cells, sizeof(kval *) * c->cap);
+    }
+
+    c->list->cells[c->list->count++] = y;
+    return 0;
+}
+
+// Entries with lo <= key < hi, either bound NULL for none, as a list in key order
+static kval *builtin_sorted_collect_range(ksorted *t, kval *lo, kval *hi, int what)
+{
+    builtin_sorted_collect c = {kval_qexpr(), 0, what};
+
+    // The whole map's size is known up front
+    if (!lo && !hi && t->count > 0)
+    {
+        c.cap = (int)t->count;
+        c.list->cells = malloc(sizeof(kval *) * c.cap);
+    }
+
+    ksorted_range(t, lo, hi, builtin_sorted_add, &c);
+    return kval_pack(c.list);
+}
+
+// {key value} pairs with from <= key < to
+kval *builtin_range_from_to(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("range-from-to", a, 3);
+    K_ASSERT_TYPE("range-from-to", a, 0, KVAL_SORTED);
+    K_ASSERT_SORTED_KEY("range-from-to", a, 1);
+    K_ASSERT_SORTED_KEY("range-from-to", a, 2);
+
+    kval *x = builtin_sorted_collect_range(a->cells[0]->sorted, a->cells[1], a->cells[2], KHASH_PAIRS);
+
+    kval_del(a);
+    return x;
+}
+
+static kval *builtin_sorted_list(kenv *e, kval *a, char *func, int what)
+{
+    K_ASSERT_NUM(func, a, 1);
+    K_ASSERT_TYPE(func, a, 0, KVAL_SORTED);
+
+    kval *x = builtin_sorted_collect_range(a->cells[0]->sorted, NULL, NULL, what);
+
+    kval_del(a);
+    return x;
+}
+
+kval *builtin_sorted_keys(kenv *e, kval *a)
+{
+    return builtin_sorted_list(e, a, "sorted-keys", KHASH_KEYS);
+}
+
+kval *builtin_sorted_vals(kenv *e, kval *a)
+{
+    return builtin_sorted_list(e, a, "sorted-vals", KHASH_VALS);
+}
+
+kval *builtin_sorted_pairs(kenv *e, kval *a)
+{
+    return builtin_sorted_list(e, a, "sorted-pairs", KHASH_PAIRS);
+}
+
+// #################
+//  Sets           #
+// #################
+
+// A set of the elements of a list, or of an integer vector
+kval *builtin_set(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("set", a, 1);
+    K_ASSERT_KIND(a, KERR_TYPE, a->cells[0]->type == KVAL_QEXPR || a->cells[0]->type == KVAL_VEC,
+                  "Function 'set' passed incorrect type for argument 0. Got %s, Expected Q-Expression or Vector.",
+                  ktype_name(a->cells[0]->type));
+
+    kval *x = a->cells[0];
+    kset *s;
+
+    if (x->type == KVAL_VEC)
+    {
+        K_ASSERT_KIND(a, KERR_TYPE, x->vec->kind == KVEC_I64, "Function 'set' passed a Vector of doubles.");
+        s = kset_from_nums((const long *)x->vec->i64, x->vec->len);
+    }
+    else if (x->pack == KPACK_NUMS)
+    {
+        s = kset_from_nums(x->nums, x->count);
+    }
+    else
+    {
+        kval_unpack(x);
+        for (int i = 0; i < x->count; i++)
+        {
+            K_ASSERT_KIND(a, KERR_TYPE, khash_hashable(x->cells[i]),
+                          "Function 'set' passed %s at %i, Expected a Number, String or Symbol.",
+                          ktype_name(x->cells[i]->type), i);
+        }
+
+        s = kset_new();
+        while (x->count > 0)
+        {
+            s = kset_add(s, kval_pop(x, 0));
+        }
+    }
+
+    kval_del(a);
+    return kval_set(s);
+}
+
+// A new set with the elements added, in place when nothing else holds it
+kval *builtin_set_add(kenv *e, kval *a)
+{
+    K_ASSERT_KIND(a, KERR_ARGS, a->count >= 2,
+                  "Function 'set-add' passed %i arguments, Expected a Set and elements.", a->count);
+    K_ASSERT_TYPE("set-add", a, 0, KVAL_SET);
+
+    for (int i = 1; i < a->count; i++)
+    {
+        K_ASSERT_KEY("set-add", a, i);
+    }
+
+    kval *x = kval_pop(a, 0);
+    while (a->count > 0)
+    {
+        x->set = kset_add(x->set, kval_pop(a, 0));
+    }
+
+    kval_del(a);
+    return x;
+}
+
+kval *builtin_set_has(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("set-has", a, 2);
+    K_ASSERT_TYPE("set-has", a, 0, KVAL_SET);
+    K_ASSERT_KEY("set-has", a, 1);
+
+    kval *x = kval_num(kset_has(a->cells[0]->set, a->cells[1]));
+
+    kval_del(a);
+    return x;
+}
+
+kval *builtin_set_len(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("set-len", a, 1);
+    K_ASSERT_TYPE("set-len", a, 0, KVAL_SET);
+
+    kval *x = kval_num(a->cells[0]->set->count);
+
+    kval_del(a);
+    return x;
+}
+
+static int builtin_set_elem(kval *x, void *list)
+{
+    kval *l = list;
+    l->cells[l->count++] = kval_copy(x);
+
+    return 0;
+}
+
+// The elements as a list, in increasing order while they're all small numbers
+kval *builtin_set_list(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("set-list", a, 1);
+    K_ASSERT_TYPE("set-list", a, 0, KVAL_SET);
+
+    kset *s = a->cells[0]->set;
+    kval *x = kval_qexpr();
+
+    // A bitmap goes straight into a packed list
+    if (s->dense && s->count)
+    {
+        x->pack = KPACK_NUMS;
+        x->nums = malloc(sizeof(long) * s->count);
+        for (size_t w = 0; w < s->nwords; w++)
+        {
+            for (uint64_t b = s->bits[w]; b; b &= b - 1)
+            {
+                x->nums[x->count++] = (long)(w * 64 + __builtin_ctzll(b));
+            }
+        }
+    }
+    else if (s->count)
+    {
+        x->cells = malloc(sizeof(kval *) * s->count);
+        kset_walk(s, builtin_set_elem, x);
+        x = kval_pack(x);
+    }
+
+    kval_del(a);
+    return x;
+}
+
+enum
+{
+    KSET_UNION,
+    KSET_INTERSECTION,
+    KSET_DIFFERENCE
+};
+
+// Folds op over two or more sets, left to right
+static kval *builtin_set_op(kenv *e, kval *a, char *func, int op)
+{
+    K_ASSERT_KIND(a, KERR_ARGS, a->count >= 2,
+                  "Function '%s' passed %i arguments, Expected at least 2 Sets.", func, a->count);
+
+    for (int i = 0; i < a->count; i++)
+    {
+        K_ASSERT_TYPE(func, a, i, KVAL_SET);
+    }
+
+    kval *x = kval_pop(a, 0);
+    for (int i = 0; i < a->count; i++)
+    {
+        kset *y = a->cells[i]->set;
+
+        if (op == KSET_UNION)
+        {
+            x->set = kset_union(x->set, y);
+            continue;
+        }
+
+        kset *r = op == KSET_INTERSECTION ? kset_intersection(x->set, y) : kset_difference(x->set, y);
+        kset_unref(x->set);
+        x->set = r;
+    }
+
+    kval_del(a);
+    return x;
+}
+
+kval *builtin_union(kenv *e, kval *a)
+{
+    return builtin_set_op(e, a, "union", KSET_UNION);
+}
+
+kval *builtin_intersection(kenv *e, kval *a)
+{
+    return builtin_set_op(e, a, "intersection", KSET_INTERSECTION);
+}
+
+// The first set without anything in the others
+kval *builtin_difference(kenv *e, kval *a)
+{
+    return builtin_set_op(e, a, "difference", KSET_DIFFERENCE);
+}
+
+// #################
+//  Sorting        #
+// #################
+
+static int builtin_sort_num_less(kval *x, kval *y, void *ctx)
+{
+    return kval_cmp_num(x, y) < 0;
+}
+
+// Flattened before sorting starts
+static int builtin_sort_str_less(kval *x, kval *y, void *ctx)
+{
+    size_t len = x->len < y->len ? x->len : y->len;
+    int c = memcmp(x->str, y->str, len);
+
+    return c < 0 || (c == 0 && x->len < y->len);
+}
+
+// Sorts a list of numbers, or of strings, in increasing order
+kval *builtin_sort(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("sort", a, 1);
+    K_ASSERT_TYPE("sort", a, 0, KVAL_QEXPR);
+
+    // Only integers, or only interned strings, pack, and have their own sorts
+    kval *x = kval_pack(a->cells[0]);
+
+    if (x->pack == KPACK_NONE && x->count > 0)
+    {
+        int nums = kval_is_number(x->cells[0]);
+        for (int i = 0; i < x->count; i++)
+        {
+            kval *v = x->cells[i];
+            K_ASSERT_KIND(a, KERR_TYPE, nums ? kval_is_number(v) : v->type == KVAL_STR,
+                          "Function 'sort' passed %s at %i, Expected %s.",
+                          ktype_name(v->type), i, nums || i == 0 ? "a Number" : "a String");
+        }
+
+        for (int i = 0; !nums && i < x->count; i++)
+        {
+            kval_str_flat(x->cells[i]);
+        }
+
+        ksort_vals(x->cells, x->count, nums ? builtin_sort_num_less : builtin_sort_str_less, NULL);
+    }
+    else if (x->pack == KPACK_NUMS)
+    {
+        ksort_nums(x->nums, x->count);
+    }
+    else if (x->pack == KPACK_STRS)
+    {
+        ksort_strs(x->strs, x->count);
+    }
+
+    return kval_take(a, 0);
+}
+
+/*
+    A comparator being called over and over. A lambda of two arguments
+    is called in one environment kept for every call, under its own,
+    with the arguments bound into it and everything dropped again after
+    each call. That's what kval_call ends up doing, without copying the
+    lambda and its environment every time.
+*/
+typedef struct
+{
+    kenv *e;
+    kval *f;
+
+    // Where a lambda's arguments go, or NULL to go through kval_call
+    kenv *frame;
+
+    // The first error, after which nothing else is called
+    kval *err;
+} builtin_sorter;
+
+static void builtin_sorter_init(builtin_sorter *s, kenv *e, kval *f)
+{
+    s->e = e;
+    s->f = f;
+    s->frame = NULL;
+    s->err = NULL;
+
+    if (f->fun || f->rec || f->formals->count != 2 ||
+        strcmp(f->formals->cells[0]->sym, "&") == 0 ||
+        strcmp(f->formals->cells[1]->sym, "&") == 0)
+    {
+        return;
+    }
+
+    f->fenv->parent = e;
+    s->frame = kenv_init();
+    s->frame->parent = f->fenv;
+}
+
+static int builtin_sorter_less(kval *x, kval *y, void *ctx)
+{
+    builtin_sorter *s = ctx;
+    if (s->err)
+    {
+        return 0;
+    }
+
+    kval *r;
+    if (s->frame)
+    {
+        // Bound in order, so with the same symbol twice the second argument wins, as in kval_call
+        kenv_put(s->frame, s->f->formals->cells[0], x);
+        kenv_put(s->frame, s->f->formals->cells[1], y);
+
+        kval *body = kval_unpack(kval_copy(s->f->body));
+        body->type = KVAL_SEXPR;
+        r = kval_eval(s->frame, body);
+
+        kenv_clear(s->frame);
+    }
+    else
+    {
+        kval *args = kval_sexpr();
+        kval_add(args, kval_copy(x));
+        kval_add(args, kval_copy(y));
+
+        // A builtin can be called as it is, a lambda binds into its environment
+        kval *g = s->f->fun ? s->f : kval_copy(s->f);
+        r = kval_call(s->e, g, args);
+        if (g != s->f)
+        {
+            kval_del(g);
+        }
+    }
+
+    if (r->type == KVAL_ERR)
+    {
+        s->err = r;
+        return 0;
+    }
+
+    if (r->type != KVAL_NUM)
+    {
+        s->err = kval_err_kind(KERR_TYPE, "Function 'sort-by' got %s from its comparator, Expected %s.",
+                               ktype_name(r->type), ktype_name(KVAL_NUM));
+        kval_del(r);
+        return 0;
+    }
+
+    int less = r->num != 0;
+    kval_del(r);
+
+    return less;
+}
+
+// Sorts a list by a function of two elements that is true when the first goes before the second
+kval *builtin_sort_by(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("sort-by", a, 2);
+    K_ASSERT_TYPE("sort-by", a, 0, KVAL_FUN);
+    K_ASSERT_TYPE("sort-by", a, 1, KVAL_QEXPR);
+
+    kval *f = kval_pop(a, 0);
+    kval *x = kval_unpack(kval_take(a, 0));
+
+    builtin_sorter s;
+    builtin_sorter_init(&s, e, f);
+    ksort_vals(x->cells, x->count, builtin_sorter_less, &s);
+    kval_del(f);
+
+    if (s.frame)
+    {
+        kenv_del(s.frame);
+    }
+
+    if (s.err)
+    {
+        kval_del(x);
+        return s.err;
+    }
+
+    return kval_pack(x);
+}
+
+// #################
+//  Records        #
+// #################
+
+/*
+    Defines a record type, with a constructor named after it and an
+    accessor for each field named after both, so (defrecord {point} {x y})
+    defines point, point-x and point-y. Each accessor knows its slot from
+    here on, and never looks at the field names again.
+*/
+kval *builtin_defrecord(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("defrecord", a, 2);
+    K_ASSERT_TYPE("defrecord", a, 0, KVAL_QEXPR);
+    K_ASSERT_TYPE("defrecord", a, 1, KVAL_QEXPR);
+    K_ASSERT_KIND(a, KERR_ARGS, a->cells[0]->count == 1,
+                  "Function 'defrecord' passed %i names, Expected 1.", a->cells[0]->count);
+    K_ASSERT_NOT_EMPTY("defrecord", a, 1);
+
+    kval *names = kval_unpack(kval_pop(a, 0));
+    names = kval_join(names, kval_unpack(kval_take(a, 0)));
+
+    for (int i = 0; i < names->count; i++)
+    {
+        K_ASSERT_KIND(names, KERR_TYPE, names->cells[i]->type == KVAL_SYM,
+                      "Function 'defrecord' cannot define non-symbol. Got %s, Expected %s.",
+                      ktype_name(names->cells[i]->type), ktype_name(KVAL_SYM));
+
+        // Index 0 is the type name, which a field may share, so fields are only checked against each other
+        for (int j = 1; j < i; j++)
+        {
+            K_ASSERT_KIND(names, KERR_ARGS, strcmp(names->cells[i]->sym, names->cells[j]->sym) != 0,
+                          "Function 'defrecord' passed field '%s' twice.", names->cells[i]->sym);
+        }
+    }
+
+    krecord *r = krecord_new(names);
+
+    kval *f = kval_record_fun(krecord_ref(r), -1);
+    kenv_def(e, names->cells[0], f);
+    kval_del(f);
+
+    kval *type = names->cells[0];
+    for (int i = 1; i < names->count; i++)
+    {
+        kval *field = names->cells[i];
+        char *buf = malloc(type->len + field->len + 1);
+        memcpy(buf, type->sym, type->len);
+        buf[type->len] = '-';
+        memcpy(buf + type->len + 1, field->sym, field->len);
+
+        kval *name = kval_sym_n(buf, type->len + field->len + 1);
+        free(buf);
+
+        f = kval_record_fun(krecord_ref(r), i - 1);
+        kenv_def(e, name, f);
+        kval_del(name);
+        kval_del(f);
+    }
+
+    krecord_unref(r);
+    return kval_sexpr();
+}
+
+// Calls the constructor or an accessor f of a record type
+kval *builtin_record_call(kenv *e, kval *f, kval *a)
+{
+    krecord *r = f->rec;
+    const char *name = krecord_name(r);
+
+    if (f->slot < 0)
+    {
+        K_ASSERT_KIND(a, KERR_ARGS, a->count == krecord_count(r),
+                      "Function '%s' passed incorrect number of arguments. Got %i, Expected %i.",
+                      name, a->count, krecord_count(r));
+
+        // The arguments are already a run of cells, so they become the fields as they are
+        kval_unpack(a);
+        a->type = KVAL_RECORD;
+        a->rec = krecord_ref(r);
+        return a;
+    }
+
+    const char *field = krecord_field(r, f->slot);
+    K_ASSERT_KIND(a, KERR_ARGS, a->count == 1,
+                  "Function '%s-%s' passed incorrect number of arguments. Got %i, Expected 1.",
+                  name, field, a->count);
+
+    kval *x = a->cells[0];
+    K_ASSERT_KIND(a, KERR_TYPE, x->type == KVAL_RECORD && krecord_eq(x->rec, r),
+                  "Function '%s-%s' passed incorrect type. Got %s, Expected %s.",
+                  name, field, x->type == KVAL_RECORD ? krecord_name(x->rec) : ktype_name(x->type), name);
+
+    // The record goes with the arguments, so the field is moved out of it rather than copied
+    kval *v = x->cells[f->slot];
+    x->cells[f->slot] = x->cells[--x->count];
+
+    kval_del(a);
+    return v;
+}
+
+// #################
+// Files           #
+// #################
+kval *builtin_load(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("load", a, 1);
+    K_ASSERT_TYPE("load", a, 0, KVAL_STR);
+
+    if (kread_use_mpc)
+    {
+        return builtin_load_mpc(e, a);
+    }
+
+    kreader r;
+    if (!kreader_open(&r, kval_str_flat(a->cells[0])))
+    {
+        kval *err = kval_err("Could not load file %s: error: Unable to open file!", a->cells[0]->str);
+        kval_del(a);
+
+        return err;
+    }
+
+    // Read, evaluate and free one form at a time
+    kval *form;
+    while ((form = kreader_next(&r)))
+    {
+        kval *x = kval_eval(e, form);
+        if (x->type == KVAL_ERR)
+        {
+            kval_println(x);
+        }
+        kval_del(x);
+    }
+
+    kval *result = r.error
+                       ? kval_err("Could not load file %s", kval_err_msg(r.error))
+                       : kval_sexpr();
+
+    kreader_close(&r);
+    kval_del(a);
+
+    return result;
+}
+
+kval *builtin_load_mpc(kenv *e, kval *a)
+{
+    kval *expr = parser_read_file(kval_str_flat(a->cells[0]));
+    kval_del(a);
+
+    return builtin_load_forms(e, expr);
+}
+
+// Evaluate an already read file, as returned by kread_file/parser_read_file
+kval *builtin_load_forms(kenv *e, kval *expr)
+{
+    if (expr->type == KVAL_ERR)
+    {
+        kval *err = kval_err("Could not load file %s", kval_err_msg(expr));
+        kval_del(expr);
+
+        return err;
+    }
+
+    // Evaluate in order, handing each form over instead of popping it off the front
+    for (int i = 0; i < expr->count; i++)
+    {
+        kval *x = kval_eval(e, expr->cells[i]);
+        if (x->type == KVAL_ERR)
+        {
+            kval_println(x);
+        }
+        kval_del(x);
+    }
+
+    expr->count = 0;
+    kval_del(expr);
+
+    return kval_sexpr();
+}
+
+kval *builtin_serialize(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("serialize", a, 2);
+    K_ASSERT_TYPE("serialize", a, 0, KVAL_STR);
+
+    kval *x = kser_save(kval_str_flat(a->cells[0]), a->cells[1])
+                  ? kval_sexpr()
+                  : kval_err("Could not write file %s", a->cells[0]->str);
+
+    kval_del(a);
+    return x;
+}
+
+kval *builtin_deserialize(kenv *e, kval *a)
+{
+    K_ASSERT_NUM("deserialize", a, 1);
+    K_ASSERT_TYPE("deserialize", a, 0, KVAL_STR);
+
+    kval *x = kser_load(kval_str_flat(a->cells[0]));
+
+    kval_del(a);
+    return x;
 }
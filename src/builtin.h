@@ -6,7 +6,8 @@
 #include "types.h"
 
 kval *builtin(kenv *e, kval *a, char *func);
-kval *builtin_op(kenv *e, kval *kv, char *op);
+// op is one of '+', '-', '*' or '/'
+kval *builtin_op(kenv *e, kval *kv, char op);
 
 // #################
 //  List Functions #
@@ -40,21 +41,142 @@ kval *builtin_gt(kenv *e, kval *a);
 kval *builtin_lt(kenv *e, kval *a);
 kval *builtin_ge(kenv *e, kval *a);
 kval *builtin_le(kenv *e, kval *a);
-kval *builtin_ord(kenv *e, kval *a, char *op);
+enum
+{
+    KORD_GT,
+    KORD_LT,
+    KORD_GE,
+    KORD_LE
+};
+
+kval *builtin_ord(kenv *e, kval *a, int op);
 kval *builtin_cmp(kenv *e, kval *a, char *op);
 kval *builtin_eq(kenv *e, kval *a);
 kval *builtin_ne(kenv *e, kval *a);
 kval *builtin_if(kenv *e, kval *a);
+kval *builtin_try(kenv *e, kval *a);
 
 // #################
 //  Strings        #
 // #################
 kval *builtin_error(kenv *e, kval *a);
 kval *builtin_print(kenv *e, kval *a);
+kval *builtin_str_len(kenv *e, kval *a);
+kval *builtin_str_concat(kenv *e, kval *a);
+kval *builtin_substr(kenv *e, kval *a);
+kval *builtin_str_join(kenv *e, kval *a);
+
+// #################
+//  Vectors        #
+// #################
+kval *builtin_vec(kenv *e, kval *a);
+kval *builtin_vec_list(kenv *e, kval *a);
+kval *builtin_vec_len(kenv *e, kval *a);
+kval *builtin_vec_get(kenv *e, kval *a);
+kval *builtin_vec_range(kenv *e, kval *a);
+kval *builtin_vec_f64(kenv *e, kval *a);
+kval *builtin_dot(kenv *e, kval *a);
+kval *builtin_scale(kenv *e, kval *a);
+kval *builtin_sum(kenv *e, kval *a);
+kval *builtin_product(kenv *e, kval *a);
+kval *builtin_min(kenv *e, kval *a);
+kval *builtin_max(kenv *e, kval *a);
+kval *builtin_vec_gt(kenv *e, kval *a);
+kval *builtin_vec_lt(kenv *e, kval *a);
+kval *builtin_vec_ge(kenv *e, kval *a);
+kval *builtin_vec_le(kenv *e, kval *a);
+kval *builtin_vec_eq(kenv *e, kval *a);
+
+// #################
+//  Matrices       #
+// #################
+kval *builtin_mat(kenv *e, kval *a);
+kval *builtin_mat_list(kenv *e, kval *a);
+kval *builtin_mat_shape(kenv *e, kval *a);
+kval *builtin_mat_get(kenv *e, kval *a);
+kval *builtin_mat_row(kenv *e, kval *a);
+kval *builtin_mat_col(kenv *e, kval *a);
+kval *builtin_mat_identity(kenv *e, kval *a);
+kval *builtin_reshape(kenv *e, kval *a);
+kval *builtin_transpose(kenv *e, kval *a);
+kval *builtin_matmul(kenv *e, kval *a);
+kval *builtin_row_sums(kenv *e, kval *a);
+kval *builtin_col_sums(kenv *e, kval *a);
+
+// #################
+//  Hash Tables    #
+// #################
+kval *builtin_hash(kenv *e, kval *a);
+kval *builtin_hash_get(kenv *e, kval *a);
+kval *builtin_hash_put(kenv *e, kval *a);
+kval *builtin_hash_del(kenv *e, kval *a);
+kval *builtin_hash_has(kenv *e, kval *a);
+kval *builtin_hash_len(kenv *e, kval *a);
+kval *builtin_hash_keys(kenv *e, kval *a);
+kval *builtin_hash_vals(kenv *e, kval *a);
+kval *builtin_hash_pairs(kenv *e, kval *a);
+kval *builtin_hash_each(kenv *e, kval *a);
+
+// #################
+//  Maps           #
+// #################
+kval *builtin_hmap(kenv *e, kval *a);
+kval *builtin_assoc(kenv *e, kval *a);
+kval *builtin_dissoc(kenv *e, kval *a);
+kval *builtin_hmap_get(kenv *e, kval *a);
+kval *builtin_hmap_has(kenv *e, kval *a);
+kval *builtin_hmap_len(kenv *e, kval *a);
+kval *builtin_hmap_keys(kenv *e, kval *a);
+kval *builtin_hmap_vals(kenv *e, kval *a);
+kval *builtin_hmap_pairs(kenv *e, kval *a);
+
+// #################
+//  Sorted Maps    #
+// #################
+kval *builtin_sorted(kenv *e, kval *a);
+kval *builtin_sorted_put(kenv *e, kval *a);
+kval *builtin_sorted_del(kenv *e, kval *a);
+kval *builtin_sorted_get(kenv *e, kval *a);
+kval *builtin_sorted_has(kenv *e, kval *a);
+kval *builtin_sorted_len(kenv *e, kval *a);
+kval *builtin_sorted_first(kenv *e, kval *a);
+kval *builtin_sorted_last(kenv *e, kval *a);
+kval *builtin_range_from_to(kenv *e, kval *a);
+kval *builtin_sorted_keys(kenv *e, kval *a);
+kval *builtin_sorted_vals(kenv *e, kval *a);
+kval *builtin_sorted_pairs(kenv *e, kval *a);
+
+// #################
+//  Sets           #
+// #################
+kval *builtin_set(kenv *e, kval *a);
+kval *builtin_set_add(kenv *e, kval *a);
+kval *builtin_set_has(kenv *e, kval *a);
+kval *builtin_set_len(kenv *e, kval *a);
+kval *builtin_set_list(kenv *e, kval *a);
+kval *builtin_union(kenv *e, kval *a);
+kval *builtin_intersection(kenv *e, kval *a);
+kval *builtin_difference(kenv *e, kval *a);
+
+// #################
+//  Sorting        #
+// #################
+kval *builtin_sort(kenv *e, kval *a);
+kval *builtin_sort_by(kenv *e, kval *a);
+
+// #################
+//  Records        #
+// #################
+kval *builtin_defrecord(kenv *e, kval *a);
+kval *builtin_record_call(kenv *e, kval *f, kval *a);
 
 // #################
 // Files           #
 // #################
 kval *builtin_load(kenv *e, kval *a);
+kval *builtin_load_mpc(kenv *e, kval *a);
+kval *builtin_load_forms(kenv *e, kval *expr);
+kval *builtin_serialize(kenv *e, kval *a);
+kval *builtin_deserialize(kenv *e, kval *a);
 
 #endif
\ No newline at end of file
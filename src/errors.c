@@ -0,0 +1,27 @@
+#include "errors.h"
+
+static const char *kerr_messages[] = {
+    [KERR_OTHER] = "Error",
+    [KERR_USER] = "Error",
+    [KERR_DIV_ZERO] = "Division by zero",
+    [KERR_BAD_OP] = "Invalid operation",
+    [KERR_BAD_NUM] = "Invalid number",
+    [KERR_UNSUPPORTED_TYPE] = "Unsupported type",
+    [KERR_BAD_SEXPR] = "Invalid S-expression",
+    [KERR_UNKNOWN] = "Unknown",
+    [KERR_TYPE] = "Incorrect type",
+    [KERR_ARGS] = "Incorrect number of arguments",
+    [KERR_EMPTY] = "Empty list",
+    [KERR_UNBOUND] = "Unbound symbol",
+};
+
+// The fixed message of an error kind, for errors raised with kval_error
+const char *kerr_message(int code)
+{
+    if (code < 0 || code >= (int)(sizeof(kerr_messages) / sizeof(kerr_messages[0])))
+    {
+        return kerr_messages[KERR_UNKNOWN];
+    }
+
+    return kerr_messages[code];
+}
@@ -1,35 +1,64 @@
 #ifndef errors_h
 #define errors_h
 
-#define KERR_DIV_ZERO "Division by zero"
-#define KERR_BAD_OP "Invalid operation"
-#define KERR_BAD_NUM "Invalid number"
-#define KERR_UNSUPPORTED_TYPE "Unsupported type"
-#define KERR_BAD_SEXPR "Invalid S-expression"
-#define KERR_UNKNOWN "Unknown"
-
-#define K_ASSERT(args, cond, fmt, ...)            \
-    if (!(cond))                                  \
-    {                                             \
-        kval *err = kval_err(fmt, ##__VA_ARGS__); \
-        kval_del(args);                           \
-        return err;                               \
+// Error kinds, stored in kval->code
+enum
+{
+    // Formatted with kval_err
+    KERR_OTHER,
+
+    // Raised by the `error` builtin
+    KERR_USER,
+
+    // Constant messages, see kerr_message
+    KERR_DIV_ZERO,
+    KERR_BAD_OP,
+    KERR_BAD_NUM,
+    KERR_UNSUPPORTED_TYPE,
+    KERR_BAD_SEXPR,
+    KERR_UNKNOWN,
+
+    // Formatted, from the K_ASSERT_* macros and the evaluator
+    KERR_TYPE,
+    KERR_ARGS,
+    KERR_EMPTY,
+    KERR_UNBOUND,
+};
+
+const char *kerr_message(int code);
+
+#define K_ASSERT_KIND(args, code, cond, fmt, ...)             \
+    if (!(cond))                                              \
+    {                                                         \
+        kval *err = kval_err_kind(code, fmt, ##__VA_ARGS__); \
+        kval_del(args);                                       \
+        return err;                                           \
     }
 
+#define K_ASSERT(args, cond, fmt, ...) \
+    K_ASSERT_KIND(args, KERR_OTHER, cond, fmt, ##__VA_ARGS__)
+
 #endif
 
-#define K_ASSERT_TYPE(func, args, index, expect)                     \
-    K_ASSERT(args, args->cells[index]->type == expect,               \
-             "Function '%s' passed incorrect type for argument %i. " \
-             "Got %s, Expected %s.",                                 \
-             func, index, ktype_name(args->cells[index]->type), ktype_name(expect))
-
-#define K_ASSERT_NUM(func, args, num)                               \
-    K_ASSERT(args, args->count == num,                              \
-             "Function '%s' passed incorrect number of arguments. " \
-             "Got %i, Expected %i.",                                \
-             func, args->count, num)
-
-#define K_ASSERT_NOT_EMPTY(func, args, index)      \
-    K_ASSERT(args, args->cells[index]->count != 0, \
-             "Function '%s' passed {} for argument %i.", func, index);
+#define K_ASSERT_TYPE(func, args, index, expect)                          \
+    K_ASSERT_KIND(args, KERR_TYPE, args->cells[index]->type == expect,    \
+                  "Function '%s' passed incorrect type for argument %i. " \
+                  "Got %s, Expected %s.",                                 \
+                  func, index, ktype_name(args->cells[index]->type), ktype_name(expect))
+
+// A number of any kind, see kval_is_number
+#define K_ASSERT_NUMBER(func, args, index)                                  \
+    K_ASSERT_KIND(args, KERR_TYPE, kval_is_number(args->cells[index]),      \
+                  "Function '%s' passed incorrect type for argument %i. " \
+                  "Got %s, Expected %s.",                                 \
+                  func, index, ktype_name(args->cells[index]->type), ktype_name(KVAL_NUM))
+
+#define K_ASSERT_NUM(func, args, num)                                    \
+    K_ASSERT_KIND(args, KERR_ARGS, args->count == num,                   \
+                  "Function '%s' passed incorrect number of arguments. " \
+                  "Got %i, Expected %i.",                                \
+                  func, args->count, num)
+
+#define K_ASSERT_NOT_EMPTY(func, args, index)                          \
+    K_ASSERT_KIND(args, KERR_EMPTY, args->cells[index]->count != 0,    \
+                  "Function '%s' passed {} for argument %i.", func, index);
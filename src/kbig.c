@@ -0,0 +1,545 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "kbig.h"
+
+typedef uint32_t limb;
+typedef uint64_t dlimb;
+
+// Below this many limbs schoolbook multiplication beats Karatsuba
+#define KBIG_KARATSUBA 32
+
+// Decimal digits handled per limb when converting to and from strings
+#define KBIG_CHUNK 1000000000u
+#define KBIG_CHUNK_DIGITS 9
+
+// ###############
+//  Magnitudes   #
+// ###############
+
+// Length of a without its leading zero limbs
+static int mag_trim(const limb *a, int n)
+{
+    while (n > 0 && a[n - 1] == 0)
+    {
+        n--;
+    }
+
+    return n;
+}
+
+static int mag_cmp(const limb *a, int alen, const limb *b, int blen)
+{
+    if (alen != blen)
+    {
+        return alen < blen ? -1 : 1;
+    }
+
+    for (int i = alen - 1; i >= 0; i--)
+    {
+        if (a[i] != b[i])
+        {
+            return a[i] < b[i] ? -1 : 1;
+        }
+    }
+
+    return 0;
+}
+
+// a += b in place. The sum must fit in alen limbs
+static void mag_add_at(limb *a, int alen, const limb *b, int blen)
+{
+    dlimb carry = 0;
+    int i = 0;
+
+    for (; i < blen; i++)
+    {
+        carry += (dlimb)a[i] + b[i];
+        a[i] = (limb)carry;
+        carry >>= 32;
+    }
+
+    for (; carry && i < alen; i++)
+    {
+        carry += a[i];
+        a[i] = (limb)carry;
+        carry >>= 32;
+    }
+}
+
+// a -= b in place, a must be at least b
+static void mag_sub_at(limb *a, int alen, const limb *b, int blen)
+{
+    dlimb borrow = 0;
+    int i = 0;
+
+    for (; i < blen; i++)
+    {
+        dlimb d = (dlimb)a[i] - b[i] - borrow;
+        a[i] = (limb)d;
+        borrow = (d >> 32) & 1;
+    }
+
+    for (; borrow && i < alen; i++)
+    {
+        dlimb d = (dlimb)a[i] - borrow;
+        a[i] = (limb)d;
+        borrow = (d >> 32) & 1;
+    }
+}
+
+static void mag_mul_school(limb *out, const limb *a, int alen, const limb *b, int blen)
+{
+    for (int i = 0; i < alen; i++)
+    {
+        dlimb carry = 0;
+        for (int j = 0; j < blen; j++)
+        {
+            carry += (dlimb)a[i] * b[j] + out[i + j];
+            out[i + j] = (limb)carry;
+            carry >>= 32;
+        }
+
+        out[i + blen] = (limb)carry;
+    }
+}
+
+// out = a * b. out has alen + blen limbs and is zeroed by the caller
+static void mag_mul(limb *out, const limb *a, int alen, const limb *b, int blen)
+{
+    if (alen < blen)
+    {
+        const limb *t = a;
+        a = b;
+        b = t;
+
+        int n = alen;
+        alen = blen;
+        blen = n;
+    }
+
+    if (blen == 0)
+    {
+        return;
+    }
+
+    if (blen < KBIG_KARATSUBA)
+    {
+        mag_mul_school(out, a, alen, b, blen);
+        return;
+    }
+
+    int m = (alen + 1) / 2;
+
+    // Lopsided: b fits in one half, so multiply each half of a by it
+    if (blen <= m)
+    {
+        limb *hi = calloc(alen - m + blen, sizeof(limb));
+
+        mag_mul(out, a, m, b, blen);
+        mag_mul(hi, a + m, alen - m, b, blen);
+        mag_add_at(out + m, alen + blen - m, hi, mag_trim(hi, alen - m + blen));
+
+        free(hi);
+        return;
+    }
+
+    // a = a1 B^m + a0, b = b1 B^m + b0
+    // a b = z2 B^2m + ((a0 + a1)(b0 + b1) - z2 - z0) B^m + z0
+    int a0 = mag_trim(a, m);
+    int b0 = mag_trim(b, m);
+    int a1 = alen - m;
+    int b1 = blen - m;
+
+    // z0 and z2 go straight into their place in out, they don't overlap
+    mag_mul(out, a, a0, b, b0);
+    mag_mul(out + 2 * m, a + m, a1, b + m, b1);
+
+    limb *sums = calloc(2 * (m + 1), sizeof(limb));
+    limb *sa = sums;
+    limb *sb = sums + m + 1;
+
+    memcpy(sa, a, a0 * sizeof(limb));
+    mag_add_at(sa, m + 1, a + m, a1);
+    memcpy(sb, b, b0 * sizeof(limb));
+    mag_add_at(sb, m + 1, b + m, b1);
+
+    int san = mag_trim(sa, m + 1);
+    int sbn = mag_trim(sb, m + 1);
+
+    limb *z1 = calloc(san + sbn, sizeof(limb));
+    mag_mul(z1, sa, san, sb, sbn);
+    mag_sub_at(z1, san + sbn, out, mag_trim(out, a0 + b0));
+    mag_sub_at(z1, san + sbn, out + 2 * m, mag_trim(out + 2 * m, a1 + b1));
+
+    mag_add_at(out + m, alen + blen - m, z1, mag_trim(z1, san + sbn));
+
+    free(z1);
+    free(sums);
+}
+
+// a / d for a single limb d, returning the remainder. q may be a
+static limb mag_divmod_small(limb *q, const limb *a, int alen, limb d)
+{
+    dlimb r = 0;
+
+    for (int i = alen - 1; i >= 0; i--)
+    {
+        dlimb cur = (r << 32) | a[i];
+        q[i] = (limb)(cur / d);
+        r = cur % d;
+    }
+
+    return (limb)r;
+}
+
+// q = a / b, with alen >= blen >= 2 and q of alen - blen + 1 limbs (Knuth's algorithm D)
+static void mag_div(limb *q, const limb *a, int alen, const limb *b, int blen)
+{
+    // Normalise so the top limb of b has its high bit set, keeping the estimates close
+    int s = __builtin_clz(b[blen - 1]);
+
+    limb *bn = malloc(blen * sizeof(limb));
+    limb *un = malloc((alen + 1) * sizeof(limb));
+
+    for (int i = blen - 1; i > 0; i--)
+    {
+        bn[i] = (b[i] << s) | (s ? b[i - 1] >> (32 - s) : 0);
+    }
+    bn[0] = b[0] << s;
+
+    un[alen] = s ? a[alen - 1] >> (32 - s) : 0;
+    for (int i = alen - 1; i > 0; i--)
+    {
+        un[i] = (a[i] << s) | (s ? a[i - 1] >> (32 - s) : 0);
+    }
+    un[0] = a[0] << s;
+
+    for (int j = alen - blen; j >= 0; j--)
+    {
+        // Estimate the quotient limb from the top two limbs, then correct it
+        dlimb num = ((dlimb)un[j + blen] << 32) | un[j + blen - 1];
+        dlimb qhat = num / bn[blen - 1];
+        dlimb rhat = num % bn[blen - 1];
+
+        while (qhat > 0xffffffffu ||
+               qhat * bn[blen - 2] > ((rhat << 32) | un[j + blen - 2]))
+        {
+            qhat--;
+            rhat += bn[blen - 1];
+            if (rhat > 0xffffffffu)
+            {
+                break;
+            }
+        }
+
+        // un -= qhat * bn, shifted by j
+        int64_t t;
+        int64_t k = 0;
+        for (int i = 0; i < blen; i++)
+        {
+            dlimb p = qhat * bn[i];
+            t = (int64_t)un[i + j] - k - (int64_t)(p & 0xffffffffu);
+            un[i + j] = (limb)t;
+            k = (int64_t)(p >> 32) - (t >> 32);
+        }
+        t = (int64_t)un[j + blen] - k;
+        un[j + blen] = (limb)t;
+
+        q[j] = (limb)qhat;
+
+        // Subtracted one too many, add it back
+        if (t < 0)
+        {
+            q[j]--;
+
+            dlimb carry = 0;
+            for (int i = 0; i < blen; i++)
+            {
+                carry += (dlimb)un[i + j] + bn[i];
+                un[i + j] = (limb)carry;
+                carry >>= 32;
+            }
+            un[j + blen] += (limb)carry;
+        }
+    }
+
+    free(bn);
+    free(un);
+}
+
+// ###############
+//  Values       #
+// ###############
+kbig *kbig_alloc(int len)
+{
+    kbig *b = malloc(sizeof(kbig) + len * sizeof(limb));
+
+    b->refs = 1;
+    b->negative = 0;
+    b->len = len;
+
+    return b;
+}
+
+// Drop leading zero limbs, zero is never negative
+kbig *kbig_norm(kbig *b)
+{
+    b->len = mag_trim(b->limbs, b->len);
+    if (b->len == 0)
+    {
+        b->negative = 0;
+    }
+
+    return b;
+}
+
+kbig *kbig_ref(kbig *b)
+{
+    b->refs++;
+    return b;
+}
+
+void kbig_unref(kbig *b)
+{
+    if (b && --b->refs == 0)
+    {
+        free(b);
+    }
+}
+
+kbig *kbig_from_long(long n)
+{
+    kbig *b = kbig_alloc(2);
+
+    // Negate as unsigned so LONG_MIN works
+    unsigned long u = n < 0 ? 0 - (unsigned long)n : (unsigned long)n;
+    b->negative = n < 0;
+    b->limbs[0] = (limb)u;
+    b->limbs[1] = (limb)(u >> 32);
+
+    return kbig_norm(b);
+}
+
+kbig *kbig_from_str(const char *s, size_t len)
+{
+    int negative = len > 0 && *s == '-';
+    if (negative)
+    {
+        s++;
+        len--;
+    }
+
+    // Each limb holds more than 9 decimal digits
+    kbig *b = kbig_alloc(len / KBIG_CHUNK_DIGITS + 1);
+    memset(b->limbs, 0, b->len * sizeof(limb));
+    int used = 0;
+
+    // Multiply in nine digits at a time, the first chunk takes the odd ones
+    size_t i = 0;
+    while (i < len)
+    {
+        size_t n = i == 0 && len % KBIG_CHUNK_DIGITS ? len % KBIG_CHUNK_DIGITS : KBIG_CHUNK_DIGITS;
+        limb chunk = 0;
+        limb scale = 1;
+
+        for (size_t j = 0; j < n; j++)
+        {
+            chunk = chunk * 10 + (s[i + j] - '0');
+            scale *= 10;
+        }
+        i += n;
+
+        dlimb carry = chunk;
+        for (int k = 0; k < used; k++)
+        {
+            carry += (dlimb)b->limbs[k] * scale;
+            b->limbs[k] = (limb)carry;
+            carry >>= 32;
+        }
+
+        if (carry)
+        {
+            b->limbs[used++] = (limb)carry;
+        }
+    }
+
+    b->len = used;
+    b->negative = negative;
+
+    return kbig_norm(b);
+}
+
+int kbig_to_long(const kbig *b, long *out)
+{
+    if (b->len > 2)
+    {
+        return 0;
+    }
+
+    unsigned long u = 0;
+    for (int i = b->len - 1; i >= 0; i--)
+    {
+        u = (u << 32) | b->limbs[i];
+    }
+
+    unsigned long limit = b->negative ? (unsigned long)LONG_MAX + 1 : (unsigned long)LONG_MAX;
+    if (u > limit)
+    {
+        return 0;
+    }
+
+    *out = b->negative ? (long)(0 - u) : (long)u;
+    return 1;
+}
+
+double kbig_to_double(const kbig *b)
+{
+    double d = 0;
+
+    for (int i = b->len - 1; i >= 0; i--)
+    {
+        d = d * 4294967296.0 + b->limbs[i];
+    }
+
+    return b->negative ? -d : d;
+}
+
+char *kbig_to_str(const kbig *b)
+{
+    // Peel off nine digits at a time from the low end
+    limb *q = malloc((b->len + 1) * sizeof(limb));
+    limb *chunks = malloc((b->len * 2 + 1) * sizeof(limb));
+    int qlen = b->len;
+    int count = 0;
+
+    memcpy(q, b->limbs, b->len * sizeof(limb));
+    do
+    {
+        chunks[count++] = mag_divmod_small(q, q, qlen, KBIG_CHUNK);
+        qlen = mag_trim(q, qlen);
+    } while (qlen > 0);
+
+    char *s = malloc(count * KBIG_CHUNK_DIGITS + 2);
+    char *p = s;
+
+    if (b->negative)
+    {
+        *p++ = '-';
+    }
+
+    p += sprintf(p, "%u", chunks[count - 1]);
+    for (int i = count - 2; i >= 0; i--)
+    {
+        p += sprintf(p, "%09u", chunks[i]);
+    }
+
+    free(q);
+    free(chunks);
+
+    return s;
+}
+
+int kbig_cmp(const kbig *a, const kbig *b)
+{
+    if (a->negative != b->negative)
+    {
+        return a->negative ? -1 : 1;
+    }
+
+    int c = mag_cmp(a->limbs, a->len, b->limbs, b->len);
+    return a->negative ? -c : c;
+}
+
+kbig *kbig_neg(const kbig *a)
+{
+    kbig *x = kbig_alloc(a->len);
+
+    memcpy(x->limbs, a->limbs, a->len * sizeof(limb));
+    x->negative = !a->negative;
+
+    return kbig_norm(x);
+}
+
+// ###############
+//  Arithmetic   #
+// ###############
+
+// a + b, with b's sign flipped when subtracting
+static kbig *kbig_add_signed(const kbig *a, const kbig *b, int b_negative)
+{
+    // Same signs add magnitudes
+    if (a->negative == b_negative)
+    {
+        int len = (a->len > b->len ? a->len : b->len) + 1;
+        kbig *x = kbig_alloc(len);
+
+        memset(x->limbs, 0, len * sizeof(limb));
+        memcpy(x->limbs, a->limbs, a->len * sizeof(limb));
+        mag_add_at(x->limbs, len, b->limbs, b->len);
+        x->negative = a->negative;
+
+        return kbig_norm(x);
+    }
+
+    // Otherwise subtract the smaller magnitude from the larger, which decides the sign
+    int negative = a->negative;
+    if (mag_cmp(a->limbs, a->len, b->limbs, b->len) < 0)
+    {
+        const kbig *t = a;
+        a = b;
+        b = t;
+        negative = b_negative;
+    }
+
+    kbig *x = kbig_alloc(a->len);
+    memcpy(x->limbs, a->limbs, a->len * sizeof(limb));
+    mag_sub_at(x->limbs, x->len, b->limbs, b->len);
+    x->negative = negative;
+
+    return kbig_norm(x);
+}
+
+kbig *kbig_add(const kbig *a, const kbig *b)
+{
+    return kbig_add_signed(a, b, b->negative);
+}
+
+kbig *kbig_sub(const kbig *a, const kbig *b)
+{
+    return kbig_add_signed(a, b, !b->negative);
+}
+
+kbig *kbig_mul(const kbig *a, const kbig *b)
+{
+    kbig *x = kbig_alloc(a->len + b->len);
+
+    memset(x->limbs, 0, x->len * sizeof(limb));
+    mag_mul(x->limbs, a->limbs, a->len, b->limbs, b->len);
+    x->negative = a->negative != b->negative;
+
+    return kbig_norm(x);
+}
+
+kbig *kbig_div(const kbig *a, const kbig *b)
+{
+    if (mag_cmp(a->limbs, a->len, b->limbs, b->len) < 0)
+    {
+        return kbig_alloc(0);
+    }
+
+    kbig *x = kbig_alloc(a->len - b->len + 1);
+    if (b->len == 1)
+    {
+        x->len = a->len;
+        mag_divmod_small(x->limbs, a->limbs, a->len, b->limbs[0]);
+    }
+    else
+    {
+        mag_div(x->limbs, a->limbs, a->len, b->limbs, b->len);
+    }
+    x->negative = a->negative != b->negative;
+
+    return kbig_norm(x);
+}
@@ -0,0 +1,57 @@
+#ifndef kbig_h
+#define kbig_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "types.h"
+
+/*
+    Arbitrary precision integers.
+
+    Sign and magnitude, the magnitude in 32 bit limbs with the least
+    significant first and no leading zero limbs, so zero has no limbs.
+    Values are immutable and reference counted, copying a kval holding
+    one is O(1). Integer ops only get here once a long overflows, and
+    results that fit in a long again go back to plain numbers, see
+    kval_big.
+*/
+struct kbig
+{
+    int refs;
+    int negative;
+    int len;
+    uint32_t limbs[];
+};
+
+// len limbs, left for the caller to fill in and then kbig_norm
+kbig *kbig_alloc(int len);
+kbig *kbig_norm(kbig *b);
+
+kbig *kbig_from_long(long n);
+
+// Decimal digits with an optional leading '-'
+kbig *kbig_from_str(const char *s, size_t len);
+
+kbig *kbig_ref(kbig *b);
+void kbig_unref(kbig *b);
+
+// 1 and the value in *out if b fits in a long
+int kbig_to_long(const kbig *b, long *out);
+
+// Nearest double, or +-inf when out of range
+double kbig_to_double(const kbig *b);
+
+// Decimal, malloc'd
+char *kbig_to_str(const kbig *b);
+
+int kbig_cmp(const kbig *a, const kbig *b);
+
+kbig *kbig_neg(const kbig *a);
+kbig *kbig_add(const kbig *a, const kbig *b);
+kbig *kbig_sub(const kbig *a, const kbig *b);
+kbig *kbig_mul(const kbig *a, const kbig *b);
+
+// Truncates towards zero like C, b must not be zero
+kbig *kbig_div(const kbig *a, const kbig *b);
+
+#endif
@@ -0,0 +1,46 @@
+#include <stdlib.h>
+#include <string.h>
+#include "kbuf.h"
+
+void kbuf_init(kbuf *b)
+{
+    b->data = NULL;
+    b->len = 0;
+    b->cap = 0;
+}
+
+void kbuf_free(kbuf *b)
+{
+    free(b->data);
+    kbuf_init(b);
+}
+
+void kbuf_reserve(kbuf *b, size_t n)
+{
+    if (b->len + n <= b->cap)
+    {
+        return;
+    }
+
+    size_t cap = b->cap ? b->cap * 2 : 256;
+    while (cap < b->len + n)
+    {
+        cap *= 2;
+    }
+
+    b->data = realloc(b->data, cap);
+    b->cap = cap;
+}
+
+void kbuf_put(kbuf *b, const void *data, size_t n)
+{
+    kbuf_reserve(b, n);
+    memcpy(b->data + b->len, data, n);
+    b->len += n;
+}
+
+void kbuf_putc(kbuf *b, char c)
+{
+    kbuf_reserve(b, 1);
+    b->data[b->len++] = c;
+}
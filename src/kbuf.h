@@ -0,0 +1,23 @@
+#ifndef kbuf_h
+#define kbuf_h
+
+#include <stddef.h>
+
+// Growable byte buffer
+typedef struct
+{
+    char *data;
+    size_t len;
+    size_t cap;
+} kbuf;
+
+void kbuf_init(kbuf *b);
+void kbuf_free(kbuf *b);
+
+// Make room for at least n more bytes
+void kbuf_reserve(kbuf *b, size_t n);
+
+void kbuf_put(kbuf *b, const void *data, size_t n);
+void kbuf_putc(kbuf *b, char c);
+
+#endif
@@ -0,0 +1,358 @@
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include "kcache.h"
+#include "kbuf.h"
+#include "kser.h"
+#include "kval.h"
+
+#define KCACHE_MAGIC "KVC"
+#define KCACHE_VERSION 2
+#define KCACHE_HEADER 20
+#define KCACHE_END 0xff
+
+// Files bigger than this are read every time, their entries would be as big
+#define KCACHE_MAX_FILE (4 << 20)
+
+// Entries used longest ago are removed once all of them add up to more than this
+#define KCACHE_MAX_TOTAL (64 << 20)
+
+int kcache_enabled = 1;
+
+struct kcache
+{
+    char *dir;
+    char *path;
+
+    // Hit: the mapped entry
+    const char *map;
+    size_t map_len;
+    const char *cur;
+    int corrupt;
+
+    // Miss: the entry being written
+    char *tmp_path;
+    FILE *out;
+    kbuf buf;
+};
+
+// ###############
+//  Helpers      #
+// ###############
+
+// 64-bit FNV-1a
+static unsigned long kcache_hash(const char *src, size_t len)
+{
+    unsigned long h = 14695981039346656037UL;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= (unsigned char)src[i];
+        h *= 1099511628211UL;
+    }
+
+    return h;
+}
+
+static void kcache_header(char *h, unsigned long hash, size_t len)
+{
+    memcpy(h, KCACHE_MAGIC, 3);
+    h[3] = KCACHE_VERSION;
+
+    for (int i = 0; i < 8; i++)
+    {
+        h[4 + i] = (char)(hash >> (8 * i));
+        h[12 + i] = (char)((unsigned long)len >> (8 * i));
+    }
+}
+
+// mkdir -p
+static int kcache_mkdir(char *dir)
+{
+    for (char *p = dir + 1; *p; p++)
+    {
+        if (*p == '/')
+        {
+            *p = '\0';
+            mkdir(dir, 0755);
+            *p = '/';
+        }
+    }
+
+    return mkdir(dir, 0755) == 0 || access(dir, W_OK) == 0;
+}
+
+static char *kcache_dir(void)
+{
+    char *dir = getenv("KOVACS_CACHE_DIR");
+    if (dir && *dir)
+    {
+        return strdup(dir);
+    }
+
+    char *base = getenv("XDG_CACHE_HOME");
+    const char *suffix = "/kovacs";
+
+    if (!base || !*base)
+    {
+        base = getenv("HOME");
+        suffix = "/.cache/kovacs";
+    }
+
+    if (!base || !*base)
+    {
+        return NULL;
+    }
+
+    dir = malloc(strlen(base) + strlen(suffix) + 1);
+    strcpy(dir, base);
+    strcat(dir, suffix);
+
+    return dir;
+}
+
+typedef struct
+{
+    char *name;
+    off_t size;
+    time_t mtime;
+} kcache_entry;
+
+static int kcache_entry_cmp(const void *x, const void *y)
+{
+    const kcache_entry *a = x;
+    const kcache_entry *b = y;
+
+    return (a->mtime > b->mtime) - (a->mtime < b->mtime);
+}
+
+// Removes entries, least recently used first, until the rest fit in KCACHE_MAX_TOTAL
+static void kcache_prune(const char *dir)
+{
+    DIR *d = opendir(dir);
+    if (!d)
+    {
+        return;
+    }
+
+    kcache_entry *entries = NULL;
+    size_t count = 0;
+    size_t cap = 0;
+    off_t total = 0;
+
+    char path[4096];
+    struct dirent *de;
+
+    while ((de = readdir(d)))
+    {
+        size_t n = strlen(de->d_name);
+        if (n < 3 || strcmp(de->d_name + n - 3, ".kc") != 0)
+        {
+            continue;
+        }
+
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+        if (stat(path, &st) != 0)
+        {
+            continue;
+        }
+
+        if (count == cap)
+        {
+            cap = cap ? cap * 2 : 64;
+            entries = realloc(entries, sizeof(kcache_entry) * cap);
+        }
+
+        entries[count].name = strdup(de->d_name);
+        entries[count].size = st.st_size;
+        entries[count].mtime = st.st_mtime;
+        total += st.st_size;
+        count++;
+    }
+
+    closedir(d);
+
+    if (total > KCACHE_MAX_TOTAL)
+    {
+        qsort(entries, count, sizeof(kcache_entry), kcache_entry_cmp);
+
+        for (size_t i = 0; i < count && total > KCACHE_MAX_TOTAL; i++)
+        {
+            snprintf(path, sizeof(path), "%s/%s", dir, entries[i].name);
+            if (unlink(path) == 0)
+            {
+                total -= entries[i].size;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        free(entries[i].name);
+    }
+
+    free(entries);
+}
+
+// ###############
+//  Cache        #
+// ###############
+kcache *kcache_open(const char *src, size_t len)
+{
+    if (!kcache_enabled || len > KCACHE_MAX_FILE)
+    {
+        return NULL;
+    }
+
+    char *dir = kcache_dir();
+    if (!dir || !kcache_mkdir(dir))
+    {
+        free(dir);
+        return NULL;
+    }
+
+    unsigned long hash = kcache_hash(src, len);
+    char header[KCACHE_HEADER];
+    kcache_header(header, hash, len);
+
+    kcache *c = calloc(1, sizeof(kcache));
+    c->dir = dir;
+    c->path = malloc(strlen(dir) + 32);
+    sprintf(c->path, "%s/%016lx.kc", dir, hash);
+    kbuf_init(&c->buf);
+
+    // Hit: a complete entry for exactly these contents
+    int fd = open(c->path, O_RDONLY);
+    if (fd >= 0)
+    {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > KCACHE_HEADER)
+        {
+            void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED)
+            {
+                const char *m = map;
+                if (memcmp(m, header, KCACHE_HEADER) == 0 &&
+                    (unsigned char)m[st.st_size - 1] == KCACHE_END)
+                {
+                    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+                    // Its mtime says when it was last used, for kcache_prune
+                    utimes(c->path, NULL);
+
+                    c->map = m;
+                    c->map_len = st.st_size;
+                    c->cur = m + KCACHE_HEADER;
+                }
+                else
+                {
+                    munmap(map, st.st_size);
+                }
+            }
+        }
+
+        close(fd);
+    }
+
+    if (c->map)
+    {
+        return c;
+    }
+
+    // Miss: write a new entry next to where it will live, and rename it into place at the end
+    c->tmp_path = malloc(strlen(dir) + 32);
+    sprintf(c->tmp_path, "%s/tmp.XXXXXX", dir);
+
+    fd = mkstemp(c->tmp_path);
+    if (fd < 0 || !(c->out = fdopen(fd, "wb")))
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+            unlink(c->tmp_path);
+        }
+
+        kcache_close(c, 0);
+        return NULL;
+    }
+
+    fwrite(header, 1, KCACHE_HEADER, c->out);
+
+    return c;
+}
+
+int kcache_hit(kcache *c)
+{
+    return c->map != NULL;
+}
+
+int kcache_corrupt(kcache *c)
+{
+    return c->corrupt;
+}
+
+kval *kcache_next(kcache *c)
+{
+    const char *end = c->map + c->map_len - 1;
+    if (c->cur >= end)
+    {
+        return NULL;
+    }
+
+    kval *x = kser_decode(&c->cur, end);
+    if (!x)
+    {
+        c->corrupt = 1;
+    }
+
+    return x;
+}
+
+void kcache_put(kcache *c, kval *form)
+{
+    c->buf.len = 0;
+    kser_encode(&c->buf, form);
+    fwrite(c->buf.data, 1, c->buf.len, c->out);
+}
+
+void kcache_close(kcache *c, int commit)
+{
+    if (c->map)
+    {
+        munmap((void *)c->map, c->map_len);
+
+        if (c->corrupt)
+        {
+            unlink(c->path);
+        }
+    }
+
+    if (c->out)
+    {
+        fputc(KCACHE_END, c->out);
+
+        if (fclose(c->out) == 0 && commit && rename(c->tmp_path, c->path) == 0)
+        {
+            kcache_prune(c->dir);
+        }
+        else
+        {
+            unlink(c->tmp_path);
+        }
+    }
+
+    kbuf_free(&c->buf);
+    free(c->tmp_path);
+    free(c->path);
+    free(c->dir);
+    free(c);
+}
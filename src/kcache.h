@@ -0,0 +1,39 @@
+#ifndef kcache_h
+#define kcache_h
+
+#include <stddef.h>
+#include "types.h"
+
+/*
+    On-disk cache of parsed files, keyed by a hash of their contents.
+
+    Each entry holds the kser encoding of every top level form, so an
+    unchanged file is decoded straight into kvals without the reader.
+    Entries live in $KOVACS_CACHE_DIR, or $XDG_CACHE_HOME/kovacs, or
+    ~/.cache/kovacs. Editing a file changes its hash, which is all the
+    invalidation needed, and entries written by an older reader carry an
+    older version in their header.
+
+    Files over a few megabytes are not cached. Using an entry touches its
+    mtime, and once the entries add up to more than 64MB the least
+    recently used go first.
+*/
+typedef struct kcache kcache;
+
+// Cleared by the --no-cache command line flag
+extern int kcache_enabled;
+
+// NULL if caching is off, the file is too big, or the cache directory is unusable
+kcache *kcache_open(const char *src, size_t len);
+
+int kcache_hit(kcache *c);
+
+// On a hit: the next cached form, NULL at the end or if the entry is corrupt
+kval *kcache_next(kcache *c);
+int kcache_corrupt(kcache *c);
+
+// On a miss: record each form as it is read, commit once the whole file was read
+void kcache_put(kcache *c, kval *form);
+void kcache_close(kcache *c, int commit);
+
+#endif
@@ -2,6 +2,7 @@
 #include "kval.h"
 #include "builtin.h"
 #include "errors.h"
+#include "kintern.h"
 
 // Constructor
 kenv *kenv_init(void)
@@ -10,6 +11,7 @@ kenv *kenv_init(void)
 
     e->count = 0;
     e->syms = NULL;
+    e->hashes = NULL;
     e->vals = NULL;
     e->parent = NULL;
 
@@ -25,20 +27,34 @@ void kenv_del(kenv *e)
         kval_del(e->vals[i]);
     }
     free(e->syms);
+    free(e->hashes);
     free(e->vals);
     free(e);
 }
 
+// Drop every binding, keeping the environment and its parent
+void kenv_clear(kenv *e)
+{
+    for (int i = 0; i < e->count; i++)
+    {
+        free(e->syms[i]);
+        kval_del(e->vals[i]);
+    }
+    e->count = 0;
+}
+
 // ############
 //  Helpers   #
 // ############
 kval *kenv_get(kenv *e, kval *k)
 {
+    unsigned long hash = kval_hash(k);
+
     // Look through known variables
     for (int i = 0; i < e->count; i++)
     {
-        // Check if the stored string matches the symbol string
-        if (strcmp(e->syms[i], k->sym) == 0)
+        // Check if the stored string matches the symbol string, the hash rules out most
+        if (e->hashes[i] == hash && strcmp(e->syms[i], k->sym) == 0)
         {
             return kval_copy(e->vals[i]);
         }
@@ -49,20 +65,20 @@ kval *kenv_get(kenv *e, kval *k)
         return kenv_get(e->parent, k);
     }
 
-    // TODO - add a real error code here
-    return kval_err("Unbound symbol: '%s'", k->sym);
+    return kval_err_kind(KERR_UNBOUND, "Unbound symbol: '%s'", k->sym);
 }
 
 // Put definition in the local environment
 void kenv_put(kenv *e, kval *k, kval *v)
 {
+    unsigned long hash = kval_hash(k);
 
     // Look through known variables
     for (int i = 0; i < e->count; i++)
     {
 
         // If an existing variable is found, overwrite it
-        if (strcmp(e->syms[i], k->sym) == 0)
+        if (e->hashes[i] == hash && strcmp(e->syms[i], k->sym) == 0)
         {
             kval_del(e->vals[i]);
             e->vals[i] = kval_copy(v);
@@ -71,13 +87,22 @@ void kenv_put(kenv *e, kval *k, kval *v)
     }
 
     // If not found, add it
+    kenv_push(e, k->sym, k->len, kval_copy(v));
+}
+
+// Add a binding without looking for an existing one, taking over v
+void kenv_push(kenv *e, const char *sym, size_t len, kval *v)
+{
     e->count++;
     e->vals = realloc(e->vals, sizeof(kval *) * e->count);
     e->syms = realloc(e->syms, sizeof(char *) * e->count);
+    e->hashes = realloc(e->hashes, sizeof(unsigned long) * e->count);
 
-    e->vals[e->count - 1] = kval_copy(v);
-    e->syms[e->count - 1] = malloc(strlen(k->sym) + 1);
-    strcpy(e->syms[e->count - 1], k->sym);
+    e->vals[e->count - 1] = v;
+    e->syms[e->count - 1] = malloc(len + 1);
+    memcpy(e->syms[e->count - 1], sym, len);
+    e->syms[e->count - 1][len] = '\0';
+    e->hashes[e->count - 1] = kintern_hash(sym, len);
 }
 
 // Put definition in the global environment
@@ -100,39 +125,176 @@ void kenv_add_builtin(kenv *e, char *name, kbuiltin func)
     kval_del(v);
 }
 
+static const struct
+{
+    char *name;
+    kbuiltin func;
+} kenv_builtins[] = {
+    // List Functions
+    {"list", builtin_list},
+    {"head", builtin_head},
+    {"tail", builtin_tail},
+    {"eval", builtin_eval},
+    {"join", builtin_join},
+
+    // Mathematical Functions
+    {"+", builtin_add},
+    {"-", builtin_sub},
+    {"*", builtin_mul},
+    {"/", builtin_div},
+
+    // Functions... Functions
+    {"def", builtin_def},
+    {"=", builtin_put},
+    {"\\", builtin_lambda},
+
+    // Conditionals
+    {"if", builtin_if},
+    {"==", builtin_eq},
+    {"!=", builtin_ne},
+    {">", builtin_gt},
+    {"<", builtin_lt},
+    {">=", builtin_ge},
+    {"<=", builtin_le},
+    {"try", builtin_try},
+
+    // String Functions
+    {"load", builtin_load},
+    {"error", builtin_error},
+    {"print", builtin_print},
+    {"str-len", builtin_str_len},
+    {"str-concat", builtin_str_concat},
+    {"substr", builtin_substr},
+    {"str-join", builtin_str_join},
+
+    // Vectors
+    {"vec", builtin_vec},
+    {"vec-list", builtin_vec_list},
+    {"vec-len", builtin_vec_len},
+    {"vec-get", builtin_vec_get},
+    {"vec-range", builtin_vec_range},
+    {"vec-f64", builtin_vec_f64},
+    {"dot", builtin_dot},
+    {"scale", builtin_scale},
+    {"sum", builtin_sum},
+    {"product", builtin_product},
+    {"min", builtin_min},
+    {"max", builtin_max},
+    {"vec>", builtin_vec_gt},
+    {"vec<", builtin_vec_lt},
+    {"vec>=", builtin_vec_ge},
+    {"vec<=", builtin_vec_le},
+    {"vec==", builtin_vec_eq},
+
+    // Matrices
+    {"mat", builtin_mat},
+    {"mat-list", builtin_mat_list},
+    {"mat-shape", builtin_mat_shape},
+    {"mat-get", builtin_mat_get},
+    {"mat-row", builtin_mat_row},
+    {"mat-col", builtin_mat_col},
+    {"mat-identity", builtin_mat_identity},
+    {"reshape", builtin_reshape},
+    {"transpose", builtin_transpose},
+    {"matmul", builtin_matmul},
+    {"row-sums", builtin_row_sums},
+    {"col-sums", builtin_col_sums},
+
+    // Hash tables
+    {"hash", builtin_hash},
+    {"hash-get", builtin_hash_get},
+    {"hash-put!", builtin_hash_put},
+    {"hash-del!", builtin_hash_del},
+    {"hash-has", builtin_hash_has},
+    {"hash-len", builtin_hash_len},
+    {"hash-keys", builtin_hash_keys},
+    {"hash-vals", builtin_hash_vals},
+    {"hash-pairs", builtin_hash_pairs},
+    {"hash-each", builtin_hash_each},
+
+    // Maps
+    {"hmap", builtin_hmap},
+    {"assoc", builtin_assoc},
+    {"dissoc", builtin_dissoc},
+    {"hmap-get", builtin_hmap_get},
+    {"hmap-has", builtin_hmap_has},
+    {"hmap-len", builtin_hmap_len},
+    {"hmap-keys", builtin_hmap_keys},
+    {"hmap-vals", builtin_hmap_vals},
+    {"hmap-pairs", builtin_hmap_pairs},
+
+    // Sorted maps
+    {"sorted", builtin_sorted},
+    {"sorted-put", builtin_sorted_put},
+    {"sorted-del", builtin_sorted_del},
+    {"sorted-get", builtin_sorted_get},
+    {"sorted-has", builtin_sorted_has},
+    {"sorted-len", builtin_sorted_len},
+    {"sorted-first", builtin_sorted_first},
+    {"sorted-last", builtin_sorted_last},
+    {"range-from-to", builtin_range_from_to},
+    {"sorted-keys", builtin_sorted_keys},
+    {"sorted-vals", builtin_sorted_vals},
+    {"sorted-pairs", builtin_sorted_pairs},
+
+    // Sets
+    {"set", builtin_set},
+    {"set-add", builtin_set_add},
+    {"set-has", builtin_set_has},
+    {"set-len", builtin_set_len},
+    {"set-list", builtin_set_list},
+    {"union", builtin_union},
+    {"intersection", builtin_intersection},
+    {"difference", builtin_difference},
+
+    // Sorting
+    {"sort", builtin_sort},
+    {"sort-by", builtin_sort_by},
+
+    // Records
+    {"defrecord", builtin_defrecord},
+
+    // Files
+    {"serialize", builtin_serialize},
+    {"deserialize", builtin_deserialize},
+
+    {NULL, NULL},
+};
+
 void kenv_add_builtins(kenv *e)
 {
-    // List Functions  
-    kenv_add_builtin(e, "list", builtin_list);
-    kenv_add_builtin(e, "head", builtin_head);
-    kenv_add_builtin(e, "tail", builtin_tail);
-    kenv_add_builtin(e, "eval", builtin_eval);
-    kenv_add_builtin(e, "join", builtin_join);
-
-    // Mathematical Functions  
-    kenv_add_builtin(e, "+", builtin_add);
-    kenv_add_builtin(e, "-", builtin_sub);
-    kenv_add_builtin(e, "*", builtin_mul);
-    kenv_add_builtin(e, "/", builtin_div);
-
-    // Functions... Functions  
-    kenv_add_builtin(e, "def", builtin_def);
-    kenv_add_builtin(e, "=", builtin_put);
-    kenv_add_builtin(e, "\\", builtin_lambda);
-
-    // Conditionals  
-    kenv_add_builtin(e, "if", builtin_if);
-    kenv_add_builtin(e, "==", builtin_eq);
-    kenv_add_builtin(e, "!=", builtin_ne);
-    kenv_add_builtin(e, ">", builtin_gt);
-    kenv_add_builtin(e, "<", builtin_lt);
-    kenv_add_builtin(e, ">=", builtin_ge);
-    kenv_add_builtin(e, "<=", builtin_le);
-
-    // String Functions  
-    kenv_add_builtin(e, "load", builtin_load);
-    kenv_add_builtin(e, "error", builtin_error);
-    kenv_add_builtin(e, "print", builtin_print);
+    for (int i = 0; kenv_builtins[i].name; i++)
+    {
+        kenv_add_builtin(e, kenv_builtins[i].name, kenv_builtins[i].func);
+    }
+}
+
+// Builtins are saved by name, so images survive the binary being rebuilt
+char *kenv_builtin_name(kbuiltin func)
+{
+    for (int i = 0; kenv_builtins[i].name; i++)
+    {
+        if (kenv_builtins[i].func == func)
+        {
+            return kenv_builtins[i].name;
+        }
+    }
+
+    return NULL;
+}
+
+kbuiltin kenv_builtin_func(const char *name, size_t len)
+{
+    for (int i = 0; kenv_builtins[i].name; i++)
+    {
+        if (strlen(kenv_builtins[i].name) == len &&
+            memcmp(kenv_builtins[i].name, name, len) == 0)
+        {
+            return kenv_builtins[i].func;
+        }
+    }
+
+    return NULL;
 }
 
 kenv *kenv_copy(kenv *e)
@@ -141,12 +303,14 @@ kenv *kenv_copy(kenv *e)
     n->parent = e->parent;
     n->count = e->count;
     n->syms = malloc(sizeof(char *) * n->count);
+    n->hashes = malloc(sizeof(unsigned long) * n->count);
     n->vals = malloc(sizeof(kval *) * n->count);
 
     for (int i = 0; i < e->count; i++)
     {
         n->syms[i] = malloc(strlen(e->syms[i]) + 1);
         strcpy(n->syms[i], e->syms[i]);
+        n->hashes[i] = e->hashes[i];
         n->vals[i] = kval_copy(e->vals[i]);
     }
     return n;
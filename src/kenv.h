@@ -8,15 +8,20 @@
 // Constructor
 kenv *kenv_init(void);
 void kenv_del(kenv *e);
+void kenv_clear(kenv *e);
 
 kval *kenv_get(kenv *e, kval *k);
 void kenv_put(kenv *e, kval *k, kval *v);
+void kenv_push(kenv *e, const char *sym, size_t len, kval *v);
 
 void kenv_def(kenv *e, kval *k, kval *v);
 
 void kenv_add_builtin(kenv *e, char *name, kbuiltin func);
 void kenv_add_builtins(kenv *e);
 
+char *kenv_builtin_name(kbuiltin func);
+kbuiltin kenv_builtin_func(const char *name, size_t len);
+
 kenv *kenv_copy(kenv *e);
 
 #endif
@@ -0,0 +1,344 @@
+#include <stdlib.h>
+#include <string.h>
+#include "khash.h"
+#include "kbig.h"
+#include "kval.h"
+
+// SSE2 is part of x86-64, so there's no need to ask the CPU for it
+#if defined(__SSE2__)
+#define KHASH_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// Control bytes. Full slots hold the low 7 bits of the hash, so only
+// empty and deleted have the top bit set.
+#define KHASH_EMPTY ((int8_t)-128)
+#define KHASH_DELETED ((int8_t)-2)
+
+// Bit i set for each control byte i of a group that matches
+typedef unsigned int khash_mask;
+
+khash *khash_new(void)
+{
+    khash *h = malloc(sizeof(khash));
+
+    h->refs = 1;
+    h->iters = 0;
+    h->count = 0;
+    h->used = 0;
+    h->cap = KHASH_GROUP;
+    h->ctrl = malloc(h->cap);
+    h->slots = malloc(sizeof(khash_slot) * h->cap);
+    memset(h->ctrl, KHASH_EMPTY, h->cap);
+
+    return h;
+}
+
+khash *khash_ref(khash *h)
+{
+    h->refs++;
+    return h;
+}
+
+void khash_unref(khash *h)
+{
+    if (--h->refs > 0)
+    {
+        return;
+    }
+
+    for (size_t i = khash_next(h, 0); i < h->cap; i = khash_next(h, i + 1))
+    {
+        kval_del(h->slots[i].key);
+        kval_del(h->slots[i].val);
+    }
+
+    free(h->ctrl);
+    free(h->slots);
+    free(h);
+}
+
+// ###############
+//  Hashing      #
+// ###############
+int khash_hashable(kval *key)
+{
+    switch (key->type)
+    {
+    case KVAL_NUM:
+    case KVAL_BIG:
+    case KVAL_DBL:
+    case KVAL_STR:
+    case KVAL_SYM:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+// Spreads the bits, so sequential numbers land in different groups
+static unsigned long khash_mix(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+
+    return (unsigned long)x;
+}
+
+unsigned long khash_num(long n)
+{
+    return khash_mix((uint64_t)n);
+}
+
+unsigned long khash_key(kval *key)
+{
+    switch (key->type)
+    {
+    case KVAL_NUM:
+        return khash_num(key->num);
+
+    case KVAL_DBL:
+    {
+        // 0.0 == -0.0
+        double d = key->dbl == 0 ? 0.0 : key->dbl;
+        uint64_t bits;
+        memcpy(&bits, &d, sizeof(bits));
+        return khash_mix(bits ^ 0x9e3779b97f4a7c15ULL);
+    }
+
+    case KVAL_BIG:
+    {
+        uint64_t x = key->big->negative;
+        for (int i = 0; i < key->big->len; i++)
+        {
+            x = khash_mix(x ^ key->big->limbs[i]);
+        }
+        return x;
+    }
+
+    default:
+        return khash_mix(kval_hash(key) + key->type);
+    }
+}
+
+// ###############
+//  Groups       #
+// ###############
+static khash_mask khash_match(const int8_t *group, int8_t c)
+{
+#ifdef KHASH_SSE2
+    __m128i g = _mm_loadu_si128((const __m128i *)group);
+    return (khash_mask)_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(c)));
+#else
+    khash_mask m = 0;
+    for (int i = 0; i < KHASH_GROUP; i++)
+    {
+        m |= (khash_mask)(group[i] == c) << i;
+    }
+    return m;
+#endif
+}
+
+// Empty or deleted, the two with the top bit set
+static khash_mask khash_match_free(const int8_t *group)
+{
+#ifdef KHASH_SSE2
+    return (khash_mask)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)group));
+#else
+    khash_mask m = 0;
+    for (int i = 0; i < KHASH_GROUP; i++)
+    {
+        m |= (khash_mask)(group[i] < 0) << i;
+    }
+    return m;
+#endif
+}
+
+static int khash_lowest(khash_mask m)
+{
+    return __builtin_ctz(m);
+}
+
+/*
+    Groups are visited at offsets 0, 1, 3, 6... from the one the hash
+    picks, which reaches every group when there's a power of two of them.
+*/
+#define KHASH_PROBE(h, hash, g, step)                   \
+    for (size_t g = ((hash) >> 7) & ((h)->cap / KHASH_GROUP - 1), step = 0; \
+         step < (h)->cap / KHASH_GROUP;                  \
+         step++, g = (g + step) & ((h)->cap / KHASH_GROUP - 1))
+
+// Slot index of key, or cap
+static size_t khash_find(const khash *h, kval *key, unsigned long hash)
+{
+    int8_t h2 = (int8_t)(hash & 0x7f);
+
+    KHASH_PROBE(h, hash, g, step)
+    {
+        const int8_t *group = h->ctrl + g * KHASH_GROUP;
+
+        for (khash_mask m = khash_match(group, h2); m; m &= m - 1)
+        {
+            size_t i = g * KHASH_GROUP + khash_lowest(m);
+            if (h->slots[i].hash != hash)
+            {
+                continue;
+            }
+
+            // khash_mix is a bijection, so numbers with the same hash are the same number
+            if (key->type == KVAL_NUM ? h->slots[i].type == KVAL_NUM : kval_eq(h->slots[i].key, key))
+            {
+                return i;
+            }
+        }
+
+        if (khash_match(group, KHASH_EMPTY))
+        {
+            break;
+        }
+    }
+
+    return h->cap;
+}
+
+// First free slot on the probe sequence for hash. There is always one.
+static size_t khash_find_free(const khash *h, unsigned long hash)
+{
+    KHASH_PROBE(h, hash, g, step)
+    {
+        khash_mask m = khash_match_free(h->ctrl + g * KHASH_GROUP);
+        if (m)
+        {
+            return g * KHASH_GROUP + khash_lowest(m);
+        }
+    }
+
+    return h->cap;
+}
+
+// Into a fresh array of cap slots, which also clears out deleted ones
+static void khash_rehash(khash *h, size_t cap)
+{
+    int8_t *ctrl = h->ctrl;
+    khash_slot *slots = h->slots;
+    size_t old = h->cap;
+
+    h->cap = cap;
+    h->used = h->count;
+    h->ctrl = malloc(cap);
+    h->slots = malloc(sizeof(khash_slot) * cap);
+    memset(h->ctrl, KHASH_EMPTY, cap);
+
+    for (size_t i = 0; i < old; i++)
+    {
+        if (ctrl[i] >= 0)
+        {
+            size_t j = khash_find_free(h, slots[i].hash);
+            h->ctrl[j] = ctrl[i];
+            h->slots[j] = slots[i];
+        }
+    }
+
+    free(ctrl);
+    free(slots);
+}
+
+// ###############
+//  Access       #
+// ###############
+kval *khash_get(khash *h, kval *key)
+{
+    size_t i = khash_find(h, key, khash_key(key));
+    return i < h->cap ? h->slots[i].val : NULL;
+}
+
+int khash_put(khash *h, kval *key, kval *val)
+{
+    unsigned long hash = khash_key(key);
+    size_t i = khash_find(h, key, hash);
+
+    if (i < h->cap)
+    {
+        kval_del(h->slots[i].val);
+        kval_del(key);
+        h->slots[i].val = val;
+        return 0;
+    }
+
+    // Whether or not this one would grow the table, the next might
+    if (h->iters)
+    {
+        kval_del(key);
+        kval_del(val);
+        return -1;
+    }
+
+    // Keep at least one slot in eight free, so probes end quickly
+    if ((h->used + 1) * 8 > h->cap * 7)
+    {
+        // Mostly deleted slots just need sweeping, otherwise double
+        size_t cap = h->cap;
+        if ((h->count + 1) * 16 > cap * 7)
+        {
+            cap *= 2;
+        }
+
+        khash_rehash(h, cap);
+    }
+
+    i = khash_find_free(h, hash);
+    if (h->ctrl[i] == KHASH_EMPTY)
+    {
+        h->used++;
+    }
+
+    h->ctrl[i] = (int8_t)(hash & 0x7f);
+    h->slots[i].hash = hash;
+    h->slots[i].type = key->type;
+    h->slots[i].key = key;
+    h->slots[i].val = val;
+    h->count++;
+
+    return 0;
+}
+
+int khash_del(khash *h, kval *key)
+{
+    size_t i = khash_find(h, key, khash_key(key));
+    if (i == h->cap)
+    {
+        return 0;
+    }
+
+    kval_del(h->slots[i].key);
+    kval_del(h->slots[i].val);
+    h->count--;
+
+    // A group that already has an empty slot never let a probe past it,
+    // so the slot can go back to empty rather than leaving a tombstone
+    size_t g = i / KHASH_GROUP * KHASH_GROUP;
+    if (khash_match(h->ctrl + g, KHASH_EMPTY))
+    {
+        h->ctrl[i] = KHASH_EMPTY;
+        h->used--;
+    }
+    else
+    {
+        h->ctrl[i] = KHASH_DELETED;
+    }
+
+    return 1;
+}
+
+size_t khash_next(const khash *h, size_t i)
+{
+    while (i < h->cap && h->ctrl[i] < 0)
+    {
+        i++;
+    }
+
+    return i;
+}
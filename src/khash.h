@@ -0,0 +1,77 @@
+#ifndef khash_h
+#define khash_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "types.h"
+
+/*
+    Mutable hash tables.
+
+    Open addressing in the style of a Swiss table: a control byte per
+    slot holds 7 bits of the key's hash, or marks the slot empty or
+    deleted, and lookups compare a whole group of 16 control bytes at
+    once (with SSE2 where there is one) before touching any keys. A
+    probe stops at the first group with an empty slot in it.
+
+    Unlike every other value a table is shared, not copied: copies of
+    the kval point at the same table, so hash-put! through one is seen
+    through all of them. It's reference counted, and hash-put! refuses
+    to put a table anywhere inside itself, so there are no cycles.
+*/
+#define KHASH_GROUP 16
+
+typedef struct
+{
+    unsigned long hash;
+
+    // Of the key, so numbers can be matched on the hash alone, see khash_find
+    int type;
+
+    kval *key;
+    kval *val;
+} khash_slot;
+
+struct khash
+{
+    int refs;
+
+    // Walks in progress, which new keys could move the slots under, see khash_put
+    int iters;
+
+    size_t count;
+
+    // Full and deleted slots, which is what fills up the probe groups
+    size_t used;
+
+    // Slots, a power of two and at least one group
+    size_t cap;
+
+    int8_t *ctrl;
+    khash_slot *slots;
+};
+
+khash *khash_new(void);
+khash *khash_ref(khash *h);
+void khash_unref(khash *h);
+
+// Numbers, doubles, strings and symbols can be keys
+int khash_hashable(kval *key);
+
+// Equal keys under kval_eq hash the same. Numbers hash through a bijection, so two with the same hash are equal.
+unsigned long khash_key(kval *key);
+unsigned long khash_num(long n);
+
+// The value stored for key, still owned by the table, or NULL
+kval *khash_get(khash *h, kval *key);
+
+// Takes key and val. 0 when done, -1 for a new key while the table is being walked.
+int khash_put(khash *h, kval *key, kval *val);
+
+// 1 if key was there
+int khash_del(khash *h, kval *key);
+
+// Index of the first full slot from i on, or cap when there are no more
+size_t khash_next(const khash *h, size_t i);
+
+#endif
@@ -0,0 +1,93 @@
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "kimage.h"
+#include "kbuf.h"
+#include "kser.h"
+#include "kval.h"
+
+#define KIMAGE_MAGIC "KVI"
+#define KIMAGE_VERSION 1
+#define KIMAGE_HEADER 4
+
+void kimage_encode(kbuf *b, kenv *e)
+{
+    kbuf_put(b, KIMAGE_MAGIC, 3);
+    kbuf_putc(b, KIMAGE_VERSION);
+    kser_encode_env(b, e);
+}
+
+// Returns an Error, or an empty S-Expression once e holds the image
+kval *kimage_decode(kenv *e, const char *data, size_t len)
+{
+    const char *p = data;
+    const char *end = data + len;
+
+    int ok = len > KIMAGE_HEADER &&
+             memcmp(p, KIMAGE_MAGIC, 3) == 0 &&
+             p[3] == KIMAGE_VERSION;
+
+    if (ok)
+    {
+        p += KIMAGE_HEADER;
+        ok = kser_decode_env(&p, end, e) && p == end;
+    }
+
+    return ok ? kval_sexpr() : kval_err("Image is corrupt or from another version");
+}
+
+int kimage_save(kenv *e, const char *path)
+{
+    kbuf b;
+    kbuf_init(&b);
+    kimage_encode(&b, e);
+
+    FILE *f = fopen(path, "wb");
+    int ok = f && fwrite(b.data, 1, b.len, f) == b.len;
+
+    if (f && fclose(f) != 0)
+    {
+        ok = 0;
+    }
+
+    kbuf_free(&b);
+    return ok;
+}
+
+kval *kimage_load(kenv *e, const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return kval_err("Could not load image %s", path);
+    }
+
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > KIMAGE_HEADER)
+    {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+
+    if (map == MAP_FAILED)
+    {
+        return kval_err("Could not load image %s", path);
+    }
+
+    kval *x = kimage_decode(e, map, st.st_size);
+    munmap(map, st.st_size);
+
+    if (x->type == KVAL_ERR)
+    {
+        kval_del(x);
+        x = kval_err("Image %s is corrupt or from another version", path);
+    }
+
+    return x;
+}
@@ -0,0 +1,22 @@
+#ifndef kimage_h
+#define kimage_h
+
+#include <stddef.h>
+#include "kbuf.h"
+#include "types.h"
+
+/*
+    Snapshot of a fully initialised global environment.
+
+    --save-image writes every binding of the global kenv (closures
+    included) after the stdlib and any files have run. --image maps the
+    file back in and decodes it instead of reading the stdlib. The
+    build embeds the stdlib into the binary the same way.
+*/
+void kimage_encode(kbuf *b, kenv *e);
+kval *kimage_decode(kenv *e, const char *data, size_t len);
+
+int kimage_save(kenv *e, const char *path);
+kval *kimage_load(kenv *e, const char *path);
+
+#endif
@@ -0,0 +1,128 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "kintern.h"
+
+#define KINTERN_SLOTS 1024
+
+// String literals longer than this are kept as their own copies
+#define KINTERN_STR_MAX 64
+
+// Bytes of string literals the table takes before it stops adding more
+#define KINTERN_STR_BUDGET (1 << 20)
+
+typedef struct
+{
+    unsigned long hash;
+    size_t len;
+    char chars[];
+} kintern_entry;
+
+int kintern_enabled = 1;
+
+static pthread_mutex_t kintern_lock = PTHREAD_MUTEX_INITIALIZER;
+static kintern_entry **kintern_slots;
+static unsigned long kintern_nslots;
+static unsigned long kintern_count;
+static size_t kintern_str_bytes;
+
+unsigned long kintern_hash(const char *s, size_t len)
+{
+    unsigned long h = 14695981039346656037UL;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211UL;
+    }
+
+    return h ? h : 1;
+}
+
+static void kintern_grow(void)
+{
+    unsigned long nslots = kintern_nslots ? kintern_nslots * 2 : KINTERN_SLOTS;
+    kintern_entry **slots = calloc(nslots, sizeof(kintern_entry *));
+
+    for (unsigned long i = 0; i < kintern_nslots; i++)
+    {
+        kintern_entry *x = kintern_slots[i];
+        if (!x)
+        {
+            continue;
+        }
+
+        unsigned long h = x->hash & (nslots - 1);
+        while (slots[h])
+        {
+            h = (h + 1) & (nslots - 1);
+        }
+        slots[h] = x;
+    }
+
+    free(kintern_slots);
+    kintern_slots = slots;
+    kintern_nslots = nslots;
+}
+
+// The entry for s, or if there isn't one and add is set a new one. Called with the lock held.
+static const char *kintern_put(const char *s, size_t len, unsigned long hash, int add)
+{
+    if (kintern_count * 2 >= kintern_nslots)
+    {
+        kintern_grow();
+    }
+
+    unsigned long h = hash & (kintern_nslots - 1);
+    kintern_entry *x;
+    while ((x = kintern_slots[h]))
+    {
+        if (x->hash == hash && x->len == len && memcmp(x->chars, s, len) == 0)
+        {
+            return x->chars;
+        }
+
+        h = (h + 1) & (kintern_nslots - 1);
+    }
+
+    if (!add)
+    {
+        return NULL;
+    }
+
+    x = malloc(sizeof(kintern_entry) + len + 1);
+    x->hash = hash;
+    x->len = len;
+    memcpy(x->chars, s, len);
+    x->chars[len] = '\0';
+
+    kintern_slots[h] = x;
+    kintern_count++;
+
+    return x->chars;
+}
+
+const char *kintern(const char *s, size_t len, unsigned long hash)
+{
+    pthread_mutex_lock(&kintern_lock);
+    const char *x = kintern_put(s, len, hash, 1);
+    pthread_mutex_unlock(&kintern_lock);
+
+    return x;
+}
+
+const char *kintern_str(const char *s, size_t len, unsigned long hash)
+{
+    pthread_mutex_lock(&kintern_lock);
+
+    unsigned long count = kintern_count;
+    int add = len <= KINTERN_STR_MAX && kintern_str_bytes + len <= KINTERN_STR_BUDGET;
+    const char *x = kintern_put(s, len, hash, add);
+    if (kintern_count != count)
+    {
+        kintern_str_bytes += len;
+    }
+
+    pthread_mutex_unlock(&kintern_lock);
+    return x;
+}
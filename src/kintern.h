@@ -0,0 +1,33 @@
+#ifndef kintern_h
+#define kintern_h
+
+#include <stddef.h>
+
+/*
+    Table of interned strings.
+
+    Symbols and string literals read from source are immutable, so
+    every occurrence of the same bytes can share one copy. Interned
+    strings are equal exactly when their pointers are, and carry their
+    hash with them. Entries are never freed, so only symbols, which a
+    program has a limited number of, always go in. String literals go in
+    while they're short and there aren't too many of them, and past that
+    keep their own bytes, so a file of unique literals streams through
+    in constant memory.
+
+    The reader runs on loader threads, so the table is locked.
+*/
+
+// Cleared by the --no-intern command line flag
+extern int kintern_enabled;
+
+// FNV-1a, never 0 so that 0 can mean "not hashed yet"
+unsigned long kintern_hash(const char *s, size_t len);
+
+// The shared copy of s, added to the table if it isn't there yet
+const char *kintern(const char *s, size_t len, unsigned long hash);
+
+// The same for a string literal, or NULL if it isn't in the table and won't be added
+const char *kintern_str(const char *s, size_t len, unsigned long hash);
+
+#endif
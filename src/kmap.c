@@ -0,0 +1,534 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include "kmap.h"
+#include "khash.h"
+#include "kval.h"
+
+#define KMAP_BITS 5
+#define KMAP_FRAG(hash, shift) (((hash) >> (shift)) & 31)
+
+// Past this shift the hash is used up, and equal hashes share a collision node
+#define KMAP_HASH_BITS ((int)(sizeof(unsigned long) * CHAR_BIT))
+
+#define KMAP_LEAF(n, i) ((kmap_leaf *)(n)->slots[i])
+#define KMAP_CHILD(n, i) ((kmap_node *)(n)->slots[(n)->nleaf + (i)])
+
+// Slot of bit among the ones set in map
+static int kmap_index(uint32_t map, uint32_t bit)
+{
+    return __builtin_popcount(map & (bit - 1));
+}
+
+// ###############
+//  Nodes        #
+// ###############
+static kmap_node *kmap_node_alloc(int nleaf, int nchild)
+{
+    kmap_node *n = malloc(sizeof(kmap_node) + sizeof(void *) * (nleaf + nchild));
+
+    n->refs = 1;
+    n->datamap = 0;
+    n->nodemap = 0;
+    n->nleaf = nleaf;
+    n->nchild = nchild;
+
+    return n;
+}
+
+static void kmap_leaf_unref(kmap_leaf *l)
+{
+    if (--l->refs == 0)
+    {
+        kval_del(l->key);
+        kval_del(l->val);
+        free(l);
+    }
+}
+
+static void kmap_node_unref(kmap_node *n)
+{
+    if (--n->refs > 0)
+    {
+        return;
+    }
+
+    for (int i = 0; i < n->nleaf; i++)
+    {
+        kmap_leaf_unref(KMAP_LEAF(n, i));
+    }
+
+    for (int i = 0; i < n->nchild; i++)
+    {
+        kmap_node_unref(KMAP_CHILD(n, i));
+    }
+
+    free(n);
+}
+
+// Takes n, giving back a node with the same slots that nothing else holds
+static kmap_node *kmap_node_own(kmap_node *n)
+{
+    if (n->refs == 1)
+    {
+        return n;
+    }
+
+    kmap_node *c = kmap_node_alloc(n->nleaf, n->nchild);
+    c->datamap = n->datamap;
+    c->nodemap = n->nodemap;
+    memcpy(c->slots, n->slots, sizeof(void *) * (n->nleaf + n->nchild));
+
+    for (int i = 0; i < c->nleaf; i++)
+    {
+        KMAP_LEAF(c, i)->refs++;
+    }
+
+    for (int i = 0; i < c->nchild; i++)
+    {
+        KMAP_CHILD(c, i)->refs++;
+    }
+
+    n->refs--;
+    return c;
+}
+
+/*
+    Takes n, giving back a node with the new maps: leaf skip_leaf and child
+    skip_child (-1 for none) left out, and NULL holes at new_leaf and
+    new_child (-1 for none) for the caller to fill. The slots move over
+    when n is ours alone, and are shared with it otherwise.
+*/
+static kmap_node *kmap_node_rebuild(kmap_node *n, uint32_t datamap, uint32_t nodemap,
+                                    int skip_leaf, int new_leaf, int skip_child, int new_child)
+{
+    kmap_node *r = kmap_node_alloc(__builtin_popcount(datamap), __builtin_popcount(nodemap));
+    r->datamap = datamap;
+    r->nodemap = nodemap;
+
+    int shared = n->refs > 1;
+
+    for (int i = 0, j = 0; i < r->nleaf; i++)
+    {
+        if (i == new_leaf)
+        {
+            r->slots[i] = NULL;
+            continue;
+        }
+
+        j += j == skip_leaf;
+        r->slots[i] = n->slots[j++];
+        if (shared)
+        {
+            KMAP_LEAF(r, i)->refs++;
+        }
+    }
+
+    for (int i = 0, j = 0; i < r->nchild; i++)
+    {
+        if (i == new_child)
+        {
+            r->slots[r->nleaf + i] = NULL;
+            continue;
+        }
+
+        j += j == skip_child;
+        r->slots[r->nleaf + i] = KMAP_CHILD(n, j++);
+        if (shared)
+        {
+            KMAP_CHILD(r, i)->refs++;
+        }
+    }
+
+    if (shared)
+    {
+        n->refs--;
+        return r;
+    }
+
+    if (skip_leaf >= 0)
+    {
+        kmap_leaf_unref(KMAP_LEAF(n, skip_leaf));
+    }
+
+    if (skip_child >= 0 && KMAP_CHILD(n, skip_child))
+    {
+        kmap_node_unref(KMAP_CHILD(n, skip_child));
+    }
+
+    free(n);
+    return r;
+}
+
+static int kmap_leaf_is(const kmap_leaf *l, kval *key, unsigned long hash)
+{
+    if (l->hash != hash)
+    {
+        return 0;
+    }
+
+    // See khash_key
+    return key->type == KVAL_NUM ? l->type == KVAL_NUM : kval_eq(l->key, key);
+}
+
+// ###############
+//  Lookup       #
+// ###############
+static kmap_leaf *kmap_node_find(const kmap_node *n, kval *key, unsigned long hash)
+{
+    for (int shift = 0; n; shift += KMAP_BITS)
+    {
+        if (shift >= KMAP_HASH_BITS)
+        {
+            for (int i = 0; i < n->nleaf; i++)
+            {
+                if (kmap_leaf_is(KMAP_LEAF(n, i), key, hash))
+                {
+                    return KMAP_LEAF(n, i);
+                }
+            }
+
+            return NULL;
+        }
+
+        uint32_t bit = 1u << KMAP_FRAG(hash, shift);
+
+        if (n->datamap & bit)
+        {
+            kmap_leaf *l = KMAP_LEAF(n, kmap_index(n->datamap, bit));
+            return kmap_leaf_is(l, key, hash) ? l : NULL;
+        }
+
+        if (!(n->nodemap & bit))
+        {
+            return NULL;
+        }
+
+        n = KMAP_CHILD(n, kmap_index(n->nodemap, bit));
+    }
+
+    return NULL;
+}
+
+// ###############
+//  Update       #
+// ###############
+
+// A node for two leaves whose hashes agree up to shift
+static kmap_node *kmap_node_pair(kmap_leaf *a, kmap_leaf *b, int shift)
+{
+    if (shift >= KMAP_HASH_BITS)
+    {
+        kmap_node *n = kmap_node_alloc(2, 0);
+        n->slots[0] = a;
+        n->slots[1] = b;
+        return n;
+    }
+
+    uint32_t ba = 1u << KMAP_FRAG(a->hash, shift);
+    uint32_t bb = 1u << KMAP_FRAG(b->hash, shift);
+
+    if (ba == bb)
+    {
+        kmap_node *n = kmap_node_alloc(0, 1);
+        n->nodemap = ba;
+        n->slots[0] = kmap_node_pair(a, b, shift + KMAP_BITS);
+        return n;
+    }
+
+    kmap_node *n = kmap_node_alloc(2, 0);
+    n->datamap = ba | bb;
+    n->slots[ba < bb ? 0 : 1] = a;
+    n->slots[ba < bb ? 1 : 0] = b;
+    return n;
+}
+
+static kmap_node *kmap_collision_assoc(kmap_node *n, kmap_leaf *leaf, int *added)
+{
+    for (int i = 0; i < n->nleaf; i++)
+    {
+        if (kmap_leaf_is(KMAP_LEAF(n, i), leaf->key, leaf->hash))
+        {
+            n = kmap_node_own(n);
+            kmap_leaf_unref(KMAP_LEAF(n, i));
+            n->slots[i] = leaf;
+            return n;
+        }
+    }
+
+    kmap_node *r = kmap_node_alloc(n->nleaf + 1, 0);
+    memcpy(r->slots, n->slots, sizeof(void *) * n->nleaf);
+    r->slots[n->nleaf] = leaf;
+
+    if (n->refs > 1)
+    {
+        for (int i = 0; i < n->nleaf; i++)
+        {
+            KMAP_LEAF(n, i)->refs++;
+        }
+        n->refs--;
+    }
+    else
+    {
+        free(n);
+    }
+
+    *added = 1;
+    return r;
+}
+
+// Takes n, giving back the node that replaces it
+static kmap_node *kmap_node_assoc(kmap_node *n, int shift, kmap_leaf *leaf, int *added)
+{
+    if (shift >= KMAP_HASH_BITS)
+    {
+        return kmap_collision_assoc(n, leaf, added);
+    }
+
+    uint32_t bit = 1u << KMAP_FRAG(leaf->hash, shift);
+
+    if (n->nodemap & bit)
+    {
+        int ci = kmap_index(n->nodemap, bit);
+
+        n = kmap_node_own(n);
+        n->slots[n->nleaf + ci] = kmap_node_assoc(KMAP_CHILD(n, ci), shift + KMAP_BITS, leaf, added);
+        return n;
+    }
+
+    int li = kmap_index(n->datamap, bit);
+
+    if (!(n->datamap & bit))
+    {
+        n = kmap_node_rebuild(n, n->datamap | bit, n->nodemap, -1, li, -1, -1);
+        n->slots[li] = leaf;
+        *added = 1;
+        return n;
+    }
+
+    kmap_leaf *old = KMAP_LEAF(n, li);
+    if (kmap_leaf_is(old, leaf->key, leaf->hash))
+    {
+        n = kmap_node_own(n);
+        kmap_leaf_unref(old);
+        n->slots[li] = leaf;
+        return n;
+    }
+
+    // Two keys with the same bits here, both go down a level
+    old->refs++;
+    kmap_node *child = kmap_node_pair(old, leaf, shift + KMAP_BITS);
+    int ci = kmap_index(n->nodemap, bit);
+
+    n = kmap_node_rebuild(n, n->datamap & ~bit, n->nodemap | bit, li, -1, -1, ci);
+    n->slots[n->nleaf + ci] = child;
+    *added = 1;
+
+    return n;
+}
+
+// Takes n, which must hold key, giving back what replaces it, NULL once it's empty
+static kmap_node *kmap_node_dissoc(kmap_node *n, int shift, kval *key, unsigned long hash)
+{
+    if (shift >= KMAP_HASH_BITS)
+    {
+        int i = 0;
+        while (!kmap_leaf_is(KMAP_LEAF(n, i), key, hash))
+        {
+            i++;
+        }
+
+        if (n->nleaf == 1)
+        {
+            kmap_node_unref(n);
+            return NULL;
+        }
+
+        // The last leaf fills the gap
+        n = kmap_node_own(n);
+        kmap_leaf_unref(KMAP_LEAF(n, i));
+        n->slots[i] = n->slots[--n->nleaf];
+        return n;
+    }
+
+    uint32_t bit = 1u << KMAP_FRAG(hash, shift);
+
+    if (n->datamap & bit)
+    {
+        if (n->nleaf == 1 && n->nchild == 0)
+        {
+            kmap_node_unref(n);
+            return NULL;
+        }
+
+        return kmap_node_rebuild(n, n->datamap & ~bit, n->nodemap, kmap_index(n->datamap, bit), -1, -1, -1);
+    }
+
+    int ci = kmap_index(n->nodemap, bit);
+
+    n = kmap_node_own(n);
+    kmap_node *c = kmap_node_dissoc(KMAP_CHILD(n, ci), shift + KMAP_BITS, key, hash);
+    n->slots[n->nleaf + ci] = c;
+
+    if (c && (c->nchild > 0 || c->nleaf > 1))
+    {
+        return n;
+    }
+
+    // The child is gone, or down to one leaf which comes up to this level instead
+    n->slots[n->nleaf + ci] = NULL;
+
+    if (!c)
+    {
+        if (n->nleaf == 0 && n->nchild == 1)
+        {
+            free(n);
+            return NULL;
+        }
+
+        return kmap_node_rebuild(n, n->datamap, n->nodemap & ~bit, -1, -1, ci, -1);
+    }
+
+    kmap_leaf *l = KMAP_LEAF(c, 0);
+    l->refs++;
+    kmap_node_unref(c);
+
+    int li = kmap_index(n->datamap, bit);
+    n = kmap_node_rebuild(n, n->datamap | bit, n->nodemap & ~bit, -1, li, ci, -1);
+    n->slots[li] = l;
+
+    return n;
+}
+
+// ###############
+//  Maps         #
+// ###############
+kmap *kmap_new(void)
+{
+    kmap *m = malloc(sizeof(kmap));
+
+    m->refs = 1;
+    m->count = 0;
+    m->root = NULL;
+
+    return m;
+}
+
+kmap *kmap_ref(kmap *m)
+{
+    m->refs++;
+    return m;
+}
+
+void kmap_unref(kmap *m)
+{
+    if (--m->refs > 0)
+    {
+        return;
+    }
+
+    if (m->root)
+    {
+        kmap_node_unref(m->root);
+    }
+
+    free(m);
+}
+
+// Takes m, giving back one nothing else holds. A copy shares the root, so updates copy their path.
+static kmap *kmap_own(kmap *m)
+{
+    if (m->refs == 1)
+    {
+        return m;
+    }
+
+    kmap *c = kmap_new();
+    c->count = m->count;
+    c->root = m->root;
+    if (c->root)
+    {
+        c->root->refs++;
+    }
+
+    m->refs--;
+    return c;
+}
+
+kval *kmap_get(const kmap *m, kval *key)
+{
+    kmap_leaf *l = kmap_node_find(m->root, key, khash_key(key));
+    return l ? l->val : NULL;
+}
+
+kmap *kmap_assoc(kmap *m, kval *key, kval *val)
+{
+    kmap_leaf *leaf = malloc(sizeof(kmap_leaf));
+    leaf->refs = 1;
+    leaf->type = key->type;
+    leaf->hash = khash_key(key);
+    leaf->key = key;
+    leaf->val = val;
+
+    m = kmap_own(m);
+
+    if (!m->root)
+    {
+        m->root = kmap_node_alloc(1, 0);
+        m->root->datamap = 1u << KMAP_FRAG(leaf->hash, 0);
+        m->root->slots[0] = leaf;
+        m->count = 1;
+        return m;
+    }
+
+    int added = 0;
+    m->root = kmap_node_assoc(m->root, 0, leaf, &added);
+    m->count += added;
+
+    return m;
+}
+
+kmap *kmap_dissoc(kmap *m, kval *key)
+{
+    unsigned long hash = khash_key(key);
+
+    // Nothing to copy when it isn't there
+    if (!kmap_node_find(m->root, key, hash))
+    {
+        return m;
+    }
+
+    m = kmap_own(m);
+    m->root = kmap_node_dissoc(m->root, 0, key, hash);
+    m->count--;
+
+    return m;
+}
+
+static int kmap_node_walk(const kmap_node *n, int (*f)(kval *key, kval *val, void *ctx), void *ctx)
+{
+    for (int i = 0; i < n->nleaf; i++)
+    {
+        int r = f(KMAP_LEAF(n, i)->key, KMAP_LEAF(n, i)->val, ctx);
+        if (r)
+        {
+            return r;
+        }
+    }
+
+    for (int i = 0; i < n->nchild; i++)
+    {
+        int r = kmap_node_walk(KMAP_CHILD(n, i), f, ctx);
+        if (r)
+        {
+            return r;
+        }
+    }
+
+    return 0;
+}
+
+int kmap_walk(const kmap *m, int (*f)(kval *key, kval *val, void *ctx), void *ctx)
+{
+    return m->root ? kmap_node_walk(m->root, f, ctx) : 0;
+}
@@ -0,0 +1,67 @@
+#ifndef kmap_h
+#define kmap_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "types.h"
+
+/*
+    Persistent maps.
+
+    A hash array mapped trie: each node takes 5 bits of the key's hash
+    and has up to 32 slots, each a leaf holding one entry or a child
+    node for the keys sharing those bits. Updates copy only the nodes
+    on the path to the key and share the rest with the old version, so
+    both stay valid, and copying a map is a reference count.
+
+    As with vectors, an update writes in place instead when nothing
+    else can see the nodes it would have copied.
+
+    Keys are hashed and compared as for hash tables, see khash_key.
+*/
+typedef struct kmap_leaf
+{
+    int refs;
+    int type;
+    unsigned long hash;
+    kval *key;
+    kval *val;
+} kmap_leaf;
+
+typedef struct kmap_node
+{
+    int refs;
+
+    // Slots holding a leaf, and a child, by their 5 bits of the hash
+    uint32_t datamap;
+    uint32_t nodemap;
+
+    // Leaves in slot order, then children in slot order. Once the hash
+    // runs out, a collision node has no maps and nleaf leaves.
+    int nleaf;
+    int nchild;
+    void *slots[];
+} kmap_node;
+
+struct kmap
+{
+    int refs;
+    size_t count;
+    kmap_node *root;
+};
+
+kmap *kmap_new(void);
+kmap *kmap_ref(kmap *m);
+void kmap_unref(kmap *m);
+
+// The value for key, still owned by the map, or NULL
+kval *kmap_get(const kmap *m, kval *key);
+
+// m with key set to val, or without key. Both take m, and assoc takes key and val.
+kmap *kmap_assoc(kmap *m, kval *key, kval *val);
+kmap *kmap_dissoc(kmap *m, kval *key);
+
+// Calls f on each entry until it returns non zero, which is returned
+int kmap_walk(const kmap *m, int (*f)(kval *key, kval *val, void *ctx), void *ctx);
+
+#endif
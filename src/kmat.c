@@ -0,0 +1,338 @@
+#include <stdlib.h>
+#include <string.h>
+#include "kmat.h"
+#include "kvec.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KMAT_X86 1
+#include <immintrin.h>
+#define KMAT_AVX2 __attribute__((target("avx2,fma")))
+#endif
+
+// Register tile of the multiply kernel, rows of a by columns of b
+#define KMAT_MR 6
+#define KMAT_NR 8
+
+// Cache blocking: a kc deep slice of b, nc wide, stays in L3 while
+// mc rows of a go through L2, and one tile's panels sit in L1
+#define KMAT_KC 256
+#define KMAT_MC 72
+#define KMAT_NC 1024
+
+// Below this many multiply-adds the packing costs more than it saves
+#define KMAT_SMALL (32 * 32 * 32)
+
+kmat *kmat_alloc(size_t rows, size_t cols)
+{
+    kmat *m = malloc(sizeof(kmat) + rows * cols * sizeof(double));
+
+    m->refs = 1;
+    m->rows = rows;
+    m->cols = cols;
+    m->f64 = (double *)(m + 1);
+
+    return m;
+}
+
+kmat *kmat_ref(kmat *m)
+{
+    m->refs++;
+    return m;
+}
+
+void kmat_unref(kmat *m)
+{
+    if (--m->refs == 0)
+    {
+        free(m);
+    }
+}
+
+// In square tiles, so neither side is walked a whole column at a time
+kmat *kmat_transpose(const kmat *m)
+{
+    kmat *t = kmat_alloc(m->cols, m->rows);
+    const size_t tile = 32;
+
+    for (size_t i0 = 0; i0 < m->rows; i0 += tile)
+    {
+        size_t i1 = i0 + tile < m->rows ? i0 + tile : m->rows;
+
+        for (size_t j0 = 0; j0 < m->cols; j0 += tile)
+        {
+            size_t j1 = j0 + tile < m->cols ? j0 + tile : m->cols;
+
+            for (size_t i = i0; i < i1; i++)
+            {
+                for (size_t j = j0; j < j1; j++)
+                {
+                    t->f64[j * m->rows + i] = m->f64[i * m->cols + j];
+                }
+            }
+        }
+    }
+
+    return t;
+}
+
+void kmat_row_sums(const kmat *m, double *out)
+{
+    for (size_t i = 0; i < m->rows; i++)
+    {
+        out[i] = kvec_f64_sum(m->f64 + i * m->cols, m->cols);
+    }
+}
+
+// Adding whole rows keeps the loads contiguous
+void kmat_col_sums(const kmat *m, double *out)
+{
+    memset(out, 0, m->cols * sizeof(double));
+
+    for (size_t i = 0; i < m->rows; i++)
+    {
+        kvec_f64_op('+', out, out, 1, m->f64 + i * m->cols, 1, m->cols);
+    }
+}
+
+// ###############
+//  Kernels      #
+// ###############
+
+/*
+    c[MR][ldc] += a * b over kc steps, where a is an MR wide panel
+    (a column of the tile at a time) and b an NR wide one (a row at a
+    time), both packed and zero padded by kmat_pack_a/b.
+*/
+typedef void (*kmat_kernel)(size_t kc, const double *a, const double *b, double *c, size_t ldc);
+
+static void kmat_kernel_c(size_t kc, const double *a, const double *b, double *c, size_t ldc)
+{
+    double acc[KMAT_MR][KMAT_NR] = {{0}};
+
+    for (size_t p = 0; p < kc; p++)
+    {
+        for (int i = 0; i < KMAT_MR; i++)
+        {
+            double x = a[i];
+            for (int j = 0; j < KMAT_NR; j++)
+            {
+                acc[i][j] += x * b[j];
+            }
+        }
+
+        a += KMAT_MR;
+        b += KMAT_NR;
+    }
+
+    for (int i = 0; i < KMAT_MR; i++)
+    {
+        for (int j = 0; j < KMAT_NR; j++)
+        {
+            c[i * ldc + j] += acc[i][j];
+        }
+    }
+}
+
+#ifdef KMAT_X86
+// Twelve accumulators, two per row of the tile, and the two lanes of b
+// and a broadcast element of a make fifteen of the sixteen registers
+KMAT_AVX2 static void kmat_kernel_avx2(size_t kc, const double *a, const double *b, double *c, size_t ldc)
+{
+    __m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+    __m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+    __m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+    __m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+    __m256d c40 = _mm256_setzero_pd(), c41 = _mm256_setzero_pd();
+    __m256d c50 = _mm256_setzero_pd(), c51 = _mm256_setzero_pd();
+
+    for (size_t p = 0; p < kc; p++)
+    {
+        __m256d b0 = _mm256_loadu_pd(b);
+        __m256d b1 = _mm256_loadu_pd(b + 4);
+        __m256d x;
+
+        x = _mm256_broadcast_sd(a + 0);
+        c00 = _mm256_fmadd_pd(x, b0, c00);
+        c01 = _mm256_fmadd_pd(x, b1, c01);
+
+        x = _mm256_broadcast_sd(a + 1);
+        c10 = _mm256_fmadd_pd(x, b0, c10);
+        c11 = _mm256_fmadd_pd(x, b1, c11);
+
+        x = _mm256_broadcast_sd(a + 2);
+        c20 = _mm256_fmadd_pd(x, b0, c20);
+        c21 = _mm256_fmadd_pd(x, b1, c21);
+
+        x = _mm256_broadcast_sd(a + 3);
+        c30 = _mm256_fmadd_pd(x, b0, c30);
+        c31 = _mm256_fmadd_pd(x, b1, c31);
+
+        x = _mm256_broadcast_sd(a + 4);
+        c40 = _mm256_fmadd_pd(x, b0, c40);
+        c41 = _mm256_fmadd_pd(x, b1, c41);
+
+        x = _mm256_broadcast_sd(a + 5);
+        c50 = _mm256_fmadd_pd(x, b0, c50);
+        c51 = _mm256_fmadd_pd(x, b1, c51);
+
+        a += KMAT_MR;
+        b += KMAT_NR;
+    }
+
+#define KMAT_STORE(row, lo, hi)                                                            \
+    _mm256_storeu_pd(c + row * ldc, _mm256_add_pd(_mm256_loadu_pd(c + row * ldc), lo));         \
+    _mm256_storeu_pd(c + row * ldc + 4, _mm256_add_pd(_mm256_loadu_pd(c + row * ldc + 4), hi));
+
+    KMAT_STORE(0, c00, c01)
+    KMAT_STORE(1, c10, c11)
+    KMAT_STORE(2, c20, c21)
+    KMAT_STORE(3, c30, c31)
+    KMAT_STORE(4, c40, c41)
+    KMAT_STORE(5, c50, c51)
+
+#undef KMAT_STORE
+}
+#endif
+
+static kmat_kernel kmat_kernel_get(void)
+{
+#ifdef KMAT_X86
+    // Same switch as the vector kernels, but this one wants FMA too
+    static int fma = -1;
+    if (fma < 0)
+    {
+        __builtin_cpu_init();
+        fma = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    }
+
+    if (fma && kvec_simd_enabled)
+    {
+        return kmat_kernel_avx2;
+    }
+#endif
+
+    return kmat_kernel_c;
+}
+
+// ###############
+//  Multiply     #
+// ###############
+
+// mc by kc of a, at lda, into MR row panels stored a column at a time
+static void kmat_pack_a(double *dst, const double *a, size_t lda, size_t mc, size_t kc)
+{
+    for (size_t i0 = 0; i0 < mc; i0 += KMAT_MR)
+    {
+        size_t mr = mc - i0 < KMAT_MR ? mc - i0 : KMAT_MR;
+
+        for (size_t p = 0; p < kc; p++)
+        {
+            for (size_t i = 0; i < KMAT_MR; i++)
+            {
+                *dst++ = i < mr ? a[(i0 + i) * lda + p] : 0.0;
+            }
+        }
+    }
+}
+
+// kc by nc of b, at ldb, into NR column panels stored a row at a time
+static void kmat_pack_b(double *dst, const double *b, size_t ldb, size_t kc, size_t nc)
+{
+    for (size_t j0 = 0; j0 < nc; j0 += KMAT_NR)
+    {
+        size_t nr = nc - j0 < KMAT_NR ? nc - j0 : KMAT_NR;
+
+        for (size_t p = 0; p < kc; p++)
+        {
+            const double *row = b + p * ldb + j0;
+
+            for (size_t j = 0; j < KMAT_NR; j++)
+            {
+                *dst++ = j < nr ? row[j] : 0.0;
+            }
+        }
+    }
+}
+
+// i, k, j order so the inner loop runs along rows of b and c
+static void kmat_mul_small(double *c, const double *a, const double *b, size_t m, size_t k, size_t n)
+{
+    memset(c, 0, m * n * sizeof(double));
+
+    for (size_t i = 0; i < m; i++)
+    {
+        for (size_t p = 0; p < k; p++)
+        {
+            double x = a[i * k + p];
+            for (size_t j = 0; j < n; j++)
+            {
+                c[i * n + j] += x * b[p * n + j];
+            }
+        }
+    }
+}
+
+void kmat_mul(double *c, const double *a, const double *b, size_t m, size_t k, size_t n)
+{
+    if (m * k * n <= KMAT_SMALL)
+    {
+        kmat_mul_small(c, a, b, m, k, n);
+        return;
+    }
+
+    kmat_kernel kernel = kmat_kernel_get();
+
+    double *pa = malloc(sizeof(double) * (KMAT_MC + KMAT_MR) * KMAT_KC);
+    double *pb = malloc(sizeof(double) * KMAT_KC * (KMAT_NC + KMAT_NR));
+
+    memset(c, 0, m * n * sizeof(double));
+
+    for (size_t jc = 0; jc < n; jc += KMAT_NC)
+    {
+        size_t nc = n - jc < KMAT_NC ? n - jc : KMAT_NC;
+
+        for (size_t pc = 0; pc < k; pc += KMAT_KC)
+        {
+            size_t kc = k - pc < KMAT_KC ? k - pc : KMAT_KC;
+            kmat_pack_b(pb, b + pc * n + jc, n, kc, nc);
+
+            for (size_t ic = 0; ic < m; ic += KMAT_MC)
+            {
+                size_t mc = m - ic < KMAT_MC ? m - ic : KMAT_MC;
+                kmat_pack_a(pa, a + ic * k + pc, k, mc, kc);
+
+                for (size_t jr = 0; jr < nc; jr += KMAT_NR)
+                {
+                    size_t nr = nc - jr < KMAT_NR ? nc - jr : KMAT_NR;
+
+                    for (size_t ir = 0; ir < mc; ir += KMAT_MR)
+                    {
+                        size_t mr = mc - ir < KMAT_MR ? mc - ir : KMAT_MR;
+                        double *ct = c + (ic + ir) * n + jc + jr;
+
+                        if (mr == KMAT_MR && nr == KMAT_NR)
+                        {
+                            kernel(kc, pa + ir * kc, pb + jr * kc, ct, n);
+                            continue;
+                        }
+
+                        // Ragged edge, run the full tile into scratch and keep what fits
+                        double edge[KMAT_MR * KMAT_NR] = {0};
+                        kernel(kc, pa + ir * kc, pb + jr * kc, edge, KMAT_NR);
+
+                        for (size_t i = 0; i < mr; i++)
+                        {
+                            for (size_t j = 0; j < nr; j++)
+                            {
+                                ct[i * n + j] += edge[i * KMAT_NR + j];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    free(pa);
+    free(pb);
+}
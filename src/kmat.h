@@ -0,0 +1,39 @@
+#ifndef kmat_h
+#define kmat_h
+
+#include <stddef.h>
+#include "types.h"
+
+/*
+    Dense matrices of doubles.
+
+    Row major, element (i, j) at f64[i * cols + j]. Immutable and
+    reference counted like vectors, and the elementwise ops are the
+    vector kernels run over the whole block. Multiplication packs both
+    sides into cache sized panels and runs a small register tiled
+    kernel over them, AVX2 + FMA when the CPU has it.
+*/
+struct kmat
+{
+    int refs;
+    size_t rows;
+    size_t cols;
+
+    // After the header
+    double *f64;
+};
+
+kmat *kmat_alloc(size_t rows, size_t cols);
+kmat *kmat_ref(kmat *m);
+void kmat_unref(kmat *m);
+
+kmat *kmat_transpose(const kmat *m);
+
+// c = a * b, a is m by k and b is k by n, c must not overlap either
+void kmat_mul(double *c, const double *a, const double *b, size_t m, size_t k, size_t n);
+
+// One sum per row into out[rows], or per column into out[cols]
+void kmat_row_sums(const kmat *m, double *out);
+void kmat_col_sums(const kmat *m, double *out);
+
+#endif
@@ -0,0 +1,174 @@
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "kout.h"
+#include "kbuf.h"
+
+#define KOUT_FLUSH 65536
+
+static kbuf out;
+static int interactive;
+
+void kout_init(void)
+{
+    kbuf_init(&out);
+    kbuf_reserve(&out, KOUT_FLUSH);
+
+    interactive = isatty(STDOUT_FILENO);
+    atexit(kout_flush);
+}
+
+void kout_flush(void)
+{
+    if (out.len)
+    {
+        fwrite(out.data, 1, out.len, stdout);
+        out.len = 0;
+    }
+
+    fflush(stdout);
+}
+
+static void kout_check(void)
+{
+    if (out.len >= KOUT_FLUSH)
+    {
+        kout_flush();
+    }
+}
+
+void kout_putc(char c)
+{
+    kbuf_putc(&out, c);
+}
+
+void kout_write(const char *s, size_t len)
+{
+    kbuf_put(&out, s, len);
+    kout_check();
+}
+
+void kout_puts(const char *s)
+{
+    kout_write(s, strlen(s));
+}
+
+void kout_long(long n)
+{
+    char digits[24];
+    char *p = digits + sizeof(digits);
+
+    // Work with the magnitude as unsigned so LONG_MIN is fine
+    unsigned long u = n < 0 ? 0 - (unsigned long)n : (unsigned long)n;
+
+    do
+    {
+        *--p = (char)('0' + u % 10);
+        u /= 10;
+    } while (u);
+
+    if (n < 0)
+    {
+        *--p = '-';
+    }
+
+    kout_write(p, digits + sizeof(digits) - p);
+}
+
+void kout_double(double d)
+{
+    char digits[40];
+
+    // Fewest digits that read back as the same double
+    int n = 0;
+    for (int precision = 15; precision <= 17; precision++)
+    {
+        n = snprintf(digits, sizeof(digits), "%.*g", precision, d);
+        if (strtod(digits, NULL) == d || d != d)
+        {
+            break;
+        }
+    }
+
+    // Keep it reading back as a double rather than an integer, 1e+20 as 1.0e+20
+    if (!strpbrk(digits, ".in"))
+    {
+        char *exp = strchr(digits, 'e');
+        size_t at = exp ? (size_t)(exp - digits) : (size_t)n;
+
+        memmove(digits + at + 2, digits + at, n - at + 1);
+        memcpy(digits + at, ".0", 2);
+        n += 2;
+    }
+
+    kout_write(digits, n);
+}
+
+// Same escapes as mpcf_escape
+static const char *kout_escape(char c)
+{
+    switch (c)
+    {
+    case '\a':
+        return "\\a";
+    case '\b':
+        return "\\b";
+    case '\f':
+        return "\\f";
+    case '\n':
+        return "\\n";
+    case '\r':
+        return "\\r";
+    case '\t':
+        return "\\t";
+    case '\v':
+        return "\\v";
+    case '\\':
+        return "\\\\";
+    case '\'':
+        return "\\'";
+    case '"':
+        return "\\\"";
+    default:
+        return NULL;
+    }
+}
+
+void kout_escaped(const char *s)
+{
+    kout_putc('"');
+
+    // Copy runs of plain characters in one go
+    const char *run = s;
+    for (; *s; s++)
+    {
+        const char *esc = kout_escape(*s);
+        if (esc)
+        {
+            kbuf_put(&out, run, s - run);
+            kbuf_put(&out, esc, 2);
+            run = s + 1;
+        }
+    }
+
+    kbuf_put(&out, run, s - run);
+    kout_putc('"');
+    kout_check();
+}
+
+void kout_newline(void)
+{
+    kbuf_putc(&out, '\n');
+
+    if (interactive)
+    {
+        kout_flush();
+    }
+    else
+    {
+        kout_check();
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef kout_h
+#define kout_h
+
+#include <stddef.h>
+
+/*
+    Buffered output for everything Kovacs prints.
+
+    Values are formatted straight into one growable buffer, which is
+    handed to stdout in large writes: at every newline when stdout is a
+    terminal, otherwise once it fills up, before the REPL prompt and at
+    exit.
+*/
+void kout_init(void);
+void kout_flush(void);
+
+void kout_putc(char c);
+void kout_write(const char *s, size_t len);
+void kout_puts(const char *s);
+void kout_long(long n);
+void kout_double(double d);
+
+// Write s as a double quoted string literal, escaped the way the reader expects
+void kout_escaped(const char *s);
+
+// End a line, flushing it straight away on a terminal
+void kout_newline(void);
+
+#endif
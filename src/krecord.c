@@ -0,0 +1,50 @@
+#include <stdlib.h>
+#include "krecord.h"
+#include "kval.h"
+
+krecord *krecord_new(kval *names)
+{
+    krecord *r = malloc(sizeof(krecord));
+
+    r->refs = 1;
+    r->names = names;
+
+    return r;
+}
+
+krecord *krecord_ref(krecord *r)
+{
+    r->refs++;
+    return r;
+}
+
+void krecord_unref(krecord *r)
+{
+    if (--r->refs > 0)
+    {
+        return;
+    }
+
+    kval_del(r->names);
+    free(r);
+}
+
+int krecord_eq(const krecord *x, const krecord *y)
+{
+    return x == y || kval_eq(x->names, y->names);
+}
+
+const char *krecord_name(const krecord *r)
+{
+    return r->names->cells[0]->sym;
+}
+
+int krecord_count(const krecord *r)
+{
+    return r->names->count - 1;
+}
+
+const char *krecord_field(const krecord *r, int i)
+{
+    return r->names->cells[i + 1]->sym;
+}
@@ -0,0 +1,36 @@
+#ifndef krecord_h
+#define krecord_h
+
+#include "types.h"
+
+/*
+    Record types.
+
+    A record is a fixed run of fields, kept in a record kval's cells like
+    the elements of a list, so it prints and compares like one. The type
+    is its name and field names, shared by every record of it and by its
+    constructor and accessors, which are functions that know their type
+    and which slot they read. Working out the slot happens once, when the
+    type is defined, and an access is then an index into the cells.
+*/
+struct krecord
+{
+    int refs;
+
+    // A Q-Expression of the name and then the fields, as symbols
+    kval *names;
+};
+
+// Takes names
+krecord *krecord_new(kval *names);
+krecord *krecord_ref(krecord *r);
+void krecord_unref(krecord *r);
+
+// Records from different definitions are the same type when they have the same names
+int krecord_eq(const krecord *x, const krecord *y);
+
+const char *krecord_name(const krecord *r);
+int krecord_count(const krecord *r);
+const char *krecord_field(const krecord *r, int i);
+
+#endif
@@ -0,0 +1,201 @@
+#include <stdlib.h>
+#include <string.h>
+#include "krope.h"
+
+// Neighbouring leaves are merged while they stay this small
+#define KROPE_LEAF 512
+
+// ###############
+//  Nodes        #
+// ###############
+krope *krope_leaf(const char *s, size_t len)
+{
+    krope *r = malloc(sizeof(krope) + len);
+
+    r->refs = 1;
+    r->height = 0;
+    r->len = len;
+    r->left = NULL;
+    r->right = NULL;
+    memcpy(r->data, s, len);
+
+    return r;
+}
+
+static krope *krope_node(krope *left, krope *right)
+{
+    krope *r = malloc(sizeof(krope));
+
+    r->refs = 1;
+    r->height = 1 + (left->height > right->height ? left->height : right->height);
+    r->len = left->len + right->len;
+    r->left = left;
+    r->right = right;
+
+    return r;
+}
+
+krope *krope_ref(krope *r)
+{
+    r->refs++;
+    return r;
+}
+
+void krope_unref(krope *r)
+{
+    while (r && --r->refs == 0)
+    {
+        krope *right = r->right;
+        if (r->left)
+        {
+            krope_unref(r->left);
+        }
+
+        free(r);
+        r = right;
+    }
+}
+
+// ###############
+//  Balancing    #
+// ###############
+
+// Rotations build new nodes, the old ones may be shared
+static krope *krope_rotate_left(krope *r)
+{
+    krope *x = r->right;
+    krope *inner = krope_node(krope_ref(r->left), krope_ref(x->left));
+    krope *top = krope_node(inner, krope_ref(x->right));
+
+    krope_unref(r);
+    return top;
+}
+
+static krope *krope_rotate_right(krope *r)
+{
+    krope *x = r->left;
+    krope *inner = krope_node(krope_ref(x->right), krope_ref(r->right));
+    krope *top = krope_node(krope_ref(x->left), inner);
+
+    krope_unref(r);
+    return top;
+}
+
+static krope *krope_balance(krope *r)
+{
+    int diff = r->left->height - r->right->height;
+
+    if (diff > 1)
+    {
+        if (r->left->left->height < r->left->right->height)
+        {
+            krope *left = krope_rotate_left(krope_ref(r->left));
+            krope *n = krope_node(left, krope_ref(r->right));
+            krope_unref(r);
+            r = n;
+        }
+
+        return krope_rotate_right(r);
+    }
+
+    if (diff < -1)
+    {
+        if (r->right->right->height < r->right->left->height)
+        {
+            krope *right = krope_rotate_right(krope_ref(r->right));
+            krope *n = krope_node(krope_ref(r->left), right);
+            krope_unref(r);
+            r = n;
+        }
+
+        return krope_rotate_left(r);
+    }
+
+    return r;
+}
+
+// ###############
+//  Concat       #
+// ###############
+krope *krope_concat(krope *a, krope *b)
+{
+    if (!a->len)
+    {
+        krope_unref(a);
+        return b;
+    }
+
+    if (!b->len)
+    {
+        krope_unref(b);
+        return a;
+    }
+
+    // Small neighbours become one leaf
+    if (!a->left && !b->left && a->len + b->len <= KROPE_LEAF)
+    {
+        krope *r = malloc(sizeof(krope) + a->len + b->len);
+
+        r->refs = 1;
+        r->height = 0;
+        r->len = a->len + b->len;
+        r->left = NULL;
+        r->right = NULL;
+        memcpy(r->data, a->data, a->len);
+        memcpy(r->data + a->len, b->data, b->len);
+
+        krope_unref(a);
+        krope_unref(b);
+        return r;
+    }
+
+    // Join down the spine of the taller tree, rebalancing on the way back up
+    if (a->height > b->height + 1 || (a->left && !b->left && a->right->len + b->len <= KROPE_LEAF))
+    {
+        krope *right = krope_concat(krope_ref(a->right), b);
+        krope *n = krope_node(krope_ref(a->left), right);
+        krope_unref(a);
+        return krope_balance(n);
+    }
+
+    if (b->height > a->height + 1)
+    {
+        krope *left = krope_concat(a, krope_ref(b->left));
+        krope *n = krope_node(left, krope_ref(b->right));
+        krope_unref(b);
+        return krope_balance(n);
+    }
+
+    return krope_node(a, b);
+}
+
+// ###############
+//  Reading      #
+// ###############
+void krope_copy(krope *r, size_t start, size_t len, char *out)
+{
+    while (len)
+    {
+        if (!r->left)
+        {
+            memcpy(out, r->data + start, len);
+            return;
+        }
+
+        if (start < r->left->len)
+        {
+            size_t n = r->left->len - start < len ? r->left->len - start : len;
+            krope_copy(r->left, start, n, out);
+
+            out += n;
+            len -= n;
+            start = 0;
+        }
+        else
+        {
+            start -= r->left->len;
+        }
+
+        r = r->right;
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef krope_h
+#define krope_h
+
+#include <stddef.h>
+#include "types.h"
+
+/*
+    Ropes for long strings.
+
+    A rope is an immutable, reference counted tree: leaves hold bytes
+    and inner nodes join two ropes. Trees are kept height balanced
+    (AVL), so concatenating is O(log n) and never copies the bytes
+    already there, and copies of a string just share the tree.
+*/
+struct krope
+{
+    int refs;
+    int height;
+    size_t len;
+
+    // Inner node when left is set, leaf otherwise
+    krope *left;
+    krope *right;
+    char data[];
+};
+
+// Strings up to this long are built flat instead of as ropes
+#define KSTR_FLAT_MAX 256
+
+krope *krope_leaf(const char *s, size_t len);
+
+// Takes over the references to a and b
+krope *krope_concat(krope *a, krope *b);
+
+krope *krope_ref(krope *r);
+void krope_unref(krope *r);
+
+// Copy len bytes starting at start into out
+void krope_copy(krope *r, size_t start, size_t len, char *out);
+
+#endif
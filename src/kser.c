@@ -0,0 +1,1188 @@
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "kser.h"
+#include "kval.h"
+#include "kenv.h"
+#include "kbig.h"
+#include "kvec.h"
+#include "kmat.h"
+#include "khash.h"
+#include "kmap.h"
+#include "ksorted.h"
+#include "kset.h"
+#include "krecord.h"
+
+#define KSER_MAGIC "KVS"
+#define KSER_VERSION 1
+#define KSER_HEADER 4
+
+// Extra tags, after the kval type tags
+#define KSER_SYM_REF 0x10
+#define KSER_STR_REF 0x11
+#define KSER_NUMS 0x12
+
+// Function kinds
+#define KSER_BUILTIN 0
+#define KSER_LAMBDA 1
+#define KSER_RECORD 2
+
+// Longer strings are never worth a table entry
+#define KSER_INTERN_MAX 64
+
+// Flush to the output file once this much is buffered
+#define KSER_FLUSH (1 << 20)
+
+typedef struct
+{
+    kbuf *b;
+    FILE *out;
+
+    // Symbols and short strings seen so far, when writing with a table
+    int table;
+    const char **names;
+    size_t *lens;
+    unsigned long count;
+    unsigned long *slots;
+    unsigned long nslots;
+
+    // Values made while writing, which the table may point into, see kser_enc_sorted_entry
+    kval *made;
+} kser_enc;
+
+typedef struct
+{
+    const char *cur;
+    const char *end;
+
+    // Table entries point straight into the input
+    int table;
+    const char **names;
+    size_t *lens;
+    unsigned long count;
+    unsigned long cap;
+
+    // Decoding cached source or an image, strings are literals and get interned
+    int literals;
+} kser_dec;
+
+// ###############
+//  Varints      #
+// ###############
+static void kser_put_varint(kbuf *b, unsigned long n)
+{
+    kbuf_reserve(b, 10);
+
+    while (n >= 0x80)
+    {
+        b->data[b->len++] = (char)(n | 0x80);
+        n >>= 7;
+    }
+
+    b->data[b->len++] = (char)n;
+}
+
+static unsigned long kser_get_varint(kser_dec *d, int *ok)
+{
+    unsigned long n = 0;
+    int shift = 0;
+
+    while (d->cur < d->end && shift < 64)
+    {
+        unsigned char c = *d->cur++;
+        n |= (unsigned long)(c & 0x7f) << shift;
+
+        if (!(c & 0x80))
+        {
+            return n;
+        }
+
+        shift += 7;
+    }
+
+    *ok = 0;
+    return 0;
+}
+
+static unsigned long zigzag(long n)
+{
+    return ((unsigned long)n << 1) ^ (unsigned long)(n >> 63);
+}
+
+static long unzigzag(unsigned long n)
+{
+    return (long)(n >> 1) ^ -(long)(n & 1);
+}
+
+// Fixed 8 bytes, little endian whatever the host
+static void kser_put_u64(kbuf *b, uint64_t n)
+{
+    char bytes[8];
+    for (int i = 0; i < 8; i++)
+    {
+        bytes[i] = (char)(n >> (i * 8));
+    }
+
+    kbuf_put(b, bytes, 8);
+}
+
+static uint64_t kser_get_u64(kser_dec *d)
+{
+    uint64_t n = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        n |= (uint64_t)(unsigned char)d->cur[i] << (i * 8);
+    }
+
+    d->cur += 8;
+    return n;
+}
+
+// A varint length followed by the bytes. NULL if it runs past the end
+static const char *kser_get_bytes(kser_dec *d, size_t *len)
+{
+    int ok = 1;
+    unsigned long n = kser_get_varint(d, &ok);
+    if (!ok || n > (unsigned long)(d->end - d->cur))
+    {
+        return NULL;
+    }
+
+    const char *s = d->cur;
+    d->cur += n;
+    *len = n;
+
+    return s;
+}
+
+// ###############
+//  Tables       #
+// ###############
+static unsigned long kser_hash(const char *s, size_t len)
+{
+    unsigned long h = 14695981039346656037UL;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211UL;
+    }
+
+    return h;
+}
+
+// Index of an earlier occurrence, or -1 after adding it to the table
+static long kser_enc_intern(kser_enc *s, const char *name, size_t len)
+{
+    if (s->count * 2 >= s->nslots)
+    {
+        unsigned long nslots = s->nslots ? s->nslots * 2 : 256;
+        unsigned long *slots = calloc(nslots, sizeof(unsigned long));
+
+        for (unsigned long i = 0; i < s->nslots; i++)
+        {
+            if (!s->slots[i])
+            {
+                continue;
+            }
+
+            unsigned long j = s->slots[i] - 1;
+            unsigned long h = kser_hash(s->names[j], s->lens[j]) & (nslots - 1);
+            while (slots[h])
+            {
+                h = (h + 1) & (nslots - 1);
+            }
+            slots[h] = s->slots[i];
+        }
+
+        free(s->slots);
+        s->slots = slots;
+        s->nslots = nslots;
+
+        s->names = realloc(s->names, sizeof(char *) * nslots / 2);
+        s->lens = realloc(s->lens, sizeof(size_t) * nslots / 2);
+    }
+
+    unsigned long h = kser_hash(name, len) & (s->nslots - 1);
+    while (s->slots[h])
+    {
+        unsigned long j = s->slots[h] - 1;
+        if (s->lens[j] == len && memcmp(s->names[j], name, len) == 0)
+        {
+            return j;
+        }
+
+        h = (h + 1) & (s->nslots - 1);
+    }
+
+    s->names[s->count] = name;
+    s->lens[s->count] = len;
+    s->slots[h] = ++s->count;
+
+    return -1;
+}
+
+static void kser_dec_intern(kser_dec *d, const char *name, size_t len)
+{
+    if (d->count == d->cap)
+    {
+        d->cap = d->cap ? d->cap * 2 : 256;
+        d->names = realloc(d->names, sizeof(char *) * d->cap);
+        d->lens = realloc(d->lens, sizeof(size_t) * d->cap);
+    }
+
+    d->names[d->count] = name;
+    d->lens[d->count] = len;
+    d->count++;
+}
+
+// ###############
+//  Encode       #
+// ###############
+static void kser_enc_value(kser_enc *s, kval *v);
+static void kser_enc_env(kser_enc *s, kenv *e);
+
+static void kser_enc_flush(kser_enc *s)
+{
+    if (s->out && s->b->len >= KSER_FLUSH)
+    {
+        fwrite(s->b->data, 1, s->b->len, s->out);
+        s->b->len = 0;
+    }
+}
+
+static void kser_enc_bytes(kser_enc *s, const char *str)
+{
+    size_t len = strlen(str);
+    kser_put_varint(s->b, len);
+    kbuf_put(s->b, str, len);
+}
+
+// Symbols and strings, replaced by a table reference when seen before
+static void kser_enc_name(kser_enc *s, int type, const char *str, size_t len)
+{
+    if (s->table && len <= KSER_INTERN_MAX)
+    {
+        long ref = kser_enc_intern(s, str, len);
+        if (ref >= 0)
+        {
+            kbuf_putc(s->b, type == KVAL_SYM ? KSER_SYM_REF : KSER_STR_REF);
+            kser_put_varint(s->b, ref);
+            return;
+        }
+    }
+
+    kbuf_putc(s->b, (char)type);
+    kser_put_varint(s->b, len);
+    kbuf_put(s->b, str, len);
+}
+
+static int kser_all_nums(kval *v)
+{
+    if (v->pack != KPACK_NONE)
+    {
+        return v->pack == KPACK_NUMS;
+    }
+
+    for (int i = 0; i < v->count; i++)
+    {
+        if (v->cells[i]->type != KVAL_NUM)
+        {
+            return 0;
+        }
+    }
+
+    return v->count > 0;
+}
+
+static int kser_enc_entry(kval *key, kval *val, void *s)
+{
+    kser_enc_value(s, key);
+    kser_enc_value(s, val);
+    kser_enc_flush(s);
+
+    return 0;
+}
+
+// The walk makes its keys and values, so anything with names in it is kept until the end
+static void kser_enc_made(kser_enc *s, kval *v)
+{
+    if (v->type == KVAL_NUM || v->type == KVAL_DBL)
+    {
+        kval_del(v);
+        return;
+    }
+
+    if (!s->made)
+    {
+        s->made = kval_qexpr();
+    }
+    kval_add(s->made, v);
+}
+
+static int kser_enc_elem(kval *x, void *s)
+{
+    kser_enc_value(s, x);
+    kser_enc_flush(s);
+
+    return 0;
+}
+
+static int kser_enc_sorted_entry(kval *key, kval *val, void *s)
+{
+    kser_enc_entry(key, val, s);
+    kser_enc_made(s, key);
+    kser_enc_made(s, val);
+
+    return 0;
+}
+
+static void kser_enc_value(kser_enc *s, kval *v)
+{
+    switch (v->type)
+    {
+    case KVAL_NUM:
+        kbuf_putc(s->b, KVAL_NUM);
+        kser_put_varint(s->b, zigzag(v->num));
+        break;
+
+    // Limb count and sign, then the limbs as varints
+    case KVAL_BIG:
+        kbuf_putc(s->b, KVAL_BIG);
+        kser_put_varint(s->b, ((unsigned long)v->big->len << 1) | v->big->negative);
+        for (int i = 0; i < v->big->len; i++)
+        {
+            kser_put_varint(s->b, v->big->limbs[i]);
+        }
+        break;
+
+    // The IEEE bits
+    case KVAL_DBL:
+    {
+        uint64_t bits;
+        memcpy(&bits, &v->dbl, sizeof(bits));
+
+        kbuf_putc(s->b, KVAL_DBL);
+        kser_put_u64(s->b, bits);
+        break;
+    }
+
+    // Kind and length, then the elements as they are in memory
+    case KVAL_VEC:
+        kbuf_putc(s->b, KVAL_VEC);
+        kbuf_putc(s->b, (char)v->vec->kind);
+        kser_put_varint(s->b, v->vec->len);
+        for (size_t i = 0; i < v->vec->len; i++)
+        {
+            kser_put_u64(s->b, (uint64_t)v->vec->i64[i]);
+        }
+        break;
+
+    // Rows and columns, then the elements a row at a time
+    case KVAL_MAT:
+    {
+        kbuf_putc(s->b, KVAL_MAT);
+        kser_put_varint(s->b, v->mat->rows);
+        kser_put_varint(s->b, v->mat->cols);
+
+        size_t n = v->mat->rows * v->mat->cols;
+        for (size_t i = 0; i < n; i++)
+        {
+            uint64_t bits;
+            memcpy(&bits, &v->mat->f64[i], sizeof(bits));
+            kser_put_u64(s->b, bits);
+        }
+        break;
+    }
+
+    case KVAL_SYM:
+        kser_enc_name(s, KVAL_SYM, v->sym, v->len);
+        break;
+
+    case KVAL_STR:
+        kser_enc_name(s, KVAL_STR, kval_str_flat(v), v->len);
+        break;
+
+    case KVAL_ERR:
+        kbuf_putc(s->b, KVAL_ERR);
+        kser_enc_bytes(s, kval_err_msg(v));
+        break;
+
+    case KVAL_SEXPR:
+    case KVAL_QEXPR:
+        // Lists of numbers are packed, without a tag per cell
+        if (s->table && v->type == KVAL_QEXPR && kser_all_nums(v))
+        {
+            kbuf_putc(s->b, KSER_NUMS);
+            kser_put_varint(s->b, v->count);
+            for (int i = 0; i < v->count; i++)
+            {
+                kser_put_varint(s->b, zigzag(v->pack == KPACK_NUMS ? v->nums[i] : v->cells[i]->num));
+                kser_enc_flush(s);
+            }
+            break;
+        }
+
+        kval_unpack(v);
+
+        kbuf_putc(s->b, (char)v->type);
+        kser_put_varint(s->b, v->count);
+        for (int i = 0; i < v->count; i++)
+        {
+            kser_enc_value(s, v->cells[i]);
+            kser_enc_flush(s);
+        }
+        break;
+
+    // Count, then keys and values in turn. A table reached twice is written twice, and comes back as two.
+    // None is ever inside itself, see builtin_hash_put.
+    case KVAL_TABLE:
+    {
+        khash *h = v->table;
+
+        kbuf_putc(s->b, KVAL_TABLE);
+        kser_put_varint(s->b, h->count);
+        for (size_t i = khash_next(h, 0); i < h->cap; i = khash_next(h, i + 1))
+        {
+            kser_enc_value(s, h->slots[i].key);
+            kser_enc_value(s, h->slots[i].val);
+            kser_enc_flush(s);
+        }
+        break;
+    }
+
+    // Like a table, the sharing between versions is lost
+    case KVAL_MAP:
+        kbuf_putc(s->b, KVAL_MAP);
+        kser_put_varint(s->b, v->map->count);
+        kmap_walk(v->map, kser_enc_entry, s);
+        break;
+
+    // In key order, which makes rebuilding it all appends
+    case KVAL_SORTED:
+        kbuf_putc(s->b, KVAL_SORTED);
+        kser_put_varint(s->b, v->sorted->count);
+        ksorted_range(v->sorted, NULL, NULL, kser_enc_sorted_entry, s);
+        break;
+
+    case KVAL_SET:
+        kbuf_putc(s->b, KVAL_SET);
+        kser_put_varint(s->b, v->set->count);
+        kset_walk(v->set, kser_enc_elem, s);
+        break;
+
+    // The names of the type, then the fields
+    case KVAL_RECORD:
+        kbuf_putc(s->b, KVAL_RECORD);
+        kser_enc_value(s, v->rec->names);
+        for (int i = 0; i < v->count; i++)
+        {
+            kser_enc_value(s, v->cells[i]);
+        }
+        break;
+
+    // Builtins by name, lambdas with their formals, body and bound arguments,
+    // record functions with the names of their type and their slot
+    case KVAL_FUN:
+        kbuf_putc(s->b, KVAL_FUN);
+        if (v->rec)
+        {
+            kbuf_putc(s->b, KSER_RECORD);
+            kser_enc_value(s, v->rec->names);
+            kser_put_varint(s->b, v->slot + 1);
+        }
+        else if (v->fun)
+        {
+            char *name = kenv_builtin_name(v->fun);
+            kbuf_putc(s->b, KSER_BUILTIN);
+            kser_enc_bytes(s, name ? name : "");
+        }
+        else
+        {
+            kbuf_putc(s->b, KSER_LAMBDA);
+            kser_enc_value(s, v->formals);
+            kser_enc_value(s, v->body);
+            kser_enc_env(s, v->fenv);
+        }
+        break;
+    }
+}
+
+// Only the bindings are saved, parents are linked again when a function is called
+static void kser_enc_env(kser_enc *s, kenv *e)
+{
+    kser_put_varint(s->b, e->count);
+
+    for (int i = 0; i < e->count; i++)
+    {
+        kser_enc_bytes(s, e->syms[i]);
+        kser_enc_value(s, e->vals[i]);
+    }
+}
+
+static void kser_enc_init(kser_enc *s, kbuf *b, FILE *out, int table)
+{
+    s->b = b;
+    s->out = out;
+    s->table = table;
+    s->names = NULL;
+    s->lens = NULL;
+    s->count = 0;
+    s->slots = NULL;
+    s->nslots = 0;
+    s->made = NULL;
+}
+
+static void kser_enc_free(kser_enc *s)
+{
+    free(s->names);
+    free(s->lens);
+    free(s->slots);
+
+    if (s->made)
+    {
+        kval_del(s->made);
+    }
+}
+
+void kser_encode(kbuf *b, kval *v)
+{
+    kser_enc s;
+    kser_enc_init(&s, b, NULL, 0);
+    kser_enc_value(&s, v);
+}
+
+void kser_encode_env(kbuf *b, kenv *e)
+{
+    kser_enc s;
+    kser_enc_init(&s, b, NULL, 0);
+    kser_enc_env(&s, e);
+}
+
+// ###############
+//  Decode       #
+// ###############
+static kval *kser_dec_value(kser_dec *d);
+static int kser_dec_env(kser_dec *d, kenv *e);
+
+static kval *kser_dec_str(kser_dec *d, const char *s, size_t len)
+{
+    return d->literals ? kval_str_lit(s, len) : kval_str_n(s, len);
+}
+
+// A record type from the list of its names
+static krecord *kser_dec_record(kser_dec *d)
+{
+    kval *names = kser_dec_value(d);
+    if (!names)
+    {
+        return NULL;
+    }
+
+    int ok = names->type == KVAL_QEXPR && names->count >= 2;
+    kval_unpack(names);
+    for (int i = 0; ok && i < names->count; i++)
+    {
+        ok = names->cells[i]->type == KVAL_SYM;
+    }
+
+    if (!ok)
+    {
+        kval_del(names);
+        return NULL;
+    }
+
+    return krecord_new(names);
+}
+
+static kval *kser_dec_value(kser_dec *d)
+{
+    if (d->cur >= d->end)
+    {
+        return NULL;
+    }
+
+    int type = (unsigned char)*d->cur++;
+    int ok = 1;
+    size_t len;
+    const char *s;
+
+    switch (type)
+    {
+    case KVAL_NUM:
+    {
+        unsigned long n = kser_get_varint(d, &ok);
+        return ok ? kval_num(unzigzag(n)) : NULL;
+    }
+
+    case KVAL_BIG:
+    {
+        unsigned long n = kser_get_varint(d, &ok);
+        if (!ok || (n >> 1) > (unsigned long)(d->end - d->cur))
+        {
+            return NULL;
+        }
+
+        kbig *b = kbig_alloc(n >> 1);
+        b->negative = n & 1;
+        for (int i = 0; i < b->len; i++)
+        {
+            unsigned long limb = kser_get_varint(d, &ok);
+            b->limbs[i] = (uint32_t)limb;
+            ok = ok && limb <= 0xffffffffu;
+        }
+
+        if (!ok)
+        {
+            kbig_unref(b);
+            return NULL;
+        }
+
+        return kval_big(kbig_norm(b));
+    }
+
+    case KVAL_DBL:
+    {
+        if (d->end - d->cur < 8)
+        {
+            return NULL;
+        }
+
+        uint64_t bits = kser_get_u64(d);
+
+        double dbl;
+        memcpy(&dbl, &bits, sizeof(dbl));
+        return kval_dbl(dbl);
+    }
+
+    case KVAL_VEC:
+    {
+        if (d->cur >= d->end)
+        {
+            return NULL;
+        }
+
+        int kind = (unsigned char)*d->cur++;
+        unsigned long n = kser_get_varint(d, &ok);
+        if (!ok || (kind != KVEC_I64 && kind != KVEC_F64) || n > (unsigned long)(d->end - d->cur) / 8)
+        {
+            return NULL;
+        }
+
+        kvec *v = kvec_alloc(kind, n);
+        for (size_t i = 0; i < n; i++)
+        {
+            v->i64[i] = (int64_t)kser_get_u64(d);
+        }
+
+        return kval_vec(v);
+    }
+
+    case KVAL_MAT:
+    {
+        unsigned long rows = kser_get_varint(d, &ok);
+        unsigned long cols = ok ? kser_get_varint(d, &ok) : 0;
+        unsigned long left = (unsigned long)(d->end - d->cur) / 8;
+        if (!ok || (cols && rows > left / cols))
+        {
+            return NULL;
+        }
+
+        kmat *m = kmat_alloc(rows, cols);
+        for (size_t i = 0; i < rows * cols; i++)
+        {
+            uint64_t bits = kser_get_u64(d);
+            memcpy(&m->f64[i], &bits, sizeof(bits));
+        }
+
+        return kval_mat(m);
+    }
+
+    case KVAL_SYM:
+    case KVAL_STR:
+        if (!(s = kser_get_bytes(d, &len)))
+        {
+            return NULL;
+        }
+
+        if (d->table && len <= KSER_INTERN_MAX)
+        {
+            kser_dec_intern(d, s, len);
+        }
+
+        return type == KVAL_SYM ? kval_sym_lit(s, len) : kser_dec_str(d, s, len);
+
+    case KSER_SYM_REF:
+    case KSER_STR_REF:
+    {
+        unsigned long ref = kser_get_varint(d, &ok);
+        if (!ok || !d->table || ref >= d->count)
+        {
+            return NULL;
+        }
+
+        return type == KSER_SYM_REF
+                   ? kval_sym_lit(d->names[ref], d->lens[ref])
+                   : kser_dec_str(d, d->names[ref], d->lens[ref]);
+    }
+
+    case KVAL_ERR:
+        if (!(s = kser_get_bytes(d, &len)))
+        {
+            return NULL;
+        }
+
+        return kval_err("%.*s", (int)len, s);
+
+    case KSER_NUMS:
+    {
+        unsigned long count = kser_get_varint(d, &ok);
+
+        // Every number takes at least a byte
+        if (!ok || count > (unsigned long)(d->end - d->cur))
+        {
+            return NULL;
+        }
+
+        kval *x = kval_qexpr();
+        if (count == 0)
+        {
+            return x;
+        }
+
+        x->pack = KPACK_NUMS;
+        x->nums = malloc(sizeof(long) * count);
+
+        for (unsigned long i = 0; i < count; i++)
+        {
+            unsigned long n = kser_get_varint(d, &ok);
+            if (!ok)
+            {
+                kval_del(x);
+                return NULL;
+            }
+
+            x->nums[x->count++] = unzigzag(n);
+        }
+
+        return x;
+    }
+
+    case KVAL_SEXPR:
+    case KVAL_QEXPR:
+    {
+        unsigned long count = kser_get_varint(d, &ok);
+
+        // Every cell takes at least two bytes
+        if (!ok || count > (unsigned long)(d->end - d->cur) / 2)
+        {
+            return NULL;
+        }
+
+        kval *x = type == KVAL_SEXPR ? kval_sexpr() : kval_qexpr();
+        x->cells = malloc(sizeof(kval *) * count);
+
+        for (unsigned long i = 0; i < count; i++)
+        {
+            kval *y = kser_dec_value(d);
+            if (!y)
+            {
+                kval_del(x);
+                return NULL;
+            }
+
+            x->cells[x->count++] = y;
+        }
+
+        return kval_pack(x);
+    }
+
+    case KVAL_TABLE:
+    {
+        unsigned long count = kser_get_varint(d, &ok);
+
+        // Every key and value takes at least two bytes
+        if (!ok || count > (unsigned long)(d->end - d->cur) / 4)
+        {
+            return NULL;
+        }
+
+        khash *h = khash_new();
+        for (unsigned long i = 0; i < count; i++)
+        {
+            kval *key = kser_dec_value(d);
+            kval *val = key ? kser_dec_value(d) : NULL;
+            if (!val || !khash_hashable(key))
+            {
+                if (key)
+                {
+                    kval_del(key);
+                }
+
+                if (val)
+                {
+                    kval_del(val);
+                }
+
+                khash_unref(h);
+                return NULL;
+            }
+
+            khash_put(h, key, val);
+        }
+
+        return kval_table(h);
+    }
+
+    case KVAL_MAP:
+    {
+        unsigned long count = kser_get_varint(d, &ok);
+        if (!ok || count > (unsigned long)(d->end - d->cur) / 4)
+        {
+            return NULL;
+        }
+
+        kmap *m = kmap_new();
+        for (unsigned long i = 0; i < count; i++)
+        {
+            kval *key = kser_dec_value(d);
+            kval *val = key ? kser_dec_value(d) : NULL;
+            if (!val || !khash_hashable(key))
+            {
+                if (key)
+                {
+                    kval_del(key);
+                }
+
+                if (val)
+                {
+                    kval_del(val);
+                }
+
+                kmap_unref(m);
+                return NULL;
+            }
+
+            m = kmap_assoc(m, key, val);
+        }
+
+        return kval_map(m);
+    }
+
+    case KVAL_SORTED:
+    {
+        unsigned long count = kser_get_varint(d, &ok);
+        if (!ok || count > (unsigned long)(d->end - d->cur) / 4)
+        {
+            return NULL;
+        }
+
+        ksorted *t = ksorted_new();
+        for (unsigned long i = 0; i < count; i++)
+        {
+            kval *key = kser_dec_value(d);
+            kval *val = key ? kser_dec_value(d) : NULL;
+            if (!val || !ksorted_keyable(key))
+            {
+                if (key)
+                {
+                    kval_del(key);
+                }
+
+                if (val)
+                {
+                    kval_del(val);
+                }
+
+                ksorted_unref(t);
+                return NULL;
+            }
+
+            t = ksorted_put(t, key, val);
+        }
+
+        return kval_sorted(t);
+    }
+
+    case KVAL_SET:
+    {
+        unsigned long count = kser_get_varint(d, &ok);
+        if (!ok || count > (unsigned long)(d->end - d->cur) / 2)
+        {
+            return NULL;
+        }
+
+        kset *s = kset_new();
+        for (unsigned long i = 0; i < count; i++)
+        {
+            kval *x = kser_dec_value(d);
+            if (!x || !khash_hashable(x))
+            {
+                if (x)
+                {
+                    kval_del(x);
+                }
+
+                kset_unref(s);
+                return NULL;
+            }
+
+            s = kset_add(s, x);
+        }
+
+        return kval_set(s);
+    }
+
+    case KVAL_RECORD:
+    {
+        krecord *r = kser_dec_record(d);
+        if (!r)
+        {
+            return NULL;
+        }
+
+        kval *x = kval_record(r);
+        x->cells = malloc(sizeof(kval *) * krecord_count(r));
+        while (x->count < krecord_count(r))
+        {
+            kval *v = kser_dec_value(d);
+            if (!v)
+            {
+                kval_del(x);
+                return NULL;
+            }
+
+            x->cells[x->count++] = v;
+        }
+
+        return x;
+    }
+
+    case KVAL_FUN:
+    {
+        if (d->cur >= d->end)
+        {
+            return NULL;
+        }
+
+        int kind = *d->cur++;
+        if (kind == KSER_RECORD)
+        {
+            krecord *r = kser_dec_record(d);
+            unsigned long slot = r ? kser_get_varint(d, &ok) : 0;
+            if (!r || !ok || slot > (unsigned long)krecord_count(r))
+            {
+                if (r)
+                {
+                    krecord_unref(r);
+                }
+                return NULL;
+            }
+
+            return kval_record_fun(r, (int)slot - 1);
+        }
+
+        if (kind == KSER_BUILTIN)
+        {
+            if (!(s = kser_get_bytes(d, &len)))
+            {
+                return NULL;
+            }
+
+            kbuiltin func = kenv_builtin_func(s, len);
+            return func ? kval_fun(func) : NULL;
+        }
+
+        kval *formals = kser_dec_value(d);
+        kval *body = formals ? kser_dec_value(d) : NULL;
+        if (!body)
+        {
+            if (formals)
+            {
+                kval_del(formals);
+            }
+            return NULL;
+        }
+
+        kval *x = kval_lambda(formals, body);
+        if (!kser_dec_env(d, x->fenv))
+        {
+            kval_del(x);
+            return NULL;
+        }
+
+        return x;
+    }
+    }
+
+    return NULL;
+}
+
+// Decode bindings into e, which is expected to be empty
+static int kser_dec_env(kser_dec *d, kenv *e)
+{
+    int ok = 1;
+    unsigned long count = kser_get_varint(d, &ok);
+    if (!ok || count > (unsigned long)(d->end - d->cur) / 3)
+    {
+        return 0;
+    }
+
+    for (unsigned long i = 0; i < count; i++)
+    {
+        size_t len;
+        const char *sym = kser_get_bytes(d, &len);
+        if (!sym)
+        {
+            return 0;
+        }
+
+        kval *v = kser_dec_value(d);
+        if (!v)
+        {
+            return 0;
+        }
+
+        kenv_push(e, sym, len, v);
+    }
+
+    return 1;
+}
+
+static void kser_dec_init(kser_dec *d, const char *p, const char *end, int table)
+{
+    d->cur = p;
+    d->end = end;
+    d->table = table;
+    d->literals = 0;
+    d->names = NULL;
+    d->lens = NULL;
+    d->count = 0;
+    d->cap = 0;
+}
+
+kval *kser_decode(const char **p, const char *end)
+{
+    kser_dec d;
+    kser_dec_init(&d, *p, end, 0);
+    d.literals = 1;
+
+    kval *x = kser_dec_value(&d);
+    *p = d.cur;
+
+    return x;
+}
+
+int kser_decode_env(const char **p, const char *end, kenv *e)
+{
+    kser_dec d;
+    kser_dec_init(&d, *p, end, 0);
+    d.literals = 1;
+
+    int ok = kser_dec_env(&d, e);
+    *p = d.cur;
+
+    return ok;
+}
+
+// ###############
+//  Files        #
+// ###############
+void kser_write(kbuf *b, kval *v)
+{
+    kbuf_put(b, KSER_MAGIC, 3);
+    kbuf_putc(b, KSER_VERSION);
+
+    kser_enc s;
+    kser_enc_init(&s, b, NULL, 1);
+    kser_enc_value(&s, v);
+    kser_enc_free(&s);
+}
+
+kval *kser_read(const char *data, size_t len)
+{
+    if (len < KSER_HEADER || memcmp(data, KSER_MAGIC, 3) != 0)
+    {
+        return kval_err("Not a serialized value");
+    }
+
+    if (data[3] != KSER_VERSION)
+    {
+        return kval_err("Unsupported serialization version %i", data[3]);
+    }
+
+    kser_dec d;
+    kser_dec_init(&d, data + KSER_HEADER, data + len, 1);
+
+    kval *x = kser_dec_value(&d);
+    if (x && d.cur != d.end)
+    {
+        kval_del(x);
+        x = NULL;
+    }
+
+    free(d.names);
+    free(d.lens);
+
+    return x ? x : kval_err("Serialized value is corrupt");
+}
+
+int kser_save(const char *path, kval *v)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f)
+    {
+        return 0;
+    }
+
+    kbuf b;
+    kbuf_init(&b);
+    kbuf_put(&b, KSER_MAGIC, 3);
+    kbuf_putc(&b, KSER_VERSION);
+
+    // Stream to the file as we go, big values are never held twice
+    kser_enc s;
+    kser_enc_init(&s, &b, f, 1);
+    kser_enc_value(&s, v);
+    kser_enc_free(&s);
+
+    int ok = fwrite(b.data, 1, b.len, f) == b.len;
+    ok = fclose(f) == 0 && ok;
+
+    kbuf_free(&b);
+    return ok;
+}
+
+kval *kser_load(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return kval_err("Could not open %s", path);
+    }
+
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+
+    if (map == MAP_FAILED)
+    {
+        return kval_err("Could not read %s", path);
+    }
+
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    kval *x = kser_read(map, st.st_size);
+    munmap(map, st.st_size);
+
+    return x;
+}
@@ -0,0 +1,37 @@
+#ifndef kser_h
+#define kser_h
+
+#include <stddef.h>
+#include "kbuf.h"
+#include "types.h"
+
+/*
+    Compact binary encoding of kvals.
+
+    Every value is a type tag byte followed by its payload. Numbers are
+    zigzag varints (big ones a sign and their 32 bit limbs), strings/symbols/errors are a varint length and the
+    bytes, and expressions are a varint count followed by their cells.
+    Builtins are stored by name and lambdas with their bound arguments,
+    so encoded values do not depend on where the binary was loaded.
+
+    kser_encode/kser_decode are the bare encoding, used by the parse
+    cache and images, and intern strings the way the reader does.
+    kser_write/kser_save add a versioned header, a
+    table so repeated symbols and short strings are written once, and
+    packed lists of numbers. That is the format of `serialize`.
+*/
+void kser_encode(kbuf *b, kval *v);
+void kser_encode_env(kbuf *b, kenv *e);
+
+// Decode one value and advance *p past it. NULL if the bytes are malformed
+kval *kser_decode(const char **p, const char *end);
+int kser_decode_env(const char **p, const char *end, kenv *e);
+
+void kser_write(kbuf *b, kval *v);
+int kser_save(const char *path, kval *v);
+
+// These return an Error if the data is not a value written by kser_write
+kval *kser_read(const char *data, size_t len);
+kval *kser_load(const char *path);
+
+#endif
@@ -0,0 +1,543 @@
+#include <stdlib.h>
+#include <string.h>
+#include "kset.h"
+#include "khash.h"
+#include "kval.h"
+
+// Words a bitmap may have past one per element, so small sets of small numbers stay bitmaps
+#define KSET_SLACK 64
+
+kset *kset_new(void)
+{
+    kset *s = malloc(sizeof(kset));
+
+    s->refs = 1;
+    s->count = 0;
+    s->dense = 1;
+    s->bits = NULL;
+    s->nwords = 0;
+    s->cap = 0;
+    s->slots = NULL;
+
+    return s;
+}
+
+kset *kset_ref(kset *s)
+{
+    s->refs++;
+    return s;
+}
+
+void kset_unref(kset *s)
+{
+    if (--s->refs > 0)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < s->cap; i++)
+    {
+        if (s->slots[i].type != KSET_EMPTY && s->slots[i].type != KVAL_NUM)
+        {
+            kval_del(s->slots[i].as.val);
+        }
+    }
+
+    free(s->bits);
+    free(s->slots);
+    free(s);
+}
+
+// s, or a copy of it if anything else holds it
+static kset *kset_own(kset *s)
+{
+    if (s->refs == 1)
+    {
+        return s;
+    }
+
+    kset *c = kset_new();
+    c->count = s->count;
+    c->dense = s->dense;
+
+    if (s->nwords)
+    {
+        c->nwords = s->nwords;
+        c->bits = malloc(sizeof(uint64_t) * s->nwords);
+        memcpy(c->bits, s->bits, sizeof(uint64_t) * s->nwords);
+    }
+
+    if (s->cap)
+    {
+        c->cap = s->cap;
+        c->slots = malloc(sizeof(kset_slot) * s->cap);
+        memcpy(c->slots, s->slots, sizeof(kset_slot) * s->cap);
+
+        for (size_t i = 0; i < c->cap; i++)
+        {
+            if (c->slots[i].type != KSET_EMPTY && c->slots[i].type != KVAL_NUM)
+            {
+                c->slots[i].as.val = kval_copy(c->slots[i].as.val);
+            }
+        }
+    }
+
+    s->refs--;
+    return c;
+}
+
+// ###############
+//  Bitmaps      #
+// ###############
+static int kset_fits(const kset *s, long n)
+{
+    return n >= 0 && (unsigned long)n / 64 < s->count + KSET_SLACK;
+}
+
+static size_t kset_popcount(const uint64_t *bits, size_t nwords)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < nwords; i++)
+    {
+        count += __builtin_popcountll(bits[i]);
+    }
+
+    return count;
+}
+
+// At least nwords, zeroed past the old ones
+static void kset_grow_bits(kset *s, size_t nwords)
+{
+    if (nwords <= s->nwords)
+    {
+        return;
+    }
+
+    if (nwords < s->nwords * 2)
+    {
+        nwords = s->nwords * 2;
+    }
+
+    s->bits = realloc(s->bits, sizeof(uint64_t) * nwords);
+    memset(s->bits + s->nwords, 0, sizeof(uint64_t) * (nwords - s->nwords));
+    s->nwords = nwords;
+}
+
+// ###############
+//  Tables       #
+// ###############
+
+// The slot holding e's element, or the empty one it would go in
+static size_t kset_find(const kset *s, const kset_slot *e)
+{
+    size_t mask = s->cap - 1;
+
+    for (size_t i = e->hash & mask;; i = (i + 1) & mask)
+    {
+        const kset_slot *x = s->slots + i;
+        if (x->type == KSET_EMPTY)
+        {
+            return i;
+        }
+
+        if (x->hash != e->hash)
+        {
+            continue;
+        }
+
+        if (e->type == KVAL_NUM ? x->type == KVAL_NUM && x->as.num == e->as.num
+                                : x->type != KVAL_NUM && kval_eq(x->as.val, e->as.val))
+        {
+            return i;
+        }
+    }
+}
+
+// Room for count elements at no more than three quarters full
+static void kset_reserve(kset *s, size_t count)
+{
+    if (count * 4 <= s->cap * 3)
+    {
+        return;
+    }
+
+    size_t cap = s->cap ? s->cap : 16;
+    while (count * 4 > cap * 3)
+    {
+        cap *= 2;
+    }
+
+    kset_slot *old = s->slots;
+    size_t ocap = s->cap;
+
+    s->cap = cap;
+    s->slots = malloc(sizeof(kset_slot) * cap);
+    for (size_t i = 0; i < cap; i++)
+    {
+        s->slots[i].type = KSET_EMPTY;
+    }
+
+    for (size_t i = 0; i < ocap; i++)
+    {
+        if (old[i].type != KSET_EMPTY)
+        {
+            s->slots[kset_find(s, old + i)] = old[i];
+        }
+    }
+
+    free(old);
+}
+
+// 1 if e's element wasn't there and now is
+static int kset_put(kset *s, const kset_slot *e)
+{
+    kset_reserve(s, s->count + 1);
+
+    size_t i = kset_find(s, e);
+    if (s->slots[i].type != KSET_EMPTY)
+    {
+        return 0;
+    }
+
+    s->slots[i] = *e;
+    s->count++;
+    return 1;
+}
+
+static void kset_put_num(kset *s, long n)
+{
+    kset_slot e;
+    e.hash = khash_num(n);
+    e.type = KVAL_NUM;
+    e.as.num = n;
+
+    kset_put(s, &e);
+}
+
+// From a bitmap to a table
+static void kset_spill(kset *s)
+{
+    uint64_t *bits = s->bits;
+    size_t nwords = s->nwords;
+
+    // A table always has slots, even an empty one
+    kset_reserve(s, s->count + 1);
+    s->dense = 0;
+    s->bits = NULL;
+    s->nwords = 0;
+    s->count = 0;
+
+    for (size_t w = 0; w < nwords; w++)
+    {
+        for (uint64_t b = bits[w]; b; b &= b - 1)
+        {
+            kset_put_num(s, (long)(w * 64 + __builtin_ctzll(b)));
+        }
+    }
+
+    free(bits);
+}
+
+// ###############
+//  Access       #
+// ###############
+kset *kset_from_nums(const long *nums, size_t n)
+{
+    kset *s = kset_new();
+    if (n == 0)
+    {
+        return s;
+    }
+
+    long lo = nums[0];
+    long hi = nums[0];
+    for (size_t i = 1; i < n; i++)
+    {
+        lo = nums[i] < lo ? nums[i] : lo;
+        hi = nums[i] > hi ? nums[i] : hi;
+    }
+
+    if (lo >= 0 && (unsigned long)hi / 64 < n + KSET_SLACK)
+    {
+        s->nwords = (size_t)hi / 64 + 1;
+        s->bits = calloc(s->nwords, sizeof(uint64_t));
+
+        for (size_t i = 0; i < n; i++)
+        {
+            s->bits[nums[i] / 64] |= (uint64_t)1 << (nums[i] % 64);
+        }
+
+        s->count = kset_popcount(s->bits, s->nwords);
+        return s;
+    }
+
+    kset_spill(s);
+    kset_reserve(s, n);
+    for (size_t i = 0; i < n; i++)
+    {
+        kset_put_num(s, nums[i]);
+    }
+
+    return s;
+}
+
+kset *kset_add_num(kset *s, long n)
+{
+    s = kset_own(s);
+
+    if (s->dense)
+    {
+        if (kset_fits(s, n))
+        {
+            kset_grow_bits(s, (size_t)n / 64 + 1);
+
+            uint64_t bit = (uint64_t)1 << (n % 64);
+            s->count += !(s->bits[n / 64] & bit);
+            s->bits[n / 64] |= bit;
+            return s;
+        }
+
+        kset_spill(s);
+    }
+
+    kset_put_num(s, n);
+    return s;
+}
+
+kset *kset_add(kset *s, kval *key)
+{
+    if (key->type == KVAL_NUM)
+    {
+        long n = key->num;
+        kval_del(key);
+        return kset_add_num(s, n);
+    }
+
+    s = kset_own(s);
+    if (s->dense)
+    {
+        kset_spill(s);
+    }
+
+    kset_slot e;
+    e.hash = khash_key(key);
+    e.type = key->type;
+    e.as.val = key;
+
+    if (!kset_put(s, &e))
+    {
+        kval_del(key);
+    }
+
+    return s;
+}
+
+int kset_has_num(const kset *s, long n)
+{
+    if (s->dense)
+    {
+        return n >= 0 && (size_t)n / 64 < s->nwords && (s->bits[n / 64] >> (n % 64) & 1);
+    }
+
+    kset_slot e;
+    e.hash = khash_num(n);
+    e.type = KVAL_NUM;
+    e.as.num = n;
+
+    return s->slots[kset_find(s, &e)].type != KSET_EMPTY;
+}
+
+int kset_has(const kset *s, kval *key)
+{
+    if (key->type == KVAL_NUM)
+    {
+        return kset_has_num(s, key->num);
+    }
+
+    if (s->dense)
+    {
+        return 0;
+    }
+
+    kset_slot e;
+    e.hash = khash_key(key);
+    e.type = key->type;
+    e.as.val = key;
+
+    return s->slots[kset_find(s, &e)].type != KSET_EMPTY;
+}
+
+int kset_walk(const kset *s, int (*f)(kval *key, void *ctx), void *ctx)
+{
+    // Numbers are lent through one kval, rewritten for each
+    kval *x = kval_num(0);
+    int r = 0;
+
+    if (s->dense)
+    {
+        for (size_t w = 0; w < s->nwords && !r; w++)
+        {
+            for (uint64_t b = s->bits[w]; b && !r; b &= b - 1)
+            {
+                x->num = (long)(w * 64 + __builtin_ctzll(b));
+                r = f(x, ctx);
+            }
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < s->cap && !r; i++)
+        {
+            const kset_slot *e = s->slots + i;
+            if (e->type == KVAL_NUM)
+            {
+                x->num = e->as.num;
+                r = f(x, ctx);
+            }
+            else if (e->type != KSET_EMPTY)
+            {
+                r = f(e->as.val, ctx);
+            }
+        }
+    }
+
+    kval_del(x);
+    return r;
+}
+
+// ###############
+//  Algebra      #
+// ###############
+static int kset_add_each(kval *key, void *ctx)
+{
+    kset **s = ctx;
+    *s = key->type == KVAL_NUM ? kset_add_num(*s, key->num) : kset_add(*s, kval_copy(key));
+
+    return 0;
+}
+
+typedef struct
+{
+    kset *r;
+    const kset *other;
+
+    // Whether to keep the elements in other, or the ones not in it
+    int in;
+} kset_filter;
+
+static int kset_filter_each(kval *key, void *ctx)
+{
+    kset_filter *c = ctx;
+    if (kset_has(c->other, key) == c->in)
+    {
+        kset_add_each(key, &c->r);
+    }
+
+    return 0;
+}
+
+/*
+    A table walked in slot order gives its elements sorted by the low bits
+    of their hash, and putting those into a smaller table piles them all
+    into one run of slots. So a table made from another one's elements is
+    sized for all of them before it starts.
+*/
+static void kset_presize(kset *s, size_t count)
+{
+    if (s->dense)
+    {
+        kset_spill(s);
+    }
+
+    kset_reserve(s, count);
+}
+
+kset *kset_union(kset *x, const kset *y)
+{
+    if (!(x->dense && y->dense))
+    {
+        x = kset_own(x);
+        kset_presize(x, x->count + y->count);
+        kset_walk(y, kset_add_each, &x);
+        return x;
+    }
+
+    x = kset_own(x);
+    kset_grow_bits(x, y->nwords);
+
+    for (size_t i = 0; i < y->nwords; i++)
+    {
+        x->bits[i] |= y->bits[i];
+    }
+
+    x->count = kset_popcount(x->bits, x->nwords);
+    return x;
+}
+
+kset *kset_intersection(const kset *x, const kset *y)
+{
+    if (!(x->dense && y->dense))
+    {
+        // Probing the bigger one for each of the smaller
+        const kset *small = x->count < y->count ? x : y;
+        kset_filter c = {kset_new(), small == x ? y : x, 1};
+
+        if (!small->dense)
+        {
+            kset_presize(c.r, small->count);
+        }
+
+        kset_walk(small, kset_filter_each, &c);
+        return c.r;
+    }
+
+    kset *r = kset_new();
+    r->nwords = x->nwords < y->nwords ? x->nwords : y->nwords;
+    r->bits = malloc(sizeof(uint64_t) * (r->nwords ? r->nwords : 1));
+
+    for (size_t i = 0; i < r->nwords; i++)
+    {
+        r->bits[i] = x->bits[i] & y->bits[i];
+    }
+
+    r->count = kset_popcount(r->bits, r->nwords);
+    return r;
+}
+
+kset *kset_difference(const kset *x, const kset *y)
+{
+    if (!(x->dense && y->dense))
+    {
+        kset_filter c = {kset_new(), y, 0};
+
+        if (!x->dense)
+        {
+            kset_presize(c.r, x->count);
+        }
+
+        kset_walk(x, kset_filter_each, &c);
+        return c.r;
+    }
+
+    kset *r = kset_new();
+    r->nwords = x->nwords;
+    r->bits = malloc(sizeof(uint64_t) * (r->nwords ? r->nwords : 1));
+
+    for (size_t i = 0; i < r->nwords; i++)
+    {
+        r->bits[i] = i < y->nwords ? x->bits[i] & ~y->bits[i] : x->bits[i];
+    }
+
+    r->count = kset_popcount(r->bits, r->nwords);
+    return r;
+}
+
+static int kset_missing(kval *key, void *other)
+{
+    return !kset_has(other, key);
+}
+
+int kset_eq(const kset *x, const kset *y)
+{
+    return x == y || (x->count == y->count && !kset_walk(x, kset_missing, (void *)y));
+}
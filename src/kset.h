@@ -0,0 +1,78 @@
+#ifndef kset_h
+#define kset_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "types.h"
+
+/*
+    Sets.
+
+    Two layouts. While every element is a non negative integer, and
+    there are enough of them that a bit for each number up to the
+    largest costs no more than a word per element, the set is a bitmap,
+    and union, intersection and difference are loops of word ors, ands
+    and and-nots. Anything else turns it into a hash table, open
+    addressing with linear probing, where numbers are kept unboxed and
+    anything else hashes and compares as a hash table key.
+
+    Like vectors, sets are immutable values, but an add writes into a
+    set nothing else holds.
+*/
+#define KSET_EMPTY -1
+
+typedef struct
+{
+    unsigned long hash;
+
+    // KSET_EMPTY for a free slot
+    int type;
+
+    union
+    {
+        long num;
+        kval *val;
+    } as;
+} kset_slot;
+
+struct kset
+{
+    int refs;
+    size_t count;
+
+    // Bit n of the words for each n
+    int dense;
+    uint64_t *bits;
+    size_t nwords;
+
+    // Otherwise a power of two of slots
+    size_t cap;
+    kset_slot *slots;
+};
+
+kset *kset_new(void);
+kset *kset_ref(kset *s);
+void kset_unref(kset *s);
+
+// From a run of integers, sized for them up front
+kset *kset_from_nums(const long *nums, size_t n);
+
+// s with key in it. Both are taken.
+kset *kset_add(kset *s, kval *key);
+kset *kset_add_num(kset *s, long n);
+
+int kset_has(const kset *s, kval *key);
+int kset_has_num(const kset *s, long n);
+
+// Union takes x, the others make a new set
+kset *kset_union(kset *x, const kset *y);
+kset *kset_intersection(const kset *x, const kset *y);
+kset *kset_difference(const kset *x, const kset *y);
+
+int kset_eq(const kset *x, const kset *y);
+
+// Calls f on each element, in increasing order for a bitmap, until it
+// returns non zero, which is returned. f is only lent the element.
+int kset_walk(const kset *s, int (*f)(kval *key, void *ctx), void *ctx);
+
+#endif
@@ -0,0 +1,281 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ksort.h"
+
+// Runs sorted by insertion before merging starts, and below which integers skip the radix sort
+#define KSORT_RUN 16
+
+// Bits of an integer each radix pass sorts by
+#define KSORT_BITS 11
+#define KSORT_RADIX (1 << KSORT_BITS)
+
+// Integers that fit in cache, with the buffer the radix sort moves them between
+#define KSORT_CACHE (1 << 15)
+
+/*
+    A stable merge sort of the n elements of type T at x, with tmp holding
+    as many. LESS(a, b) says whether a must go before b. Each merge only
+    takes from the right run when it is strictly less, which keeps equal
+    elements in order.
+*/
+#define KSORT_MERGE(T, x, tmp, n, LESS)                                        \
+    do                                                                         \
+    {                                                                          \
+        for (size_t lo = 0; lo < n; lo += KSORT_RUN)                           \
+        {                                                                      \
+            size_t hi = lo + KSORT_RUN < n ? lo + KSORT_RUN : n;               \
+            for (size_t i = lo + 1; i < hi; i++)                               \
+            {                                                                  \
+                T v = x[i];                                                    \
+                size_t j = i;                                                  \
+                for (; j > lo && LESS(v, x[j - 1]); j--)                       \
+                {                                                              \
+                    x[j] = x[j - 1];                                           \
+                }                                                              \
+                x[j] = v;                                                      \
+            }                                                                  \
+        }                                                                      \
+                                                                               \
+        T *src = x;                                                            \
+        T *dst = tmp;                                                          \
+        for (size_t w = KSORT_RUN; w < n; w *= 2)                              \
+        {                                                                      \
+            for (size_t lo = 0; lo < n; lo += 2 * w)                           \
+            {                                                                  \
+                size_t mid = lo + w < n ? lo + w : n;                          \
+                size_t hi = lo + 2 * w < n ? lo + 2 * w : n;                   \
+                size_t i = lo, j = mid, k = lo;                                \
+                                                                               \
+                /* Runs already in order are copied across whole */            \
+                if (mid < hi && LESS(src[mid], src[mid - 1]))                  \
+                {                                                              \
+                    while (i < mid && j < hi)                                  \
+                    {                                                          \
+                        dst[k++] = LESS(src[j], src[i]) ? src[j++] : src[i++]; \
+                    }                                                          \
+                }                                                              \
+                memcpy(dst + k, src + i, sizeof(T) * (mid - i));               \
+                k += mid - i;                                                  \
+                memcpy(dst + k, src + j, sizeof(T) * (hi - j));                \
+            }                                                                  \
+                                                                               \
+            T *t = src;                                                        \
+            src = dst;                                                         \
+            dst = t;                                                           \
+        }                                                                      \
+                                                                               \
+        if (src != x)                                                          \
+        {                                                                      \
+            memcpy(x, src, sizeof(T) * n);                                     \
+        }                                                                      \
+    } while (0)
+
+// ###############
+//  Integers     #
+// ###############
+
+static void ksort_nums_insert(long *x, size_t n)
+{
+    for (size_t i = 1; i < n; i++)
+    {
+        long v = x[i];
+        size_t j = i;
+        for (; j > 0 && v < x[j - 1]; j--)
+        {
+            x[j] = x[j - 1];
+        }
+        x[j] = v;
+    }
+}
+
+// Offsets of each digit's run, from counts of them
+static void ksort_nums_offsets(size_t *counts)
+{
+    size_t total = 0;
+    for (int b = 0; b < KSORT_RADIX; b++)
+    {
+        size_t c = counts[b];
+        counts[b] = total;
+        total += c;
+    }
+}
+
+/*
+    Sorts x using tmp for as many, as offsets from the smallest element,
+    so only the digits the spread between the smallest and largest needs
+    take a pass. Past KSORT_CACHE elements the passes would scatter all
+    over memory, so the top digit goes first instead, and each of its
+    runs, small enough to stay in cache, is sorted the same way.
+*/
+static void ksort_nums_radix(long *x, size_t n, long *tmp)
+{
+    if (n < KSORT_RUN)
+    {
+        ksort_nums_insert(x, n);
+        return;
+    }
+
+    long lo = x[0];
+    long hi = x[0];
+    int sorted = 1;
+
+    for (size_t i = 1; i < n; i++)
+    {
+        lo = x[i] < lo ? x[i] : lo;
+        hi = x[i] > hi ? x[i] : hi;
+        sorted &= x[i - 1] <= x[i];
+    }
+
+    if (sorted)
+    {
+        return;
+    }
+
+    uint64_t spread = (uint64_t)hi - (uint64_t)lo;
+    int bits = 64 - __builtin_clzl(spread);
+
+    // Few enough values to count each one, and equal integers can't be told apart
+    if (bits <= KSORT_BITS)
+    {
+        size_t counts[KSORT_RADIX] = {0};
+        for (size_t i = 0; i < n; i++)
+        {
+            counts[(uint64_t)x[i] - (uint64_t)lo]++;
+        }
+
+        for (size_t b = 0, k = 0; b <= spread; b++)
+        {
+            for (size_t c = counts[b]; c > 0; c--)
+            {
+                x[k++] = (long)((uint64_t)lo + b);
+            }
+        }
+
+        return;
+    }
+
+    if (n > KSORT_CACHE)
+    {
+        int shift = bits - KSORT_BITS;
+        size_t counts[KSORT_RADIX] = {0};
+        size_t at[KSORT_RADIX];
+
+        for (size_t i = 0; i < n; i++)
+        {
+            counts[((uint64_t)x[i] - (uint64_t)lo) >> shift]++;
+        }
+
+        memcpy(at, counts, sizeof(at));
+        ksort_nums_offsets(at);
+
+        for (size_t i = 0; i < n; i++)
+        {
+            tmp[at[((uint64_t)x[i] - (uint64_t)lo) >> shift]++] = x[i];
+        }
+
+        // Each run sorted where it landed, with its place in x as room
+        for (size_t b = 0, start = 0; b < KSORT_RADIX; start += counts[b++])
+        {
+            ksort_nums_radix(tmp + start, counts[b], x + start);
+        }
+
+        memcpy(x, tmp, sizeof(long) * n);
+        return;
+    }
+
+    // Counts of every digit, all in one pass
+    int passes = (bits + KSORT_BITS - 1) / KSORT_BITS;
+    size_t (*counts)[KSORT_RADIX] = calloc(passes, sizeof(*counts));
+
+    for (size_t i = 0; i < n; i++)
+    {
+        uint64_t u = (uint64_t)x[i] - (uint64_t)lo;
+        for (int d = 0; d < passes; d++)
+        {
+            counts[d][(u >> (d * KSORT_BITS)) & (KSORT_RADIX - 1)]++;
+        }
+    }
+
+    long *src = x;
+    long *dst = tmp;
+
+    for (int d = 0; d < passes; d++)
+    {
+        int shift = d * KSORT_BITS;
+        size_t *at = counts[d];
+        ksort_nums_offsets(at);
+
+        for (size_t i = 0; i < n; i++)
+        {
+            uint64_t u = (uint64_t)src[i] - (uint64_t)lo;
+            dst[at[(u >> shift) & (KSORT_RADIX - 1)]++] = src[i];
+        }
+
+        long *t = src;
+        src = dst;
+        dst = t;
+    }
+
+    if (src != x)
+    {
+        memcpy(x, src, sizeof(long) * n);
+    }
+
+    free(counts);
+}
+
+void ksort_nums(long *nums, size_t n)
+{
+    if (n < KSORT_RUN)
+    {
+        ksort_nums_insert(nums, n);
+        return;
+    }
+
+    long *tmp = malloc(sizeof(long) * n);
+    ksort_nums_radix(nums, n, tmp);
+    free(tmp);
+}
+
+// ###############
+//  Strings      #
+// ###############
+
+// Equal interned strings are the same pointer, which settles most ties without reading them
+static inline int ksort_str_less(kstr_ref x, kstr_ref y)
+{
+    if (x.str == y.str)
+    {
+        return 0;
+    }
+
+    size_t len = x.len < y.len ? x.len : y.len;
+    int c = memcmp(x.str, y.str, len);
+
+    return c < 0 || (c == 0 && x.len < y.len);
+}
+
+void ksort_strs(kstr_ref *strs, size_t n)
+{
+    kstr_ref *tmp = malloc(sizeof(kstr_ref) * n);
+
+    KSORT_MERGE(kstr_ref, strs, tmp, n, ksort_str_less);
+
+    free(tmp);
+}
+
+// ###############
+//  Values       #
+// ###############
+
+void ksort_vals(kval **vals, size_t n, int (*less)(kval *x, kval *y, void *ctx), void *ctx)
+{
+    kval **tmp = malloc(sizeof(kval *) * n);
+
+#define KSORT_VAL_LESS(x, y) less(x, y, ctx)
+    KSORT_MERGE(kval *, vals, tmp, n, KSORT_VAL_LESS);
+#undef KSORT_VAL_LESS
+
+    free(tmp);
+}
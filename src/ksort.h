@@ -0,0 +1,27 @@
+#ifndef ksort_h
+#define ksort_h
+
+#include <stddef.h>
+#include "types.h"
+
+/*
+    Sorting.
+
+    Integers get a radix sort on their offsets from the smallest, so a
+    list spanning a small range takes one counting pass and a wide one
+    takes a pass per eleven bits of it, and no comparisons at all. A big
+    list is split on its top digit first, so the passes over each part
+    stay in cache. Everything else is a stable merge sort: runs of a few
+    elements by insertion, then merged bottom up between the array and a
+    buffer as long as it, skipping merges of runs already in order.
+*/
+
+void ksort_nums(long *nums, size_t n);
+
+// By their bytes, shorter first when one is the start of the other
+void ksort_strs(kstr_ref *strs, size_t n);
+
+// By less, which says whether x must go before y. Equal elements keep their order.
+void ksort_vals(kval **vals, size_t n, int (*less)(kval *x, kval *y, void *ctx), void *ctx);
+
+#endif
@@ -0,0 +1,764 @@
+#include <stdlib.h>
+#include <string.h>
+#include "ksorted.h"
+#include "kval.h"
+
+// Where a full node splits, unless the new key goes past its end, as keys
+// in increasing order do. Then the node stays full and the key starts a new one.
+#define KSORTED_HALF (KSORTED_ORDER / 2)
+
+ksorted *ksorted_new(void)
+{
+    ksorted *t = malloc(sizeof(ksorted));
+
+    t->refs = 1;
+    t->count = 0;
+    t->root = NULL;
+
+    return t;
+}
+
+ksorted *ksorted_ref(ksorted *t)
+{
+    t->refs++;
+    return t;
+}
+
+static void ksorted_node_unref(ksorted_node *n)
+{
+    if (--n->refs > 0)
+    {
+        return;
+    }
+
+    for (int i = 0; i < n->count; i++)
+    {
+        if (n->ktype[i] == KVAL_STR)
+        {
+            free(n->keys[i].str);
+        }
+
+        if (!n->leaf)
+        {
+            ksorted_node_unref(n->u.kids[i]);
+        }
+        else if (n->vtype[i] != KVAL_NUM && n->vtype[i] != KVAL_DBL)
+        {
+            kval_del(n->u.vals[i].val);
+        }
+    }
+
+    free(n);
+}
+
+void ksorted_unref(ksorted *t)
+{
+    if (--t->refs > 0)
+    {
+        return;
+    }
+
+    if (t->root)
+    {
+        ksorted_node_unref(t->root);
+    }
+
+    free(t);
+}
+
+// ###############
+//  Keys         #
+// ###############
+int ksorted_keyable(kval *key)
+{
+    switch (key->type)
+    {
+    case KVAL_NUM:
+    case KVAL_STR:
+        return 1;
+    case KVAL_DBL:
+        return key->dbl == key->dbl;
+    default:
+        return 0;
+    }
+}
+
+// Borrows a string key's bytes
+static int ksorted_word_of(kval *key, ksorted_word *w)
+{
+    switch (key->type)
+    {
+    case KVAL_NUM:
+        w->num = key->num;
+        break;
+    case KVAL_DBL:
+        w->dbl = key->dbl;
+        break;
+    default:
+        w->str = kval_str_flat(key);
+        break;
+    }
+
+    return key->type;
+}
+
+static char *ksorted_strdup(const char *s)
+{
+    size_t len = strlen(s) + 1;
+    return memcpy(malloc(len), s, len);
+}
+
+// Sign of n - d, exactly, for d not nan
+static int ksorted_cmp_mixed(long n, double d)
+{
+    if (d < -9223372036854775808.0)
+    {
+        return 1;
+    }
+
+    if (d >= 9223372036854775808.0)
+    {
+        return -1;
+    }
+
+    // Both the whole part and what's left of d are exact
+    long whole = (long)d;
+    if (n != whole)
+    {
+        return n < whole ? -1 : 1;
+    }
+
+    double rest = d - (double)whole;
+    return (rest < 0) - (rest > 0);
+}
+
+static int ksorted_cmp(int xt, ksorted_word x, int yt, ksorted_word y)
+{
+    if (xt == KVAL_NUM && yt == KVAL_NUM)
+    {
+        return (x.num > y.num) - (x.num < y.num);
+    }
+
+    if (xt == KVAL_STR || yt == KVAL_STR)
+    {
+        if (xt != yt)
+        {
+            return xt == KVAL_STR ? 1 : -1;
+        }
+
+        int c = strcmp(x.str, y.str);
+        return (c > 0) - (c < 0);
+    }
+
+    if (xt == KVAL_DBL && yt == KVAL_DBL)
+    {
+        return (x.dbl > y.dbl) - (x.dbl < y.dbl);
+    }
+
+    int c = xt == KVAL_NUM ? ksorted_cmp_mixed(x.num, y.dbl) : -ksorted_cmp_mixed(y.num, x.dbl);
+    if (c)
+    {
+        return c;
+    }
+
+    return xt == KVAL_NUM ? -1 : 1;
+}
+
+static kval *ksorted_key_kval(int type, ksorted_word w)
+{
+    switch (type)
+    {
+    case KVAL_NUM:
+        return kval_num(w.num);
+    case KVAL_DBL:
+        return kval_dbl(w.dbl);
+    default:
+        return kval_str(w.str);
+    }
+}
+
+static kval *ksorted_val_kval(int type, ksorted_word w)
+{
+    switch (type)
+    {
+    case KVAL_NUM:
+        return kval_num(w.num);
+    case KVAL_DBL:
+        return kval_dbl(w.dbl);
+    default:
+        return kval_copy(w.val);
+    }
+}
+
+// ###############
+//  Nodes        #
+// ###############
+static ksorted_node *ksorted_node_alloc(int leaf)
+{
+    ksorted_node *n = malloc(sizeof(ksorted_node));
+
+    n->refs = 1;
+    n->leaf = leaf;
+    n->count = 0;
+
+    return n;
+}
+
+// n, or a copy of it if anything else holds it
+static ksorted_node *ksorted_node_own(ksorted_node *n)
+{
+    if (n->refs == 1)
+    {
+        return n;
+    }
+
+    ksorted_node *c = malloc(sizeof(ksorted_node));
+    memcpy(c, n, sizeof(ksorted_node));
+    c->refs = 1;
+
+    for (int i = 0; i < n->count; i++)
+    {
+        if (n->ktype[i] == KVAL_STR)
+        {
+            c->keys[i].str = ksorted_strdup(n->keys[i].str);
+        }
+
+        if (!n->leaf)
+        {
+            n->u.kids[i]->refs++;
+        }
+        else if (n->vtype[i] != KVAL_NUM && n->vtype[i] != KVAL_DBL)
+        {
+            c->u.vals[i].val = kval_copy(n->u.vals[i].val);
+        }
+    }
+
+    n->refs--;
+    return c;
+}
+
+// A binary search's loads each depend on the last, so ask for all of a
+// node's keys at once and wait on memory once rather than at every step
+static void ksorted_prefetch(const ksorted_node *n)
+{
+    for (int i = 0; i < n->count; i += 64 / sizeof(ksorted_word))
+    {
+        __builtin_prefetch(n->keys + i);
+    }
+}
+
+// Index of the first key not below k
+static int ksorted_lower(const ksorted_node *n, int kt, ksorted_word k)
+{
+    ksorted_prefetch(n);
+
+    int lo = 0;
+    int hi = n->count;
+
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (ksorted_cmp(n->ktype[mid], n->keys[mid], kt, k) < 0)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+// Index of the child of an inner node whose keys k falls among
+static int ksorted_child(const ksorted_node *n, int kt, ksorted_word k)
+{
+    ksorted_prefetch(n);
+
+    int lo = 1;
+    int hi = n->count;
+
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (ksorted_cmp(n->ktype[mid], n->keys[mid], kt, k) <= 0)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return lo - 1;
+}
+
+// Opens a gap at i
+static void ksorted_shift_up(ksorted_node *n, int i)
+{
+    int tail = n->count - i;
+
+    memmove(n->ktype + i + 1, n->ktype + i, tail);
+    memmove(n->vtype + i + 1, n->vtype + i, tail);
+    memmove(n->keys + i + 1, n->keys + i, tail * sizeof(ksorted_word));
+    memmove(n->u.vals + i + 1, n->u.vals + i, tail * sizeof(ksorted_word));
+    n->count++;
+}
+
+// Closes the gap at i
+static void ksorted_shift_down(ksorted_node *n, int i)
+{
+    int tail = n->count - i - 1;
+
+    memmove(n->ktype + i, n->ktype + i + 1, tail);
+    memmove(n->vtype + i, n->vtype + i + 1, tail);
+    memmove(n->keys + i, n->keys + i + 1, tail * sizeof(ksorted_word));
+    memmove(n->u.vals + i, n->u.vals + i + 1, tail * sizeof(ksorted_word));
+    n->count--;
+}
+
+// Moves the entries from at on into a new node
+static ksorted_node *ksorted_split(ksorted_node *n, int at)
+{
+    ksorted_node *r = ksorted_node_alloc(n->leaf);
+    int tail = n->count - at;
+
+    memcpy(r->ktype, n->ktype + at, tail);
+    memcpy(r->vtype, n->vtype + at, tail);
+    memcpy(r->keys, n->keys + at, tail * sizeof(ksorted_word));
+    memcpy(r->u.vals, n->u.vals + at, tail * sizeof(ksorted_word));
+    r->count = tail;
+    n->count = at;
+
+    return r;
+}
+
+typedef struct
+{
+    int kt;
+    ksorted_word k;
+    int vt;
+    ksorted_word v;
+
+    int added;
+
+    // A node split off to the right of the one put into, and its first key
+    ksorted_node *right;
+    int st;
+    ksorted_word sep;
+} ksorted_put_op;
+
+static void ksorted_leaf_put(ksorted_node *n, int i, ksorted_put_op *op)
+{
+    ksorted_shift_up(n, i);
+    n->ktype[i] = op->kt;
+    n->keys[i] = op->k;
+    n->vtype[i] = op->vt;
+    n->u.vals[i] = op->v;
+}
+
+static void ksorted_inner_put(ksorted_node *n, int i, int st, ksorted_word sep, ksorted_node *kid)
+{
+    ksorted_shift_up(n, i);
+    n->ktype[i] = st;
+    n->keys[i] = sep;
+    n->u.kids[i] = kid;
+}
+
+// Puts into the subtree at n, which is taken, and returns it
+static ksorted_node *ksorted_node_put(ksorted_node *n, ksorted_put_op *op)
+{
+    n = ksorted_node_own(n);
+
+    if (n->leaf)
+    {
+        int i = ksorted_lower(n, op->kt, op->k);
+
+        if (i < n->count && ksorted_cmp(n->ktype[i], n->keys[i], op->kt, op->k) == 0)
+        {
+            if (op->kt == KVAL_STR)
+            {
+                free(op->k.str);
+            }
+
+            if (n->vtype[i] != KVAL_NUM && n->vtype[i] != KVAL_DBL)
+            {
+                kval_del(n->u.vals[i].val);
+            }
+
+            n->vtype[i] = op->vt;
+            n->u.vals[i] = op->v;
+            return n;
+        }
+
+        op->added = 1;
+        if (n->count < KSORTED_ORDER)
+        {
+            ksorted_leaf_put(n, i, op);
+            return n;
+        }
+
+        int at = i == KSORTED_ORDER ? KSORTED_ORDER : KSORTED_HALF;
+        ksorted_node *r = ksorted_split(n, at);
+        if (i < at)
+        {
+            ksorted_leaf_put(n, i, op);
+        }
+        else
+        {
+            ksorted_leaf_put(r, i - at, op);
+        }
+
+        // Leaves keep their keys, so the parent gets a copy
+        op->right = r;
+        op->st = r->ktype[0];
+        op->sep = r->keys[0];
+        if (op->st == KVAL_STR)
+        {
+            op->sep.str = ksorted_strdup(op->sep.str);
+        }
+        return n;
+    }
+
+    int i = ksorted_child(n, op->kt, op->k);
+    n->u.kids[i] = ksorted_node_put(n->u.kids[i], op);
+    if (!op->right)
+    {
+        return n;
+    }
+
+    ksorted_node *kid = op->right;
+    op->right = NULL;
+
+    if (n->count < KSORTED_ORDER)
+    {
+        ksorted_inner_put(n, i + 1, op->st, op->sep, kid);
+        return n;
+    }
+
+    int at = i + 1 == KSORTED_ORDER ? KSORTED_ORDER : KSORTED_HALF;
+    ksorted_node *r = ksorted_split(n, at);
+    if (i + 1 < at)
+    {
+        ksorted_inner_put(n, i + 1, op->st, op->sep, kid);
+    }
+    else
+    {
+        ksorted_inner_put(r, i + 1 - at, op->st, op->sep, kid);
+    }
+
+    // The first key of an inner node isn't used, so it moves up
+    op->right = r;
+    op->st = r->ktype[0];
+    op->sep = r->keys[0];
+    r->ktype[0] = KVAL_NUM;
+    return n;
+}
+
+/*
+    Deletes k, which is there, from the subtree at n, which is taken.
+    Returns n, or NULL once it's empty. Nodes aren't merged with their
+    neighbours, only freed when their last entry goes.
+*/
+static ksorted_node *ksorted_node_del(ksorted_node *n, int kt, ksorted_word k)
+{
+    n = ksorted_node_own(n);
+
+    if (n->leaf)
+    {
+        int i = ksorted_lower(n, kt, k);
+
+        if (n->ktype[i] == KVAL_STR)
+        {
+            free(n->keys[i].str);
+        }
+
+        if (n->vtype[i] != KVAL_NUM && n->vtype[i] != KVAL_DBL)
+        {
+            kval_del(n->u.vals[i].val);
+        }
+
+        ksorted_shift_down(n, i);
+    }
+    else
+    {
+        int i = ksorted_child(n, kt, k);
+        ksorted_node *kid = ksorted_node_del(n->u.kids[i], kt, k);
+
+        if (kid)
+        {
+            n->u.kids[i] = kid;
+            return n;
+        }
+
+        // Dropping the first child leaves the second's key unused
+        int unused = i == 0 ? 1 : i;
+        if (unused < n->count && n->ktype[unused] == KVAL_STR)
+        {
+            free(n->keys[unused].str);
+        }
+
+        ksorted_shift_down(n, i);
+        n->ktype[0] = KVAL_NUM;
+    }
+
+    if (n->count == 0)
+    {
+        free(n);
+        return NULL;
+    }
+
+    return n;
+}
+
+// ###############
+//  Access       #
+// ###############
+
+// t, or a copy of it sharing its nodes if anything else holds it
+static ksorted *ksorted_own(ksorted *t)
+{
+    if (t->refs == 1)
+    {
+        return t;
+    }
+
+    ksorted *c = ksorted_new();
+    c->count = t->count;
+    c->root = t->root;
+    if (c->root)
+    {
+        c->root->refs++;
+    }
+
+    t->refs--;
+    return c;
+}
+
+// The leaf that would hold k
+static const ksorted_node *ksorted_leaf(const ksorted *t, int kt, ksorted_word k)
+{
+    const ksorted_node *n = t->root;
+    if (!n)
+    {
+        return NULL;
+    }
+
+    while (!n->leaf)
+    {
+        n = n->u.kids[ksorted_child(n, kt, k)];
+    }
+
+    return n;
+}
+
+kval *ksorted_get(const ksorted *t, kval *key)
+{
+    ksorted_word k;
+    int kt = ksorted_word_of(key, &k);
+
+    const ksorted_node *n = ksorted_leaf(t, kt, k);
+    if (!n)
+    {
+        return NULL;
+    }
+
+    int i = ksorted_lower(n, kt, k);
+    if (i == n->count || ksorted_cmp(n->ktype[i], n->keys[i], kt, k) != 0)
+    {
+        return NULL;
+    }
+
+    return ksorted_val_kval(n->vtype[i], n->u.vals[i]);
+}
+
+ksorted *ksorted_put(ksorted *t, kval *key, kval *val)
+{
+    ksorted_put_op op;
+
+    op.kt = ksorted_word_of(key, &op.k);
+    if (op.kt == KVAL_STR)
+    {
+        op.k.str = ksorted_strdup(op.k.str);
+    }
+    kval_del(key);
+
+    // Numbers are kept unboxed
+    op.vt = val->type;
+    if (val->type == KVAL_NUM)
+    {
+        op.v.num = val->num;
+        kval_del(val);
+    }
+    else if (val->type == KVAL_DBL)
+    {
+        op.v.dbl = val->dbl;
+        kval_del(val);
+    }
+    else
+    {
+        op.v.val = val;
+    }
+
+    op.added = 0;
+    op.right = NULL;
+
+    t = ksorted_own(t);
+    if (!t->root)
+    {
+        t->root = ksorted_node_alloc(1);
+        ksorted_leaf_put(t->root, 0, &op);
+        t->count = 1;
+        return t;
+    }
+
+    t->root = ksorted_node_put(t->root, &op);
+    t->count += op.added;
+
+    if (op.right)
+    {
+        ksorted_node *root = ksorted_node_alloc(0);
+        root->count = 2;
+        root->ktype[0] = KVAL_NUM;
+        root->u.kids[0] = t->root;
+        root->ktype[1] = op.st;
+        root->keys[1] = op.sep;
+        root->u.kids[1] = op.right;
+        t->root = root;
+    }
+
+    return t;
+}
+
+ksorted *ksorted_del(ksorted *t, kval *key)
+{
+    ksorted_word k;
+    int kt = ksorted_word_of(key, &k);
+
+    // Leave t alone, and shared, when there's nothing to delete
+    const ksorted_node *leaf = ksorted_leaf(t, kt, k);
+    int i = leaf ? ksorted_lower(leaf, kt, k) : 0;
+    if (!leaf || i == leaf->count || ksorted_cmp(leaf->ktype[i], leaf->keys[i], kt, k) != 0)
+    {
+        kval_del(key);
+        return t;
+    }
+
+    t = ksorted_own(t);
+    t->root = ksorted_node_del(t->root, kt, k);
+    t->count--;
+    kval_del(key);
+
+    // Deleting never leaves a node empty, but can leave a root with one child
+    while (t->root && !t->root->leaf && t->root->count == 1)
+    {
+        ksorted_node *root = t->root;
+        t->root = root->u.kids[0];
+        free(root);
+    }
+
+    return t;
+}
+
+// ###############
+//  Walking      #
+// ###############
+typedef struct
+{
+    int has_lo;
+    int lt;
+    ksorted_word lo;
+
+    int has_hi;
+    int ht;
+    ksorted_word hi;
+
+    int (*f)(kval *key, kval *val, void *ctx);
+    void *ctx;
+
+    // Reached hi
+    int done;
+} ksorted_walk;
+
+// Along the left edge of the range the walk starts from lo, elsewhere from the first entry
+static int ksorted_node_range(const ksorted_node *n, ksorted_walk *w, int edge)
+{
+    int first = 0;
+    if (edge && w->has_lo)
+    {
+        first = n->leaf ? ksorted_lower(n, w->lt, w->lo) : ksorted_child(n, w->lt, w->lo);
+    }
+
+    for (int i = first; i < n->count; i++)
+    {
+        // An inner node's first key isn't kept, but its parent already checked it
+        if (w->has_hi && (n->leaf || i > 0) && ksorted_cmp(n->ktype[i], n->keys[i], w->ht, w->hi) >= 0)
+        {
+            w->done = 1;
+            return 0;
+        }
+
+        int r;
+        if (n->leaf)
+        {
+            r = w->f(ksorted_key_kval(n->ktype[i], n->keys[i]), ksorted_val_kval(n->vtype[i], n->u.vals[i]), w->ctx);
+        }
+        else
+        {
+            r = ksorted_node_range(n->u.kids[i], w, edge && i == first);
+        }
+
+        if (r || w->done)
+        {
+            return r;
+        }
+    }
+
+    return 0;
+}
+
+int ksorted_range(const ksorted *t, kval *lo, kval *hi, int (*f)(kval *key, kval *val, void *ctx), void *ctx)
+{
+    if (!t->root)
+    {
+        return 0;
+    }
+
+    ksorted_walk w;
+    w.has_lo = lo != NULL;
+    w.lt = lo ? ksorted_word_of(lo, &w.lo) : 0;
+    w.has_hi = hi != NULL;
+    w.ht = hi ? ksorted_word_of(hi, &w.hi) : 0;
+    w.f = f;
+    w.ctx = ctx;
+    w.done = 0;
+
+    return ksorted_node_range(t->root, &w, 1);
+}
+
+void ksorted_first(const ksorted *t, kval **key, kval **val)
+{
+    const ksorted_node *n = t->root;
+    while (!n->leaf)
+    {
+        n = n->u.kids[0];
+    }
+
+    *key = ksorted_key_kval(n->ktype[0], n->keys[0]);
+    *val = ksorted_val_kval(n->vtype[0], n->u.vals[0]);
+}
+
+void ksorted_last(const ksorted *t, kval **key, kval **val)
+{
+    const ksorted_node *n = t->root;
+    while (!n->leaf)
+    {
+        n = n->u.kids[n->count - 1];
+    }
+
+    int i = n->count - 1;
+    *key = ksorted_key_kval(n->ktype[i], n->keys[i]);
+    *val = ksorted_val_kval(n->vtype[i], n->u.vals[i]);
+}
@@ -0,0 +1,89 @@
+#ifndef ksorted_h
+#define ksorted_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "types.h"
+
+/*
+    Sorted maps.
+
+    A B+ tree: entries live in the leaves in key order, and inner nodes
+    hold the smallest key under each child to steer by. Nodes are wide,
+    with their keys in one run of cache lines that a search prefetches
+    before it starts, so each level costs about one wait on memory and
+    ten million keys are four levels deep.
+
+    Numbers are kept inline, as keys and as values, rather than as kvals
+    of their own, so a map of numbers costs little more than the numbers.
+    Other values are kvals, and string keys are copies of their bytes.
+
+    Like hash maps, updates copy the path to the key and share the rest,
+    unless nothing else can see the nodes on it.
+*/
+#define KSORTED_ORDER 128
+
+// A key or value: a number, a string key, or any other value
+typedef union
+{
+    long num;
+    double dbl;
+    char *str;
+    kval *val;
+} ksorted_word;
+
+typedef struct ksorted_node
+{
+    int refs;
+    int leaf;
+    int count;
+
+    // Types of keys and values, KVAL_NUM, KVAL_DBL or KVAL_STR for keys,
+    // anything for values. The first key of an inner node isn't used.
+    uint8_t ktype[KSORTED_ORDER];
+    uint8_t vtype[KSORTED_ORDER];
+
+    ksorted_word keys[KSORTED_ORDER];
+
+    // Values in a leaf, children in an inner node
+    union
+    {
+        ksorted_word vals[KSORTED_ORDER];
+        struct ksorted_node *kids[KSORTED_ORDER];
+    } u;
+} ksorted_node;
+
+struct ksorted
+{
+    int refs;
+    size_t count;
+    ksorted_node *root;
+};
+
+ksorted *ksorted_new(void);
+ksorted *ksorted_ref(ksorted *t);
+void ksorted_unref(ksorted *t);
+
+// Numbers other than nan, and strings. Numbers sort before strings,
+// and an integer before a double of the same value, so 1 and 1.0 are different keys.
+int ksorted_keyable(kval *key);
+
+// A copy of the value for key, or NULL
+kval *ksorted_get(const ksorted *t, kval *key);
+
+// t with key set to val, or without key. All of them are taken.
+ksorted *ksorted_put(ksorted *t, kval *key, kval *val);
+ksorted *ksorted_del(ksorted *t, kval *key);
+
+/*
+    Calls f on each entry with lo <= key < hi in order, either bound
+    NULL for none, until it returns non zero, which is returned. f is
+    given the key and value as new kvals.
+*/
+int ksorted_range(const ksorted *t, kval *lo, kval *hi, int (*f)(kval *key, kval *val, void *ctx), void *ctx);
+
+// The first or last entry as new kvals. t must not be empty.
+void ksorted_first(const ksorted *t, kval **key, kval **val);
+void ksorted_last(const ksorted *t, kval **key, kval **val);
+
+#endif
@@ -5,6 +5,199 @@
 #include "builtin.h"
 #include "types.h"
 #include "kenv.h"
+#include "kout.h"
+#include "krope.h"
+#include "kintern.h"
+#include "kbuf.h"
+#include "kbig.h"
+#include "kvec.h"
+#include "kmat.h"
+#include "khash.h"
+#include "kmap.h"
+#include "ksorted.h"
+#include "kset.h"
+#include "krecord.h"
+
+// Room for len characters and the terminator, inline in v when they fit
+static char *kval_chars(kval *v, size_t len)
+{
+    return len < KVAL_SMALL ? v->small : malloc(len + 1);
+}
+
+static void kval_chars_free(kval *v, char *s)
+{
+    if (s != v->small && !v->interned)
+    {
+        free(s);
+    }
+}
+
+// ###############
+//  Errors       #
+// ###############
+
+// Arguments of a formatted error, kept until the message is needed
+#define KERR_ARGS_MAX 8
+
+struct kerr_args
+{
+    const char *fmt;
+    size_t size;
+    long nums[KERR_ARGS_MAX];
+
+    // Offsets into text, so the whole block can be copied with memcpy
+    size_t strs[KERR_ARGS_MAX];
+    char text[];
+};
+
+// Conversions in fmt: 's', 'i' or 'l'. -1 if it uses anything else
+static int kerr_scan(const char *fmt, char *kinds)
+{
+    int count = 0;
+
+    for (const char *p = fmt; (p = strchr(p, '%')); p++)
+    {
+        if (count == KERR_ARGS_MAX)
+        {
+            return -1;
+        }
+
+        p++;
+        if (*p == 's' || *p == 'i' || *p == 'd')
+        {
+            kinds[count++] = *p == 's' ? 's' : 'i';
+        }
+        else if (*p == 'l' && (p[1] == 'i' || p[1] == 'd'))
+        {
+            kinds[count++] = 'l';
+            p++;
+        }
+        else
+        {
+            return -1;
+        }
+    }
+
+    return count;
+}
+
+static kval *kval_verr(int code, const char *fmt, va_list va)
+{
+    char kinds[KERR_ARGS_MAX];
+    int count = kerr_scan(fmt, kinds);
+
+    // A constant message is the format itself
+    if (count == 0)
+    {
+        return kval_err_static(code, fmt);
+    }
+
+    kval *v = kval_err_static(code, NULL);
+    v->err_static = 0;
+
+    // Anything fancier is formatted straight away
+    if (count < 0)
+    {
+        v->err = malloc(512);
+        vsnprintf(v->err, 511, fmt, va);
+        v->err = realloc(v->err, strlen(v->err) + 1);
+
+        return v;
+    }
+
+    // Strings are copied, they rarely outlive the caller
+    va_list sizes;
+    va_copy(sizes, va);
+    size_t text = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (kinds[i] == 's')
+        {
+            text += strlen(va_arg(sizes, char *)) + 1;
+        }
+        else if (kinds[i] == 'l')
+        {
+            va_arg(sizes, long);
+        }
+        else
+        {
+            va_arg(sizes, int);
+        }
+    }
+    va_end(sizes);
+
+    kerr_args *x = malloc(sizeof(kerr_args) + text);
+    x->fmt = fmt;
+    x->size = sizeof(kerr_args) + text;
+
+    size_t at = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (kinds[i] == 's')
+        {
+            const char *s = va_arg(va, char *);
+            size_t len = strlen(s) + 1;
+
+            memcpy(x->text + at, s, len);
+            x->strs[i] = at;
+            at += len;
+        }
+        else
+        {
+            x->nums[i] = kinds[i] == 'l' ? va_arg(va, long) : va_arg(va, int);
+        }
+    }
+
+    v->eargs = x;
+    return v;
+}
+
+static char *kerr_render(kerr_args *x)
+{
+    kbuf b;
+    kbuf_init(&b);
+
+    int i = 0;
+    for (const char *p = x->fmt; *p; p++)
+    {
+        if (*p != '%')
+        {
+            kbuf_putc(&b, *p);
+            continue;
+        }
+
+        p++;
+        if (*p == 's')
+        {
+            const char *s = x->text + x->strs[i];
+            kbuf_put(&b, s, strlen(s));
+        }
+        else
+        {
+            char num[24];
+            kbuf_put(&b, num, snprintf(num, sizeof(num), "%ld", x->nums[i]));
+            p += *p == 'l';
+        }
+
+        i++;
+    }
+
+    kbuf_putc(&b, '\0');
+    return b.data;
+}
+
+// The message of an error, formatting it the first time it is asked for
+const char *kval_err_msg(kval *v)
+{
+    if (v->eargs)
+    {
+        v->err = kerr_render(v->eargs);
+        free(v->eargs);
+        v->eargs = NULL;
+    }
+
+    return v->err;
+}
 
 // ###############
 //  Constructors #
@@ -19,23 +212,198 @@ kval *kval_num(long num)
     return kv;
 }
 
+// Takes over the reference to v.
+kval *kval_vec(kvec *v)
+{
+    kval *kv = malloc(sizeof(kval));
+
+    kv->type = KVAL_VEC;
+    kv->vec = v;
+
+    return kv;
+}
+
+// Takes over the reference to m.
+kval *kval_mat(kmat *m)
+{
+    kval *kv = malloc(sizeof(kval));
+
+    kv->type = KVAL_MAT;
+    kv->mat = m;
+
+    return kv;
+}
+
+// Takes over the reference to h.
+kval *kval_table(khash *h)
+{
+    kval *kv = malloc(sizeof(kval));
+
+    kv->type = KVAL_TABLE;
+    kv->table = h;
+
+    return kv;
+}
+
+// Takes over the reference to m.
+kval *kval_map(kmap *m)
+{
+    kval *kv = malloc(sizeof(kval));
+
+    kv->type = KVAL_MAP;
+    kv->map = m;
+
+    return kv;
+}
+
+// Takes over the reference to t.
+kval *kval_sorted(ksorted *t)
+{
+    kval *kv = malloc(sizeof(kval));
+
+    kv->type = KVAL_SORTED;
+    kv->sorted = t;
+
+    return kv;
+}
+
+// Takes over the reference to s.
+kval *kval_set(kset *s)
+{
+    kval *kv = malloc(sizeof(kval));
+
+    kv->type = KVAL_SET;
+    kv->set = s;
+
+    return kv;
+}
+
+// A record of type r with no fields yet. Takes over the reference to r.
+kval *kval_record(krecord *r)
+{
+    kval *kv = malloc(sizeof(kval));
+
+    kv->type = KVAL_RECORD;
+    kv->rec = r;
+    kv->count = 0;
+    kv->pack = KPACK_NONE;
+    kv->cells = NULL;
+
+    return kv;
+}
+
+// The constructor of r, with slot -1, or the accessor of a field. Takes over the reference to r.
+kval *kval_record_fun(krecord *r, int slot)
+{
+    kval *kv = malloc(sizeof(kval));
+
+    kv->type = KVAL_FUN;
+    kv->fun = NULL;
+    kv->rec = r;
+    kv->slot = slot;
+
+    return kv;
+}
+
+kval *kval_dbl(double dbl)
+{
+    kval *kv = malloc(sizeof(kval));
+
+    kv->type = KVAL_DBL;
+    kv->dbl = dbl;
+
+    return kv;
+}
+
+// Takes over the reference to b. Values that fit in a long come back as plain numbers
+kval *kval_big(kbig *b)
+{
+    long n;
+    if (kbig_to_long(b, &n))
+    {
+        kbig_unref(b);
+        return kval_num(n);
+    }
+
+    kval *kv = malloc(sizeof(kval));
+
+    kv->type = KVAL_BIG;
+    kv->big = b;
+
+    return kv;
+}
+
 kval *kval_sym(char *s)
+{
+    return kval_sym_n(s, strlen(s));
+}
+
+kval *kval_sym_n(const char *s, size_t len)
 {
     kval *kv = malloc(sizeof(kval));
 
     kv->type = KVAL_SYM;
-    kv->sym = malloc(strlen(s) + 1); // REMINDER: strings are null-terminated with '\0'
-    strcpy(kv->sym, s);
+    kv->len = len;
+    kv->hash = 0;
+    kv->interned = 0;
+    kv->rope = NULL;
+    kv->sym = kval_chars(kv, len);
+    memcpy(kv->sym, s, len);
+    kv->sym[len] = '\0'; // REMINDER: strings are null-terminated with '\0'
+
+    return kv;
+}
+
+// A symbol or string sharing the table's bytes s, which it doesn't own
+static kval *kval_interned(int type, const char *s, size_t len, unsigned long hash)
+{
+    kval *kv = malloc(sizeof(kval));
+
+    kv->type = type;
+    kv->len = len;
+    kv->hash = hash;
+    kv->interned = 1;
+    kv->rope = NULL;
+    kv->str = (char *)s;
 
     return kv;
 }
 
+// A symbol read from source. Interned straight from the source bytes, so they're never copied but into the table.
+kval *kval_sym_lit(const char *s, size_t len)
+{
+    if (!kintern_enabled)
+    {
+        return kval_sym_n(s, len);
+    }
+
+    unsigned long hash = kintern_hash(s, len);
+    return kval_interned(KVAL_SYM, kintern(s, len, hash), len, hash);
+}
+
+// The same for a string literal, copied only when the table won't take it, see kintern_str
+kval *kval_str_lit(const char *s, size_t len)
+{
+    if (kintern_enabled)
+    {
+        unsigned long hash = kintern_hash(s, len);
+        const char *shared = kintern_str(s, len, hash);
+        if (shared)
+        {
+            return kval_interned(KVAL_STR, shared, len, hash);
+        }
+    }
+
+    return kval_str_n(s, len);
+}
+
 kval *kval_sexpr(void)
 {
     kval *kv = malloc(sizeof(kval));
 
     kv->type = KVAL_SEXPR;
     kv->count = 0;
+    kv->pack = KPACK_NONE;
     kv->cells = NULL;
 
     return kv;
@@ -47,6 +415,7 @@ kval *kval_qexpr(void)
 
     kv->type = KVAL_QEXPR;
     kv->count = 0;
+    kv->pack = KPACK_NONE;
     kv->cells = NULL;
 
     return kv;
@@ -54,29 +423,49 @@ kval *kval_qexpr(void)
 
 kval *kval_err(char *errorMsg, ...)
 {
-    kval *v = malloc(sizeof(kval));
-    v->type = KVAL_ERR;
-
     va_list va;
     va_start(va, errorMsg);
+    kval *v = kval_verr(KERR_OTHER, errorMsg, va);
+    va_end(va);
 
-    v->err = malloc(512);
+    return v;
+}
 
-    vsnprintf(v->err, 511, errorMsg, va);
+kval *kval_err_kind(int code, char *errorMsg, ...)
+{
+    va_list va;
+    va_start(va, errorMsg);
+    kval *v = kval_verr(code, errorMsg, va);
+    va_end(va);
 
-    v->err = realloc(v->err, strlen(v->err) + 1);
+    return v;
+}
 
-    va_end(va);
+// msg is not copied, it must be static or interned
+kval *kval_err_static(int code, const char *msg)
+{
+    kval *v = malloc(sizeof(kval));
+    v->type = KVAL_ERR;
+    v->code = code;
+    v->err = (char *)msg;
+    v->eargs = NULL;
+    v->err_static = 1;
 
     return v;
 }
 
+kval *kval_error(int code)
+{
+    return kval_err_static(code, kerr_message(code));
+}
+
 kval *kval_fun(kbuiltin func)
 {
     kval *kv = malloc(sizeof(kval));
 
     kv->type = KVAL_FUN;
     kv->fun = func;
+    kv->rec = NULL;
 
     return kv;
 }
@@ -88,6 +477,7 @@ kval *kval_lambda(kval *formals, kval *body)
     kv->type = KVAL_FUN;
 
     kv->fun = NULL;
+    kv->rec = NULL;
     kv->fenv = kenv_init();
 
     kv->formals = formals;
@@ -97,14 +487,351 @@ kval *kval_lambda(kval *formals, kval *body)
 }
 
 kval *kval_str(char *s)
+{
+    return kval_str_n(s, strlen(s));
+}
+
+kval *kval_str_n(const char *s, size_t len)
+{
+    kval *v = kval_str_alloc(len);
+    memcpy(v->str, s, len);
+    return v;
+}
+
+// A string of len bytes for the caller to fill in
+kval *kval_str_alloc(size_t len)
+{
+    kval *v = malloc(sizeof(kval));
+    v->type = KVAL_STR;
+    v->len = len;
+    v->hash = 0;
+    v->interned = 0;
+    v->rope = NULL;
+    v->str = kval_chars(v, len);
+    v->str[len] = '\0';
+    return v;
+}
+
+// Takes over the rope reference
+kval *kval_str_rope(krope *r)
 {
     kval *v = malloc(sizeof(kval));
     v->type = KVAL_STR;
-    v->str = malloc(strlen(s) + 1);
-    strcpy(v->str, s);
+    v->len = r->len;
+    v->hash = 0;
+    v->interned = 0;
+    v->rope = r;
+    v->str = NULL;
     return v;
 }
 
+// ###############
+//  Numbers      #
+// ###############
+int kval_is_number(kval *v)
+{
+    return v->type == KVAL_NUM || v->type == KVAL_BIG || v->type == KVAL_DBL;
+}
+
+double kval_to_double(kval *v)
+{
+    switch (v->type)
+    {
+    case KVAL_DBL:
+        return v->dbl;
+    case KVAL_BIG:
+        return kbig_to_double(v->big);
+    default:
+        return (double)v->num;
+    }
+}
+
+// A number or big number as a kbig, with a new reference
+kbig *kval_to_big(kval *v)
+{
+    return v->type == KVAL_BIG ? kbig_ref(v->big) : kbig_from_long(v->num);
+}
+
+// <0, 0 or >0 as x is less than, equal to or greater than y
+int kval_cmp_num(kval *x, kval *y)
+{
+    if (x->type == KVAL_NUM && y->type == KVAL_NUM)
+    {
+        return (x->num > y->num) - (x->num < y->num);
+    }
+
+    if (x->type == KVAL_DBL || y->type == KVAL_DBL)
+    {
+        double a = kval_to_double(x);
+        double b = kval_to_double(y);
+        return (a > b) - (a < b);
+    }
+
+    kbig *a = kval_to_big(x);
+    kbig *b = kval_to_big(y);
+    int c = kbig_cmp(a, b);
+
+    kbig_unref(a);
+    kbig_unref(b);
+
+    return c;
+}
+
+// ###############
+//  Strings      #
+// ###############
+
+// The bytes of a string, turning a rope into flat bytes the first time they are needed
+char *kval_str_flat(kval *v)
+{
+    if (v->rope)
+    {
+        v->str = kval_chars(v, v->len);
+        krope_copy(v->rope, 0, v->len, v->str);
+        v->str[v->len] = '\0';
+
+        krope_unref(v->rope);
+        v->rope = NULL;
+    }
+
+    return v->str;
+}
+
+// Hash of a symbol or string, computed the first time it is asked for
+unsigned long kval_hash(kval *v)
+{
+    if (!v->hash)
+    {
+        v->hash = kintern_hash(v->type == KVAL_SYM ? v->sym : kval_str_flat(v), v->len);
+    }
+
+    return v->hash;
+}
+
+// Share the table's copy of a symbol or flat string, when the table takes it
+kval *kval_intern(kval *v)
+{
+    if (!kintern_enabled || v->interned || v->rope)
+    {
+        return v;
+    }
+
+    char **chars = v->type == KVAL_SYM ? &v->sym : &v->str;
+    const char *shared = v->type == KVAL_SYM ? kintern(*chars, v->len, kval_hash(v))
+                                             : kintern_str(*chars, v->len, kval_hash(v));
+    if (!shared)
+    {
+        return v;
+    }
+
+    kval_chars_free(v, *chars);
+    *chars = (char *)shared;
+    v->interned = 1;
+
+    return v;
+}
+
+// Interned strings are equal only if they are the same pointer, hashes rule out most others
+static bool kval_str_eq(kval *x, kval *y)
+{
+    if (x->len != y->len)
+    {
+        return false;
+    }
+
+    const char *a = x->type == KVAL_SYM ? x->sym : kval_str_flat(x);
+    const char *b = y->type == KVAL_SYM ? y->sym : kval_str_flat(y);
+
+    if (x->interned && y->interned)
+    {
+        return a == b;
+    }
+
+    if (x->hash && y->hash && x->hash != y->hash)
+    {
+        return false;
+    }
+
+    return memcmp(a, b, x->len) == 0;
+}
+
+// The string as a rope, for concatenation
+krope *kval_str_to_rope(kval *v)
+{
+    return v->rope ? krope_ref(v->rope) : krope_leaf(v->str, v->len);
+}
+
+// ###############
+//  Packed Lists #
+// ###############
+
+// Whether v can be stored in a list packed as pack
+static int kval_packs_as(kval *v, int pack)
+{
+    if (pack == KPACK_NUMS)
+    {
+        return v->type == KVAL_NUM;
+    }
+
+    // Interned bytes are never freed, so the list can point at them without owning them
+    return v->type == KVAL_STR && v->interned;
+}
+
+// Element i of a packed list, boxed
+static kval *kval_packed_get(kval *v, int i)
+{
+    if (v->pack == KPACK_NUMS)
+    {
+        return kval_num(v->nums[i]);
+    }
+
+    return kval_interned(KVAL_STR, v->strs[i].str, v->strs[i].len, 0);
+}
+
+static size_t kval_packed_size(int pack)
+{
+    return pack == KPACK_NUMS ? sizeof(long) : sizeof(kstr_ref);
+}
+
+static void *kval_packed_data(kval *v)
+{
+    return v->pack == KPACK_NUMS ? (void *)v->nums : (void *)v->strs;
+}
+
+static void kval_packed_free(kval *v)
+{
+    free(kval_packed_data(v));
+    v->pack = KPACK_NONE;
+    v->cells = NULL;
+}
+
+// Store a Q-Expression of only numbers, or only interned strings, without a kval per element
+kval *kval_pack(kval *v)
+{
+    if (v->type != KVAL_QEXPR || v->pack != KPACK_NONE || v->count <= 0)
+    {
+        return v;
+    }
+
+    int pack = v->cells[0]->type == KVAL_NUM ? KPACK_NUMS : KPACK_STRS;
+    for (int i = 0; i < v->count; i++)
+    {
+        if (!kval_packs_as(v->cells[i], pack))
+        {
+            return v;
+        }
+    }
+
+    if (pack == KPACK_NUMS)
+    {
+        v->nums = malloc(sizeof(long) * v->count);
+    }
+    else
+    {
+        v->strs = malloc(sizeof(kstr_ref) * v->count);
+    }
+
+    for (int i = 0; i < v->count; i++)
+    {
+        if (pack == KPACK_NUMS)
+        {
+            v->nums[i] = v->cells[i]->num;
+        }
+        else
+        {
+            v->strs[i].str = v->cells[i]->str;
+            v->strs[i].len = v->cells[i]->len;
+        }
+
+        kval_del(v->cells[i]);
+    }
+
+    free(v->cells);
+    v->cells = NULL;
+    v->pack = pack;
+
+    return v;
+}
+
+// Back to a kval per element, for anything that works on cells directly
+kval *kval_unpack(kval *v)
+{
+    if (v->pack == KPACK_NONE)
+    {
+        return v;
+    }
+
+    kval **cells = malloc(sizeof(kval *) * v->count);
+    for (int i = 0; i < v->count; i++)
+    {
+        cells[i] = kval_packed_get(v, i);
+    }
+
+    kval_packed_free(v);
+    v->cells = cells;
+
+    return v;
+}
+
+// x packed and y with the same packing, appended to the end of x. Takes y.
+kval *kval_packed_join(kval *x, kval *y)
+{
+    size_t size = kval_packed_size(x->pack);
+    char *data = realloc(kval_packed_data(x), size * (x->count + y->count));
+    memcpy(data + size * x->count, kval_packed_data(y), size * y->count);
+
+    if (x->pack == KPACK_NUMS)
+    {
+        x->nums = (long *)data;
+    }
+    else
+    {
+        x->strs = (kstr_ref *)data;
+    }
+
+    x->count += y->count;
+    kval_del(y);
+
+    return x;
+}
+
+// Drop elements from the front and back of a packed list, without boxing them
+kval *kval_packed_slice(kval *v, int start, int count)
+{
+    if (count == 0)
+    {
+        kval_packed_free(v);
+        v->count = 0;
+        return v;
+    }
+
+    size_t size = kval_packed_size(v->pack);
+    char *data = kval_packed_data(v);
+    memmove(data, data + size * start, size * count);
+    v->count = count;
+
+    return v;
+}
+
+static int kval_packed_eq(kval *x, kval *y)
+{
+    if (x->pack == KPACK_NUMS)
+    {
+        return memcmp(x->nums, y->nums, sizeof(long) * x->count) == 0;
+    }
+
+    // Equal interned strings are the same pointer
+    for (int i = 0; i < x->count; i++)
+    {
+        if (x->strs[i].str != y->strs[i].str)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
 // ###############
 //  Eval         #
 // ###############
@@ -127,18 +854,12 @@ kval *kval_eval(kenv *e, kval *kv)
 
 kval *kval_eval_sexpr(kenv *e, kval *kv)
 {
-    // Evaluate cells
+    // Evaluate cells, stopping at the first error. The cells after it are never evaluated
     for (int i = 0; i < kv->count; i++)
     {
         kv->cells[i] = kval_eval(e, kv->cells[i]);
-    }
-
-    // Check for errors
-    for (int i = 0; i < kv->count; i++)
-    {
-        bool is_error = kv->cells[i]->type == KVAL_ERR;
 
-        if (is_error)
+        if (kv->cells[i]->type == KVAL_ERR)
         {
             return kval_take(kv, i);
         }
@@ -159,7 +880,8 @@ kval *kval_eval_sexpr(kenv *e, kval *kv)
     kval *f = kval_pop(kv, 0);
     if (f->type != KVAL_FUN)
     {
-        kval *err = kval_err(
+        kval *err = kval_err_kind(
+            KERR_TYPE,
             "S-Expression starts with incorrect type. "
             "Got %s, Expected %s.",
             ktype_name(f->type), ktype_name(KVAL_FUN));
@@ -185,19 +907,34 @@ void kval_del(kval *kv)
     {
 
     case KVAL_ERR:
-        free(kv->err);
+        free(kv->eargs);
+        if (!kv->err_static)
+        {
+            free(kv->err);
+        }
         break;
 
     case KVAL_SYM:
-        free(kv->sym);
+        kval_chars_free(kv, kv->sym);
         break;
 
     case KVAL_STR:
-        free(kv->str);
+        kval_chars_free(kv, kv->str);
+        krope_unref(kv->rope);
         break;
 
+    case KVAL_RECORD:
+        krecord_unref(kv->rec);
+        // fall through
+
     case KVAL_SEXPR:
     case KVAL_QEXPR:
+        if (kv->pack != KPACK_NONE)
+        {
+            kval_packed_free(kv);
+            break;
+        }
+
         for (int i = 0; i < kv->count; i++)
         {
             kval_del(kv->cells[i]);
@@ -207,7 +944,11 @@ void kval_del(kval *kv)
         break;
 
     case KVAL_FUN:
-        if (!kv->fun)
+        if (kv->rec)
+        {
+            krecord_unref(kv->rec);
+        }
+        else if (!kv->fun)
         {
             kenv_del(kv->fenv);
             kval_del(kv->formals);
@@ -215,6 +956,34 @@ void kval_del(kval *kv)
         }
         break;
 
+    case KVAL_BIG:
+        kbig_unref(kv->big);
+        break;
+
+    case KVAL_VEC:
+        kvec_unref(kv->vec);
+        break;
+
+    case KVAL_MAT:
+        kmat_unref(kv->mat);
+        break;
+
+    case KVAL_TABLE:
+        khash_unref(kv->table);
+        break;
+
+    case KVAL_MAP:
+        kmap_unref(kv->map);
+        break;
+
+    case KVAL_SORTED:
+        ksorted_unref(kv->sorted);
+        break;
+
+    case KVAL_SET:
+        kset_unref(kv->set);
+        break;
+
     case KVAL_NUM:
     default:
         break;
@@ -235,7 +1004,7 @@ kval *kval_read(mpc_ast_t *ast)
 
     if (strstr(ast->tag, "symbol"))
     {
-        return kval_sym(ast->contents);
+        return kval_intern(kval_sym(ast->contents));
     }
 
     if (strstr(ast->tag, "string"))
@@ -276,18 +1045,23 @@ kval *kval_read(mpc_ast_t *ast)
         x = kval_add(x, kval_read(ast->children[i]));
     }
 
-    return x;
+    return kval_pack(x);
 }
 
 kval *kval_read_num(mpc_ast_t *ast)
 {
+    if (strchr(ast->contents, '.'))
+    {
+        return kval_dbl(strtod(ast->contents, NULL));
+    }
+
     errno = 0;
     long x = strtol(ast->contents, NULL, 10);
 
     bool x_out_of_range = errno == ERANGE;
 
     return x_out_of_range
-               ? kval_err(KERR_BAD_NUM)
+               ? kval_big(kbig_from_str(ast->contents, strlen(ast->contents)))
                : kval_num(x);
 }
 
@@ -299,7 +1073,7 @@ kval *kval_read_str(mpc_ast_t *t)
     strcpy(unescaped, t->contents + 1);
     unescaped = mpcf_unescape(unescaped);
 
-    kval *str = kval_str(unescaped);
+    kval *str = kval_intern(kval_str(unescaped));
 
     free(unescaped);
 
@@ -311,6 +1085,19 @@ kval *kval_read_str(mpc_ast_t *t)
 // ###############
 kval *kval_pop(kval *kv, int i)
 {
+    if (kv->pack != KPACK_NONE)
+    {
+        kval *x = kval_packed_get(kv, i);
+
+        // Shift the rest down over it
+        size_t size = kval_packed_size(kv->pack);
+        char *data = kval_packed_data(kv);
+        memmove(data + size * i, data + size * (i + 1), size * (kv->count - i - 1));
+
+        kval_packed_slice(kv, 0, kv->count - 1);
+        return x;
+    }
+
     kval *x = kv->cells[i];
 
     memmove(
@@ -334,6 +1121,26 @@ kval *kval_take(kval *v, int i)
 
 kval *kval_add(kval *kv, kval *new_cell)
 {
+    // Stays packed while the new cell fits, anything else unpacks the whole list
+    if (kv->pack == KPACK_NUMS && kval_packs_as(new_cell, KPACK_NUMS))
+    {
+        kv->nums = realloc(kv->nums, sizeof(long) * (kv->count + 1));
+        kv->nums[kv->count++] = new_cell->num;
+        kval_del(new_cell);
+        return kv;
+    }
+
+    if (kv->pack == KPACK_STRS && kval_packs_as(new_cell, KPACK_STRS))
+    {
+        kv->strs = realloc(kv->strs, sizeof(kstr_ref) * (kv->count + 1));
+        kv->strs[kv->count].str = new_cell->str;
+        kv->strs[kv->count++].len = new_cell->len;
+        kval_del(new_cell);
+        return kv;
+    }
+
+    kval_unpack(kv);
+
     kv->count++;
     kv->cells = realloc(kv->cells, sizeof(kval *) * kv->count);
     kv->cells[kv->count - 1] = new_cell;
@@ -363,7 +1170,14 @@ kval *kval_copy(kval *v)
     {
 
     case KVAL_FUN:
-        if (v->fun)
+        x->rec = NULL;
+        if (v->rec)
+        {
+            x->fun = NULL;
+            x->rec = krecord_ref(v->rec);
+            x->slot = v->slot;
+        }
+        else if (v->fun)
         {
             x->fun = v->fun;
         }
@@ -377,28 +1191,107 @@ kval *kval_copy(kval *v)
 
         break;
 
+    // Ropes and interned strings are immutable, copies share them
     case KVAL_STR:
-        x->str = malloc(strlen(v->str) + 1);
-        strcpy(x->str, v->str);
+        x->len = v->len;
+        x->hash = v->hash;
+        x->interned = v->interned;
+        x->rope = v->rope ? krope_ref(v->rope) : NULL;
+        x->str = v->interned ? v->str : NULL;
+        if (v->str && !v->interned)
+        {
+            x->str = kval_chars(x, v->len);
+            memcpy(x->str, v->str, v->len + 1);
+        }
         break;
 
     case KVAL_NUM:
         x->num = v->num;
         break;
 
+    case KVAL_BIG:
+        x->big = kbig_ref(v->big);
+        break;
+
+    case KVAL_DBL:
+        x->dbl = v->dbl;
+        break;
+
+    case KVAL_VEC:
+        x->vec = kvec_ref(v->vec);
+        break;
+
+    case KVAL_MAT:
+        x->mat = kmat_ref(v->mat);
+        break;
+
+    // Tables are mutable and shared, see khash.h
+    case KVAL_TABLE:
+        x->table = khash_ref(v->table);
+        break;
+
+    case KVAL_MAP:
+        x->map = kmap_ref(v->map);
+        break;
+
+    case KVAL_SORTED:
+        x->sorted = ksorted_ref(v->sorted);
+        break;
+
+    case KVAL_SET:
+        x->set = kset_ref(v->set);
+        break;
+
+    // Static messages are shared, pending ones copy their arguments
     case KVAL_ERR:
-        x->err = malloc(strlen(v->err) + 1);
-        strcpy(x->err, v->err);
+        x->code = v->code;
+        x->err_static = v->err_static;
+        x->err = v->err;
+        x->eargs = NULL;
+        if (v->eargs)
+        {
+            x->eargs = malloc(v->eargs->size);
+            memcpy(x->eargs, v->eargs, v->eargs->size);
+        }
+        else if (!v->err_static)
+        {
+            x->err = malloc(strlen(v->err) + 1);
+            strcpy(x->err, v->err);
+        }
         break;
 
     case KVAL_SYM:
-        x->sym = malloc(strlen(v->sym) + 1);
-        strcpy(x->sym, v->sym);
+        x->len = v->len;
+        x->hash = v->hash;
+        x->interned = v->interned;
+        x->rope = NULL;
+        x->sym = v->sym;
+        if (!v->interned)
+        {
+            x->sym = kval_chars(x, v->len);
+            memcpy(x->sym, v->sym, v->len + 1);
+        }
         break;
 
+    case KVAL_RECORD:
+        x->rec = krecord_ref(v->rec);
+        // fall through
+
     case KVAL_SEXPR:
     case KVAL_QEXPR:
         x->count = v->count;
+        x->pack = v->pack;
+        if (v->pack != KPACK_NONE)
+        {
+            size_t size = kval_packed_size(v->pack) * v->count;
+            void *data = memcpy(malloc(size), kval_packed_data(v), size);
+
+            x->nums = data;
+            x->strs = data;
+            x->cells = NULL;
+            break;
+        }
+
         x->cells = malloc(sizeof(kval *) * x->count);
         for (int i = 0; i < x->count; i++)
         {
@@ -413,6 +1306,12 @@ kval *kval_copy(kval *v)
 kval *kval_call(kenv *e, kval *f, kval *a)
 {
 
+    // Record constructors and accessors need their type and slot
+    if (f->rec)
+    {
+        return builtin_record_call(e, f, a);
+    }
+
     if (f->fun)
     {
         return f->fun(e, a);
@@ -428,7 +1327,8 @@ kval *kval_call(kenv *e, kval *f, kval *a)
         if (f->formals->count == 0)
         {
             kval_del(a);
-            return kval_err(
+            return kval_err_kind(
+                KERR_ARGS,
                 "Function passed too many arguments. "
                 "Got %i, Expected %i.",
                 given, total);
@@ -510,6 +1410,105 @@ kval *kval_call(kenv *e, kval *f, kval *a)
     return kval_copy(f);
 }
 
+static int kval_vec_eq(kvec *x, kvec *y)
+{
+    if (x->kind != y->kind || x->len != y->len)
+    {
+        return 0;
+    }
+
+    // Doubles compare by value, so 0.0 and -0.0 are equal and nan isn't
+    if (x->kind == KVEC_F64)
+    {
+        for (size_t i = 0; i < x->len; i++)
+        {
+            if (x->f64[i] != y->f64[i])
+            {
+                return 0;
+            }
+        }
+
+        return 1;
+    }
+
+    return x == y || memcmp(x->i64, y->i64, x->len * sizeof(int64_t)) == 0;
+}
+
+static int kval_mat_eq(kmat *x, kmat *y)
+{
+    if (x->rows != y->rows || x->cols != y->cols)
+    {
+        return 0;
+    }
+
+    for (size_t i = 0; i < x->rows * x->cols; i++)
+    {
+        if (x->f64[i] != y->f64[i])
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Same keys, with equal values
+static int kval_table_eq(khash *x, khash *y)
+{
+    if (x == y)
+    {
+        return 1;
+    }
+
+    if (x->count != y->count)
+    {
+        return 0;
+    }
+
+    for (size_t i = khash_next(x, 0); i < x->cap; i = khash_next(x, i + 1))
+    {
+        kval *v = khash_get(y, x->slots[i].key);
+        if (!v || !kval_eq(x->slots[i].val, v))
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Non zero when the other map lacks key or has a different value for it
+static int kval_map_differs(kval *key, kval *val, void *other)
+{
+    kval *v = kmap_get(other, key);
+    return !v || !kval_eq(val, v);
+}
+
+static int kval_map_eq(kmap *x, kmap *y)
+{
+    return x == y || (x->count == y->count && !kmap_walk(x, kval_map_differs, y));
+}
+
+static int kval_sorted_differs(kval *key, kval *val, void *other)
+{
+    kval *v = ksorted_get(other, key);
+    int r = !v || !kval_eq(val, v);
+
+    if (v)
+    {
+        kval_del(v);
+    }
+    kval_del(key);
+    kval_del(val);
+
+    return r;
+}
+
+static int kval_sorted_eq(ksorted *x, ksorted *y)
+{
+    return x == y || (x->count == y->count && !ksorted_range(x, NULL, NULL, kval_sorted_differs, y));
+}
+
 int kval_eq(kval *x, kval *y)
 {
 
@@ -524,13 +1523,43 @@ int kval_eq(kval *x, kval *y)
     case KVAL_NUM:
         return (x->num == y->num);
 
+    case KVAL_BIG:
+        return kbig_cmp(x->big, y->big) == 0;
+
+    case KVAL_DBL:
+        return x->dbl == y->dbl;
+
+    case KVAL_VEC:
+        return kval_vec_eq(x->vec, y->vec);
+
+    case KVAL_MAT:
+        return kval_mat_eq(x->mat, y->mat);
+
+    case KVAL_TABLE:
+        return kval_table_eq(x->table, y->table);
+
+    case KVAL_MAP:
+        return kval_map_eq(x->map, y->map);
+
+    case KVAL_SORTED:
+        return kval_sorted_eq(x->sorted, y->sorted);
+
+    case KVAL_SET:
+        return kset_eq(x->set, y->set);
+
     case KVAL_ERR:
-        return (strcmp(x->err, y->err) == 0);
+        return (strcmp(kval_err_msg(x), kval_err_msg(y)) == 0);
 
     case KVAL_SYM:
-        return (strcmp(x->sym, y->sym) == 0);
+    case KVAL_STR:
+        return kval_str_eq(x, y);
 
     case KVAL_FUN:
+        if (x->rec || y->rec)
+        {
+            return x->rec && y->rec && x->slot == y->slot && krecord_eq(x->rec, y->rec);
+        }
+
         if (x->fun || y->fun)
         {
             return x->fun == y->fun;
@@ -540,8 +1569,14 @@ int kval_eq(kval *x, kval *y)
             return kval_eq(x->formals, y->formals) && kval_eq(x->body, y->body);
         }
 
-    case KVAL_STR:
-        return (strcmp(x->str, y->str) == 0);
+
+    // Records of the same type compare field by field, like lists
+    case KVAL_RECORD:
+        if (!krecord_eq(x->rec, y->rec))
+        {
+            return 0;
+        }
+        // fall through
 
     // If list compare every individual element
     case KVAL_QEXPR:
@@ -550,10 +1585,31 @@ int kval_eq(kval *x, kval *y)
         {
             return 0;
         }
+
+        if (x->pack != KPACK_NONE && x->pack == y->pack)
+        {
+            return kval_packed_eq(x, y);
+        }
+
         for (int i = 0; i < x->count; i++)
         {
+            // Packed elements are boxed one at a time to compare them
+            kval *a = x->pack != KPACK_NONE ? kval_packed_get(x, i) : x->cells[i];
+            kval *b = y->pack != KPACK_NONE ? kval_packed_get(y, i) : y->cells[i];
+            int eq = kval_eq(a, b);
+
+            if (x->pack != KPACK_NONE)
+            {
+                kval_del(a);
+            }
+
+            if (y->pack != KPACK_NONE)
+            {
+                kval_del(b);
+            }
+
             // If any element not equal then whole list not equal
-            if (!kval_eq(x->cells[i], y->cells[i]))
+            if (!eq)
             {
                 return 0;
             }
@@ -565,13 +1621,97 @@ int kval_eq(kval *x, kval *y)
     return 0;
 }
 
+static int kval_holds_entry(kval *key, kval *val, void *h)
+{
+    return kval_holds(val, h);
+}
+
+// ksorted_range hands out new kvals
+static int kval_holds_sorted_entry(kval *key, kval *val, void *h)
+{
+    int r = kval_holds(val, h);
+
+    kval_del(key);
+    kval_del(val);
+
+    return r;
+}
+
+// Whether v is the table h or has it anywhere inside. Keys are never
+// tables, so only values are looked at.
+int kval_holds(kval *v, khash *h)
+{
+    switch (v->type)
+    {
+    case KVAL_TABLE:
+        if (v->table == h)
+        {
+            return 1;
+        }
+
+        for (size_t i = khash_next(v->table, 0); i < v->table->cap; i = khash_next(v->table, i + 1))
+        {
+            if (kval_holds(v->table->slots[i].val, h))
+            {
+                return 1;
+            }
+        }
+
+        return 0;
+
+    case KVAL_MAP:
+        return kmap_walk(v->map, kval_holds_entry, h);
+
+    case KVAL_SORTED:
+        return ksorted_range(v->sorted, NULL, NULL, kval_holds_sorted_entry, h);
+
+    // Lambdas with their bound arguments
+    case KVAL_FUN:
+        if (v->fun || v->rec)
+        {
+            return 0;
+        }
+
+        for (int i = 0; i < v->fenv->count; i++)
+        {
+            if (kval_holds(v->fenv->vals[i], h))
+            {
+                return 1;
+            }
+        }
+
+        return kval_holds(v->formals, h) || kval_holds(v->body, h);
+
+    case KVAL_RECORD:
+    case KVAL_QEXPR:
+    case KVAL_SEXPR:
+        if (v->pack != KPACK_NONE)
+        {
+            return 0;
+        }
+
+        for (int i = 0; i < v->count; i++)
+        {
+            if (kval_holds(v->cells[i], h))
+            {
+                return 1;
+            }
+        }
+
+        return 0;
+
+    default:
+        return 0;
+    }
+}
+
 // ###############
 //  Print        #
 // ###############
 void kval_println(kval *kv)
 {
     kval_print(kv);
-    putchar('\n');
+    kout_newline();
 }
 
 void kval_print(kval *kv)
@@ -579,15 +1719,52 @@ void kval_print(kval *kv)
     switch (kv->type)
     {
     case KVAL_NUM:
-        printf("%li", kv->num);
+        kout_long(kv->num);
+        break;
+
+    case KVAL_BIG:
+    {
+        char *digits = kbig_to_str(kv->big);
+        kout_puts(digits);
+        free(digits);
+        break;
+    }
+
+    case KVAL_DBL:
+        kout_double(kv->dbl);
+        break;
+
+    case KVAL_VEC:
+        kval_print_vec(kv->vec);
+        break;
+
+    case KVAL_MAT:
+        kval_print_mat(kv->mat);
+        break;
+
+    case KVAL_TABLE:
+        kval_print_table(kv->table);
+        break;
+
+    case KVAL_MAP:
+        kval_print_map(kv->map);
+        break;
+
+    case KVAL_SORTED:
+        kval_print_sorted(kv->sorted);
+        break;
+
+    case KVAL_SET:
+        kval_print_set(kv->set);
         break;
 
     case KVAL_ERR:
-        printf("Error: %s", kv->err);
+        kout_puts("Error: ");
+        kout_puts(kval_err_msg(kv));
         break;
 
     case KVAL_SYM:
-        printf("%s", kv->sym);
+        kout_puts(kv->sym);
         break;
 
     case KVAL_SEXPR:
@@ -595,6 +1772,7 @@ void kval_print(kval *kv)
         break;
 
     case KVAL_QEXPR:
+    case KVAL_RECORD:
         kval_print_expr(kv, '{', '}');
         break;
 
@@ -603,45 +1781,186 @@ void kval_print(kval *kv)
         break;
 
     case KVAL_FUN:
-        if (kv->fun)
+        if (kv->fun || kv->rec)
         {
-            printf("<builtin>");
+            kout_puts("<builtin>");
         }
         else
         {
-            printf("(\\ ");
+            kout_puts("(\\ ");
             kval_print(kv->formals);
-            putchar(' ');
+            kout_putc(' ');
             kval_print(kv->body);
-            putchar(')');
+            kout_putc(')');
         }
     }
 }
 
-void kval_print_str(kval *v)
+void kval_print_vec(kvec *v)
+{
+    kout_putc('[');
+
+    for (size_t i = 0; i < v->len; i++)
+    {
+        if (i)
+        {
+            kout_putc(' ');
+        }
+
+        if (v->kind == KVEC_F64)
+        {
+            kout_double(v->f64[i]);
+        }
+        else
+        {
+            kout_long(v->i64[i]);
+        }
+    }
+
+    kout_putc(']');
+}
+
+// A vector per row, [[1.0 2.0] [3.0 4.0]]
+void kval_print_mat(kmat *m)
+{
+    kout_putc('[');
+
+    for (size_t i = 0; i < m->rows; i++)
+    {
+        kout_puts(i ? " [" : "[");
+
+        for (size_t j = 0; j < m->cols; j++)
+        {
+            if (j)
+            {
+                kout_putc(' ');
+            }
+
+            kout_double(m->f64[i * m->cols + j]);
+        }
+
+        kout_putc(']');
+    }
+
+    kout_putc(']');
+}
+
+// Keys and values in turn, #{"a" 1 "b" 2}, in no particular order
+void kval_print_table(khash *h)
+{
+    kout_puts("#{");
+
+    int first = 1;
+    for (size_t i = khash_next(h, 0); i < h->cap; i = khash_next(h, i + 1))
+    {
+        if (!first)
+        {
+            kout_putc(' ');
+        }
+        first = 0;
+
+        kval_print(h->slots[i].key);
+        kout_putc(' ');
+        kval_print(h->slots[i].val);
+    }
+
+    kout_putc('}');
+}
+
+static int kval_print_entry(kval *key, kval *val, void *first)
+{
+    if (!*(int *)first)
+    {
+        kout_putc(' ');
+    }
+    *(int *)first = 0;
+
+    kval_print(key);
+    kout_putc(' ');
+    kval_print(val);
+
+    return 0;
+}
+
+// Like a table, #map{"a" 1 "b" 2}
+void kval_print_map(kmap *m)
+{
+    int first = 1;
+
+    kout_puts("#map{");
+    kmap_walk(m, kval_print_entry, &first);
+    kout_putc('}');
+}
+
+// The walk hands over its keys and values
+static int kval_print_sorted_entry(kval *key, kval *val, void *first)
+{
+    kval_print_entry(key, val, first);
+    kval_del(key);
+    kval_del(val);
+
+    return 0;
+}
+
+// In key order, #sorted{1 "a" 2 "b"}
+void kval_print_sorted(ksorted *t)
+{
+    int first = 1;
+
+    kout_puts("#sorted{");
+    ksorted_range(t, NULL, NULL, kval_print_sorted_entry, &first);
+    kout_putc('}');
+}
+
+static int kval_print_elem(kval *x, void *first)
 {
-    char *escaped = malloc(strlen(v->str) + 1);
-    strcpy(escaped, v->str);
+    if (!*(int *)first)
+    {
+        kout_putc(' ');
+    }
+    *(int *)first = 0;
+
+    kval_print(x);
+    return 0;
+}
 
-    escaped = mpcf_escape(escaped);
+// #set{1 2 3}, in increasing order while it's all small numbers
+void kval_print_set(kset *s)
+{
+    int first = 1;
 
-    printf("\"%s\"", escaped);
+    kout_puts("#set{");
+    kset_walk(s, kval_print_elem, &first);
+    kout_putc('}');
+}
 
-    free(escaped);
+void kval_print_str(kval *v)
+{
+    kout_escaped(kval_str_flat(v));
 }
 
 void kval_print_expr(kval *kv, char open, char close)
 {
-    putchar(open);
+    kout_putc(open);
     for (int i = 0; i < kv->count; i++)
     {
-
-        kval_print(kv->cells[i]);
+        if (kv->pack == KPACK_NUMS)
+        {
+            kout_long(kv->nums[i]);
+        }
+        else if (kv->pack == KPACK_STRS)
+        {
+            kout_escaped(kv->strs[i].str);
+        }
+        else
+        {
+            kval_print(kv->cells[i]);
+        }
 
         if (i != (kv->count - 1))
         {
-            putchar(' ');
+            kout_putc(' ');
         }
     }
-    putchar(close);
+    kout_putc(close);
 }
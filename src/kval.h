@@ -8,13 +8,61 @@
 //  Constructors #
 // ###############
 kval *kval_num(long num);
+kval *kval_big(kbig *b);
+kval *kval_dbl(double dbl);
+kval *kval_vec(kvec *v);
+kval *kval_mat(kmat *m);
+kval *kval_table(khash *h);
+kval *kval_map(kmap *m);
+kval *kval_sorted(ksorted *t);
+kval *kval_set(kset *s);
+kval *kval_record(krecord *r);
+kval *kval_record_fun(krecord *r, int slot);
 kval *kval_sym(char *s);
+kval *kval_sym_n(const char *s, size_t len);
+kval *kval_sym_lit(const char *s, size_t len);
 kval *kval_sexpr(void);
 kval *kval_qexpr(void);
 kval *kval_err(char *err, ...);
+kval *kval_err_kind(int code, char *err, ...);
+kval *kval_err_static(int code, const char *msg);
+kval *kval_error(int code);
 kval *kval_fun(kbuiltin func);
 kval *kval_lambda(kval *formals, kval *body);
 kval *kval_str(char *s);
+kval *kval_str_n(const char *s, size_t len);
+kval *kval_str_lit(const char *s, size_t len);
+kval *kval_str_alloc(size_t len);
+kval *kval_str_rope(krope *r);
+
+// ###############
+//  Numbers      #
+// ###############
+kbig *kval_to_big(kval *v);
+int kval_is_number(kval *v);
+double kval_to_double(kval *v);
+int kval_cmp_num(kval *x, kval *y);
+
+// ###############
+//  Strings      #
+// ###############
+char *kval_str_flat(kval *v);
+krope *kval_str_to_rope(kval *v);
+unsigned long kval_hash(kval *v);
+kval *kval_intern(kval *v);
+
+// ###############
+//  Packed Lists #
+// ###############
+kval *kval_pack(kval *v);
+kval *kval_unpack(kval *v);
+kval *kval_packed_join(kval *x, kval *y);
+kval *kval_packed_slice(kval *v, int start, int count);
+
+// ###############
+//  Errors       #
+// ###############
+const char *kval_err_msg(kval *v);
 
 // ###############
 //  Eval         #
@@ -44,6 +92,7 @@ kval *kval_join(kval *x, kval *y);
 kval *kval_copy(kval *v);
 kval *kval_call(kenv *e, kval *f, kval *a);
 int kval_eq(kval *x, kval *y);
+int kval_holds(kval *v, khash *h);
 
 // ###############
 //  Print        #
@@ -52,5 +101,11 @@ void kval_println(kval *kv);
 void kval_print(kval *kv);
 void kval_print_expr(kval *kv, char open, char close);
 void kval_print_str(kval *v);
+void kval_print_vec(kvec *v);
+void kval_print_mat(kmat *m);
+void kval_print_table(khash *h);
+void kval_print_map(kmap *m);
+void kval_print_sorted(ksorted *t);
+void kval_print_set(kset *s);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,707 @@
+#include <stdlib.h>
+#include <string.h>
+#include "kvec.h"
+#include "errors.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KVEC_X86 1
+#include <immintrin.h>
+#define KVEC_AVX2 __attribute__((target("avx2")))
+#endif
+
+int kvec_simd_enabled = 1;
+
+kvec *kvec_alloc(int kind, size_t len)
+{
+    kvec *v = malloc(sizeof(kvec) + len * sizeof(int64_t));
+
+    v->refs = 1;
+    v->kind = kind;
+    v->len = len;
+    v->i64 = (int64_t *)(v + 1);
+    v->f64 = (double *)(v + 1);
+
+    return v;
+}
+
+kvec *kvec_ref(kvec *v)
+{
+    v->refs++;
+    return v;
+}
+
+void kvec_unref(kvec *v)
+{
+    if (--v->refs == 0)
+    {
+        free(v);
+    }
+}
+
+kvec *kvec_to_f64(const kvec *v)
+{
+    kvec *r = kvec_alloc(KVEC_F64, v->len);
+
+    for (size_t i = 0; i < v->len; i++)
+    {
+        r->f64[i] = (double)v->i64[i];
+    }
+
+    return r;
+}
+
+// ###############
+//  Plain C      #
+// ###############
+
+// Stamps out the loop once per op, so the op isn't switched on per element
+#define KVEC_LOOP(expr)                     \
+    for (size_t i = 0; i < n; i++)          \
+    {                                       \
+        r[i] = expr;                        \
+    }
+
+static void kvec_f64_op_c(char op, double *r, const double *x, int xs, const double *y, int ys, size_t n)
+{
+    switch (op)
+    {
+    case '+':
+        KVEC_LOOP(x[i * xs] + y[i * ys]);
+        break;
+    case '-':
+        KVEC_LOOP(x[i * xs] - y[i * ys]);
+        break;
+    case '*':
+        KVEC_LOOP(x[i * xs] * y[i * ys]);
+        break;
+    case '/':
+        KVEC_LOOP(x[i * xs] / y[i * ys]);
+        break;
+    }
+}
+
+static int kvec_i64_op_c(char op, int64_t *r, const int64_t *x, int xs, const int64_t *y, int ys, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        int64_t a = x[i * xs];
+        int64_t b = y[i * ys];
+        int overflow = 0;
+
+        switch (op)
+        {
+        case '+':
+            overflow = __builtin_add_overflow(a, b, &r[i]);
+            break;
+        case '-':
+            overflow = __builtin_sub_overflow(a, b, &r[i]);
+            break;
+        case '*':
+            overflow = __builtin_mul_overflow(a, b, &r[i]);
+            break;
+        case '/':
+            if (b == 0)
+            {
+                return KERR_DIV_ZERO;
+            }
+
+            overflow = a == INT64_MIN && b == -1;
+            r[i] = overflow ? 0 : a / b;
+            break;
+        }
+
+        if (overflow)
+        {
+            return KERR_BAD_NUM;
+        }
+    }
+
+    return 0;
+}
+
+static void kvec_f64_cmp_c(int cmp, int64_t *r, const double *x, int xs, const double *y, int ys, size_t n)
+{
+    switch (cmp)
+    {
+    case KVEC_GT:
+        KVEC_LOOP(x[i * xs] > y[i * ys]);
+        break;
+    case KVEC_LT:
+        KVEC_LOOP(x[i * xs] < y[i * ys]);
+        break;
+    case KVEC_GE:
+        KVEC_LOOP(x[i * xs] >= y[i * ys]);
+        break;
+    case KVEC_LE:
+        KVEC_LOOP(x[i * xs] <= y[i * ys]);
+        break;
+    case KVEC_EQ:
+        KVEC_LOOP(x[i * xs] == y[i * ys]);
+        break;
+    }
+}
+
+static void kvec_i64_cmp_c(int cmp, int64_t *r, const int64_t *x, int xs, const int64_t *y, int ys, size_t n)
+{
+    switch (cmp)
+    {
+    case KVEC_GT:
+        KVEC_LOOP(x[i * xs] > y[i * ys]);
+        break;
+    case KVEC_LT:
+        KVEC_LOOP(x[i * xs] < y[i * ys]);
+        break;
+    case KVEC_GE:
+        KVEC_LOOP(x[i * xs] >= y[i * ys]);
+        break;
+    case KVEC_LE:
+        KVEC_LOOP(x[i * xs] <= y[i * ys]);
+        break;
+    case KVEC_EQ:
+        KVEC_LOOP(x[i * xs] == y[i * ys]);
+        break;
+    }
+}
+
+static double kvec_f64_sum_c(const double *x, size_t n)
+{
+    double s = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        s += x[i];
+    }
+
+    return s;
+}
+
+static double kvec_f64_dot_c(const double *x, const double *y, size_t n)
+{
+    double s = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        s += x[i] * y[i];
+    }
+
+    return s;
+}
+
+static double kvec_f64_extreme_c(const double *x, size_t n, int largest)
+{
+    double m = x[0];
+    for (size_t i = 1; i < n; i++)
+    {
+        if (largest ? x[i] > m : x[i] < m)
+        {
+            m = x[i];
+        }
+    }
+
+    return m;
+}
+
+static int kvec_i64_sum_c(const int64_t *x, size_t n, int64_t *out)
+{
+    int64_t s = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (__builtin_add_overflow(s, x[i], &s))
+        {
+            return KERR_BAD_NUM;
+        }
+    }
+
+    *out = s;
+    return 0;
+}
+
+static int64_t kvec_i64_extreme_c(const int64_t *x, size_t n, int largest)
+{
+    int64_t m = x[0];
+    for (size_t i = 1; i < n; i++)
+    {
+        if (largest ? x[i] > m : x[i] < m)
+        {
+            m = x[i];
+        }
+    }
+
+    return m;
+}
+
+// ###############
+//  AVX2         #
+// ###############
+#ifdef KVEC_X86
+
+// Four lanes at a time, leaving the last n % 4 to the plain C kernel
+#define KVEC_F64_LOOP(expr)                                        \
+    for (; i + 4 <= n; i += 4)                                     \
+    {                                                              \
+        __m256d a = xs ? _mm256_loadu_pd(x + i) : bx;              \
+        __m256d b = ys ? _mm256_loadu_pd(y + i) : by;              \
+        _mm256_storeu_pd(r + i, expr);                             \
+    }
+
+#define KVEC_I64_LOOP(expr)                                        \
+    for (; i + 4 <= n; i += 4)                                     \
+    {                                                              \
+        __m256i a = xs ? _mm256_loadu_si256((__m256i *)(x + i)) : bx; \
+        __m256i b = ys ? _mm256_loadu_si256((__m256i *)(y + i)) : by; \
+        _mm256_storeu_si256((__m256i *)(r + i), expr);             \
+    }
+
+// Comparisons give all ones lanes, masked down to 1
+#define KVEC_F64_MASK(pred)                                                  \
+    for (; i + 4 <= n; i += 4)                                               \
+    {                                                                        \
+        __m256d a = xs ? _mm256_loadu_pd(x + i) : bx;                        \
+        __m256d b = ys ? _mm256_loadu_pd(y + i) : by;                        \
+        __m256i m = _mm256_castpd_si256(_mm256_cmp_pd(a, b, pred));          \
+        _mm256_storeu_si256((__m256i *)(r + i), _mm256_and_si256(m, one));   \
+    }
+
+KVEC_AVX2 static void kvec_f64_op_avx2(char op, double *r, const double *x, int xs, const double *y, int ys, size_t n)
+{
+    __m256d bx = _mm256_set1_pd(x[0]);
+    __m256d by = _mm256_set1_pd(y[0]);
+    size_t i = 0;
+
+    switch (op)
+    {
+    case '+':
+        KVEC_F64_LOOP(_mm256_add_pd(a, b));
+        break;
+    case '-':
+        KVEC_F64_LOOP(_mm256_sub_pd(a, b));
+        break;
+    case '*':
+        KVEC_F64_LOOP(_mm256_mul_pd(a, b));
+        break;
+    case '/':
+        KVEC_F64_LOOP(_mm256_div_pd(a, b));
+        break;
+    }
+
+    kvec_f64_op_c(op, r + i, x + i * xs, xs, y + i * ys, ys, n - i);
+}
+
+// There is no 64 bit multiply or divide in AVX2, those stay in C
+KVEC_AVX2 static int kvec_i64_op_avx2(char op, int64_t *r, const int64_t *x, int xs, const int64_t *y, int ys, size_t n)
+{
+    if (op != '+' && op != '-')
+    {
+        return kvec_i64_op_c(op, r, x, xs, y, ys, n);
+    }
+
+    __m256i bx = _mm256_set1_epi64x(x[0]);
+    __m256i by = _mm256_set1_epi64x(y[0]);
+    size_t i = 0;
+
+    // Sign bits of the lanes that overflowed, checked once at the end
+    __m256i overflow = _mm256_setzero_si256();
+
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256i a = xs ? _mm256_loadu_si256((__m256i *)(x + i)) : bx;
+        __m256i b = ys ? _mm256_loadu_si256((__m256i *)(y + i)) : by;
+        __m256i s;
+
+        if (op == '+')
+        {
+            s = _mm256_add_epi64(a, b);
+            overflow = _mm256_or_si256(overflow, _mm256_and_si256(_mm256_xor_si256(a, s), _mm256_xor_si256(b, s)));
+        }
+        else
+        {
+            s = _mm256_sub_epi64(a, b);
+            overflow = _mm256_or_si256(overflow, _mm256_and_si256(_mm256_xor_si256(a, b), _mm256_xor_si256(a, s)));
+        }
+
+        _mm256_storeu_si256((__m256i *)(r + i), s);
+    }
+
+    if (_mm256_movemask_pd(_mm256_castsi256_pd(overflow)))
+    {
+        return KERR_BAD_NUM;
+    }
+
+    return kvec_i64_op_c(op, r + i, x + i * xs, xs, y + i * ys, ys, n - i);
+}
+
+KVEC_AVX2 static void kvec_f64_cmp_avx2(int cmp, int64_t *r, const double *x, int xs, const double *y, int ys, size_t n)
+{
+    __m256d bx = _mm256_set1_pd(x[0]);
+    __m256d by = _mm256_set1_pd(y[0]);
+    __m256i one = _mm256_set1_epi64x(1);
+    size_t i = 0;
+
+    switch (cmp)
+    {
+    case KVEC_GT:
+        KVEC_F64_MASK(_CMP_GT_OQ);
+        break;
+    case KVEC_LT:
+        KVEC_F64_MASK(_CMP_LT_OQ);
+        break;
+    case KVEC_GE:
+        KVEC_F64_MASK(_CMP_GE_OQ);
+        break;
+    case KVEC_LE:
+        KVEC_F64_MASK(_CMP_LE_OQ);
+        break;
+    case KVEC_EQ:
+        KVEC_F64_MASK(_CMP_EQ_OQ);
+        break;
+    }
+
+    kvec_f64_cmp_c(cmp, r + i, x + i * xs, xs, y + i * ys, ys, n - i);
+}
+
+KVEC_AVX2 static void kvec_i64_cmp_avx2(int cmp, int64_t *r, const int64_t *x, int xs, const int64_t *y, int ys, size_t n)
+{
+    __m256i bx = _mm256_set1_epi64x(x[0]);
+    __m256i by = _mm256_set1_epi64x(y[0]);
+    __m256i one = _mm256_set1_epi64x(1);
+    size_t i = 0;
+
+    // Only > and == exist, the rest are those swapped or negated
+    switch (cmp)
+    {
+    case KVEC_GT:
+        KVEC_I64_LOOP(_mm256_and_si256(_mm256_cmpgt_epi64(a, b), one));
+        break;
+    case KVEC_LT:
+        KVEC_I64_LOOP(_mm256_and_si256(_mm256_cmpgt_epi64(b, a), one));
+        break;
+    case KVEC_GE:
+        KVEC_I64_LOOP(_mm256_andnot_si256(_mm256_cmpgt_epi64(b, a), one));
+        break;
+    case KVEC_LE:
+        KVEC_I64_LOOP(_mm256_andnot_si256(_mm256_cmpgt_epi64(a, b), one));
+        break;
+    case KVEC_EQ:
+        KVEC_I64_LOOP(_mm256_and_si256(_mm256_cmpeq_epi64(a, b), one));
+        break;
+    }
+
+    kvec_i64_cmp_c(cmp, r + i, x + i * xs, xs, y + i * ys, ys, n - i);
+}
+
+// Horizontal sum of the four lanes
+KVEC_AVX2 static double kvec_hsum_avx2(__m256d v)
+{
+    double lanes[4];
+    _mm256_storeu_pd(lanes, v);
+
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+// Several accumulators, so the adds don't wait on each other
+KVEC_AVX2 static double kvec_f64_sum_avx2(const double *x, size_t n)
+{
+    __m256d s0 = _mm256_setzero_pd();
+    __m256d s1 = _mm256_setzero_pd();
+    __m256d s2 = _mm256_setzero_pd();
+    __m256d s3 = _mm256_setzero_pd();
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        s0 = _mm256_add_pd(s0, _mm256_loadu_pd(x + i));
+        s1 = _mm256_add_pd(s1, _mm256_loadu_pd(x + i + 4));
+        s2 = _mm256_add_pd(s2, _mm256_loadu_pd(x + i + 8));
+        s3 = _mm256_add_pd(s3, _mm256_loadu_pd(x + i + 12));
+    }
+
+    for (; i + 4 <= n; i += 4)
+    {
+        s0 = _mm256_add_pd(s0, _mm256_loadu_pd(x + i));
+    }
+
+    double s = kvec_hsum_avx2(_mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3)));
+    return s + kvec_f64_sum_c(x + i, n - i);
+}
+
+KVEC_AVX2 static double kvec_f64_dot_avx2(const double *x, const double *y, size_t n)
+{
+    __m256d s0 = _mm256_setzero_pd();
+    __m256d s1 = _mm256_setzero_pd();
+    __m256d s2 = _mm256_setzero_pd();
+    __m256d s3 = _mm256_setzero_pd();
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        s0 = _mm256_add_pd(s0, _mm256_mul_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i)));
+        s1 = _mm256_add_pd(s1, _mm256_mul_pd(_mm256_loadu_pd(x + i + 4), _mm256_loadu_pd(y + i + 4)));
+        s2 = _mm256_add_pd(s2, _mm256_mul_pd(_mm256_loadu_pd(x + i + 8), _mm256_loadu_pd(y + i + 8)));
+        s3 = _mm256_add_pd(s3, _mm256_mul_pd(_mm256_loadu_pd(x + i + 12), _mm256_loadu_pd(y + i + 12)));
+    }
+
+    for (; i + 4 <= n; i += 4)
+    {
+        s0 = _mm256_add_pd(s0, _mm256_mul_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i)));
+    }
+
+    double s = kvec_hsum_avx2(_mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3)));
+    return s + kvec_f64_dot_c(x + i, y + i, n - i);
+}
+
+KVEC_AVX2 static double kvec_f64_extreme_avx2(const double *x, size_t n, int largest)
+{
+    if (n < 4)
+    {
+        return kvec_f64_extreme_c(x, n, largest);
+    }
+
+    __m256d m = _mm256_loadu_pd(x);
+    size_t i = 4;
+
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256d a = _mm256_loadu_pd(x + i);
+        m = largest ? _mm256_max_pd(m, a) : _mm256_min_pd(m, a);
+    }
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, m);
+
+    double r = kvec_f64_extreme_c(lanes, 4, largest);
+    if (i < n)
+    {
+        double rest = kvec_f64_extreme_c(x + i, n - i, largest);
+        r = (largest ? rest > r : rest < r) ? rest : r;
+    }
+
+    return r;
+}
+
+KVEC_AVX2 static int kvec_i64_sum_avx2(const int64_t *x, size_t n, int64_t *out)
+{
+    __m256i s = _mm256_setzero_si256();
+    __m256i overflow = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256i a = _mm256_loadu_si256((__m256i *)(x + i));
+        __m256i t = _mm256_add_epi64(s, a);
+        overflow = _mm256_or_si256(overflow, _mm256_and_si256(_mm256_xor_si256(s, t), _mm256_xor_si256(a, t)));
+        s = t;
+    }
+
+    if (_mm256_movemask_pd(_mm256_castsi256_pd(overflow)))
+    {
+        return KERR_BAD_NUM;
+    }
+
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, s);
+
+    int64_t rest;
+    if (kvec_i64_sum_c(x + i, n - i, &rest))
+    {
+        return KERR_BAD_NUM;
+    }
+
+    for (int l = 0; l < 4; l++)
+    {
+        if (__builtin_add_overflow(rest, lanes[l], &rest))
+        {
+            return KERR_BAD_NUM;
+        }
+    }
+
+    *out = rest;
+    return 0;
+}
+
+KVEC_AVX2 static int64_t kvec_i64_extreme_avx2(const int64_t *x, size_t n, int largest)
+{
+    if (n < 4)
+    {
+        return kvec_i64_extreme_c(x, n, largest);
+    }
+
+    __m256i m = _mm256_loadu_si256((__m256i *)x);
+    size_t i = 4;
+
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256i a = _mm256_loadu_si256((__m256i *)(x + i));
+        __m256i take = largest ? _mm256_cmpgt_epi64(a, m) : _mm256_cmpgt_epi64(m, a);
+        m = _mm256_blendv_epi8(m, a, take);
+    }
+
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, m);
+
+    int64_t r = kvec_i64_extreme_c(lanes, 4, largest);
+    if (i < n)
+    {
+        int64_t rest = kvec_i64_extreme_c(x + i, n - i, largest);
+        r = (largest ? rest > r : rest < r) ? rest : r;
+    }
+
+    return r;
+}
+
+#endif
+
+// ###############
+//  Dispatch     #
+// ###############
+typedef struct
+{
+    void (*f64_op)(char op, double *r, const double *x, int xs, const double *y, int ys, size_t n);
+    int (*i64_op)(char op, int64_t *r, const int64_t *x, int xs, const int64_t *y, int ys, size_t n);
+    void (*f64_cmp)(int cmp, int64_t *r, const double *x, int xs, const double *y, int ys, size_t n);
+    void (*i64_cmp)(int cmp, int64_t *r, const int64_t *x, int xs, const int64_t *y, int ys, size_t n);
+    double (*f64_sum)(const double *x, size_t n);
+    double (*f64_dot)(const double *x, const double *y, size_t n);
+    double (*f64_extreme)(const double *x, size_t n, int largest);
+    int (*i64_sum)(const int64_t *x, size_t n, int64_t *out);
+    int64_t (*i64_extreme)(const int64_t *x, size_t n, int largest);
+} kvec_kernels;
+
+static const kvec_kernels kvec_kernels_c = {
+    kvec_f64_op_c,
+    kvec_i64_op_c,
+    kvec_f64_cmp_c,
+    kvec_i64_cmp_c,
+    kvec_f64_sum_c,
+    kvec_f64_dot_c,
+    kvec_f64_extreme_c,
+    kvec_i64_sum_c,
+    kvec_i64_extreme_c,
+};
+
+#ifdef KVEC_X86
+static const kvec_kernels kvec_kernels_avx2 = {
+    kvec_f64_op_avx2,
+    kvec_i64_op_avx2,
+    kvec_f64_cmp_avx2,
+    kvec_i64_cmp_avx2,
+    kvec_f64_sum_avx2,
+    kvec_f64_dot_avx2,
+    kvec_f64_extreme_avx2,
+    kvec_i64_sum_avx2,
+    kvec_i64_extreme_avx2,
+};
+#endif
+
+static const kvec_kernels *kvec_kernels_get(void)
+{
+#ifdef KVEC_X86
+    // Asked once, the answer can't change under us
+    static int avx2 = -1;
+    if (avx2 < 0)
+    {
+        __builtin_cpu_init();
+        avx2 = __builtin_cpu_supports("avx2") != 0;
+    }
+
+    if (avx2 && kvec_simd_enabled)
+    {
+        return &kvec_kernels_avx2;
+    }
+#endif
+
+    return &kvec_kernels_c;
+}
+
+void kvec_f64_op(char op, double *r, const double *x, int xs, const double *y, int ys, size_t n)
+{
+    if (n)
+    {
+        kvec_kernels_get()->f64_op(op, r, x, xs, y, ys, n);
+    }
+}
+
+int kvec_i64_op(char op, int64_t *r, const int64_t *x, int xs, const int64_t *y, int ys, size_t n)
+{
+    return n ? kvec_kernels_get()->i64_op(op, r, x, xs, y, ys, n) : 0;
+}
+
+void kvec_f64_cmp(int cmp, int64_t *r, const double *x, int xs, const double *y, int ys, size_t n)
+{
+    if (n)
+    {
+        kvec_kernels_get()->f64_cmp(cmp, r, x, xs, y, ys, n);
+    }
+}
+
+void kvec_i64_cmp(int cmp, int64_t *r, const int64_t *x, int xs, const int64_t *y, int ys, size_t n)
+{
+    if (n)
+    {
+        kvec_kernels_get()->i64_cmp(cmp, r, x, xs, y, ys, n);
+    }
+}
+
+double kvec_f64_sum(const double *x, size_t n)
+{
+    return kvec_kernels_get()->f64_sum(x, n);
+}
+
+double kvec_f64_product(const double *x, size_t n)
+{
+    double p = 1;
+    for (size_t i = 0; i < n; i++)
+    {
+        p *= x[i];
+    }
+
+    return p;
+}
+
+double kvec_f64_dot(const double *x, const double *y, size_t n)
+{
+    return kvec_kernels_get()->f64_dot(x, y, n);
+}
+
+int kvec_i64_sum(const int64_t *x, size_t n, int64_t *out)
+{
+    return kvec_kernels_get()->i64_sum(x, n, out);
+}
+
+int kvec_i64_product(const int64_t *x, size_t n, int64_t *out)
+{
+    int64_t p = 1;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (__builtin_mul_overflow(p, x[i], &p))
+        {
+            return KERR_BAD_NUM;
+        }
+    }
+
+    *out = p;
+    return 0;
+}
+
+int kvec_i64_dot(const int64_t *x, const int64_t *y, size_t n, int64_t *out)
+{
+    int64_t s = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        int64_t p;
+        if (__builtin_mul_overflow(x[i], y[i], &p) || __builtin_add_overflow(s, p, &s))
+        {
+            return KERR_BAD_NUM;
+        }
+    }
+
+    *out = s;
+    return 0;
+}
+
+double kvec_f64_extreme(const double *x, size_t n, int largest)
+{
+    return kvec_kernels_get()->f64_extreme(x, n, largest);
+}
+
+int64_t kvec_i64_extreme(const int64_t *x, size_t n, int largest)
+{
+    return kvec_kernels_get()->i64_extreme(x, n, largest);
+}
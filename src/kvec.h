@@ -0,0 +1,80 @@
+#ifndef kvec_h
+#define kvec_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "types.h"
+
+/*
+    Packed numeric vectors.
+
+    A flat array of 64 bit integers or doubles, rather than a Q-Expression
+    of boxed kvals, so the builtins over them run as tight loops. Those
+    loops are picked once at runtime: AVX2 kernels when the CPU has it,
+    plain C otherwise. Like big numbers they are immutable and reference
+    counted, except that an op may write its result over an operand
+    nothing else holds.
+*/
+enum
+{
+    KVEC_I64,
+    KVEC_F64
+};
+
+// Comparisons, giving a mask of 0s and 1s
+enum
+{
+    KVEC_GT,
+    KVEC_LT,
+    KVEC_GE,
+    KVEC_LE,
+    KVEC_EQ
+};
+
+struct kvec
+{
+    int refs;
+    int kind;
+    size_t len;
+
+    // Both point at the same elements, after the header
+    int64_t *i64;
+    double *f64;
+};
+
+// Cleared by the --no-simd command line flag, for the plain C kernels
+extern int kvec_simd_enabled;
+
+kvec *kvec_alloc(int kind, size_t len);
+kvec *kvec_ref(kvec *v);
+void kvec_unref(kvec *v);
+
+// A double copy of an integer vector
+kvec *kvec_to_f64(const kvec *v);
+
+/*
+    Elementwise r = x op y, op one of '+', '-', '*' or '/'. A stride of 0
+    repeats the first element, for a scalar on either side. r may be x or y.
+    Integer kernels return KERR_BAD_NUM on overflow and KERR_DIV_ZERO, 0
+    when all went well.
+*/
+void kvec_f64_op(char op, double *r, const double *x, int xs, const double *y, int ys, size_t n);
+int kvec_i64_op(char op, int64_t *r, const int64_t *x, int xs, const int64_t *y, int ys, size_t n);
+
+// Masks for x cmp y, with the same strides
+void kvec_f64_cmp(int cmp, int64_t *r, const double *x, int xs, const double *y, int ys, size_t n);
+void kvec_i64_cmp(int cmp, int64_t *r, const int64_t *x, int xs, const int64_t *y, int ys, size_t n);
+
+// Reductions, the integer ones return KERR_BAD_NUM on overflow
+double kvec_f64_sum(const double *x, size_t n);
+double kvec_f64_product(const double *x, size_t n);
+double kvec_f64_dot(const double *x, const double *y, size_t n);
+int kvec_i64_sum(const int64_t *x, size_t n, int64_t *out);
+int kvec_i64_product(const int64_t *x, size_t n, int64_t *out);
+int kvec_i64_dot(const int64_t *x, const int64_t *y, size_t n, int64_t *out);
+
+// Smallest or largest element, n must not be 0
+double kvec_f64_extreme(const double *x, size_t n, int largest);
+int64_t kvec_i64_extreme(const int64_t *x, size_t n, int largest);
+
+#endif
@@ -0,0 +1,163 @@
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "loader.h"
+#include "kval.h"
+#include "reader.h"
+#include "parser.h"
+
+int kload_jobs = 0;
+
+struct kloader
+{
+    char **files;
+    int count;
+
+    // Parsed files waiting to be evaluated, NULL until ready
+    kval **results;
+
+    int next;
+    int taken;
+    int window;
+    int stop;
+
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_cond_t space;
+
+    int jobs;
+    pthread_t *threads;
+};
+
+static void *kloader_work(void *arg)
+{
+    kloader *l = arg;
+
+    pthread_mutex_lock(&l->lock);
+    while (1)
+    {
+        // Do not run too far ahead of evaluation, parsed files hold memory
+        while (!l->stop && l->next < l->count && l->next >= l->taken + l->window)
+        {
+            pthread_cond_wait(&l->space, &l->lock);
+        }
+
+        if (l->stop || l->next >= l->count)
+        {
+            break;
+        }
+
+        int i = l->next++;
+        pthread_mutex_unlock(&l->lock);
+
+        kval *x = kread_use_mpc
+                      ? parser_read_file(l->files[i])
+                      : kread_file(l->files[i]);
+
+        pthread_mutex_lock(&l->lock);
+        l->results[i] = x;
+        pthread_cond_broadcast(&l->ready);
+    }
+    pthread_mutex_unlock(&l->lock);
+
+    return NULL;
+}
+
+// Number of workers to use for `count` files
+int kloader_jobs(int jobs, int count)
+{
+    if (jobs <= 0)
+    {
+        jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+
+    if (jobs > count)
+    {
+        jobs = count;
+    }
+
+    return jobs < 1 ? 1 : jobs;
+}
+
+kloader *kloader_start(char **files, int count, int jobs)
+{
+    jobs = kloader_jobs(jobs, count);
+
+    // The mpc grammar must exist before any worker shares it
+    if (kread_use_mpc)
+    {
+        parser_init();
+    }
+
+    kloader *l = malloc(sizeof(kloader));
+    l->files = files;
+    l->count = count;
+    l->results = calloc(count, sizeof(kval *));
+    l->next = 0;
+    l->taken = 0;
+    l->window = jobs;
+    l->stop = 0;
+
+    pthread_mutex_init(&l->lock, NULL);
+    pthread_cond_init(&l->ready, NULL);
+    pthread_cond_init(&l->space, NULL);
+
+    l->jobs = jobs;
+    l->threads = malloc(sizeof(pthread_t) * jobs);
+    for (int i = 0; i < jobs; i++)
+    {
+        pthread_create(&l->threads[i], NULL, kloader_work, l);
+    }
+
+    return l;
+}
+
+kval *kloader_take(kloader *l, int i)
+{
+    pthread_mutex_lock(&l->lock);
+
+    while (!l->results[i])
+    {
+        pthread_cond_wait(&l->ready, &l->lock);
+    }
+
+    kval *x = l->results[i];
+    l->results[i] = NULL;
+    l->taken = i + 1;
+
+    pthread_cond_broadcast(&l->space);
+    pthread_mutex_unlock(&l->lock);
+
+    return x;
+}
+
+void kloader_stop(kloader *l)
+{
+    pthread_mutex_lock(&l->lock);
+    l->stop = 1;
+    pthread_cond_broadcast(&l->space);
+    pthread_mutex_unlock(&l->lock);
+
+    for (int i = 0; i < l->jobs; i++)
+    {
+        pthread_join(l->threads[i], NULL);
+    }
+
+    for (int i = 0; i < l->count; i++)
+    {
+        if (l->results[i])
+        {
+            kval_del(l->results[i]);
+        }
+    }
+
+    pthread_mutex_destroy(&l->lock);
+    pthread_cond_destroy(&l->ready);
+    pthread_cond_destroy(&l->space);
+
+    free(l->threads);
+    free(l->results);
+    free(l);
+}
@@ -0,0 +1,24 @@
+#ifndef loader_h
+#define loader_h
+
+#include "types.h"
+
+/*
+    Parses the files given on the command line on a pool of worker
+    threads, while the main thread evaluates them strictly in order.
+    Workers stay at most `jobs` files ahead of evaluation.
+*/
+typedef struct kloader kloader;
+
+// Set by the --jobs command line flag, 0 means one per CPU
+extern int kload_jobs;
+
+int kloader_jobs(int jobs, int count);
+kloader *kloader_start(char **files, int count, int jobs);
+
+// Blocks until file i is parsed. Returns its forms as an S-Expression, or an Error
+kval *kloader_take(kloader *l, int i);
+
+void kloader_stop(kloader *l);
+
+#endif
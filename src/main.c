@@ -11,91 +11,186 @@
 #include "kenv.h"
 #include "quotes.h"
 #include "parser.h"
+#include "reader.h"
+#include "loader.h"
+#include "kimage.h"
+#include "kbuf.h"
+#include "kout.h"
+#include "kintern.h"
+#include "kvec.h"
 #include "builtin.h"
 
+#ifdef KOVACS_EMBED_STDLIB
+// Generated at build time by --emit-stdlib, see scripts/build.sh
+extern const char kovacs_stdlib[];
+extern const size_t kovacs_stdlib_len;
+#endif
+
+// Run a file in a fresh environment and print the result as a C translation unit defining kovacs_stdlib
+static int emit_stdlib(char *path)
+{
+    kenv *e = kenv_init();
+    kenv_add_builtins(e);
+
+    kval *x = builtin_load(e, kval_add(kval_sexpr(), kval_str(path)));
+    if (x->type == KVAL_ERR)
+    {
+        kval_println(x);
+        return 1;
+    }
+    kval_del(x);
+
+    kbuf b;
+    kbuf_init(&b);
+    kimage_encode(&b, e);
+
+    printf("/* Generated from %s by scripts/build.sh, do not edit */\n", path);
+    printf("#include <stddef.h>\n\n");
+    printf("const char kovacs_stdlib[] = {");
+
+    for (size_t i = 0; i < b.len; i++)
+    {
+        printf(i % 16 ? " %d," : "\n    %d,", (signed char)b.data[i]);
+    }
+
+    printf("\n};\n\nconst size_t kovacs_stdlib_len = %zu;\n", b.len);
+
+    kbuf_free(&b);
+    kenv_del(e);
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
-    Number = mpc_new("number");
-    Symbol = mpc_new("symbol");
-    Sexpr = mpc_new("sexpr");
-    Expr = mpc_new("expr");
-    Kovacs = mpc_new("kovacs");
-    Qexpr = mpc_new("qexpr");
-    String = mpc_new("string");
-    Comment = mpc_new("comment");
-
-    mpca_lang(
-        MPCA_LANG_DEFAULT,
-        "                                                                               \
-            number  : /-?[0-9]+/ ;                                                      \
-            symbol  : /[a-zA-Z0-9_+\\-*\\/\\\\=<>!&]+/ ;                                \
-            sexpr   : '(' <expr>* ')' ;                                                 \
-            qexpr   : '{' <expr>* '}' ;                                                 \
-            expr    : <number> | <symbol> | <sexpr> | <qexpr> | <string> | <comment>;   \
-            kovacs  : /^/ <expr>+ /$/ ;                                                 \
-            string  : /\"(\\\\.|[^\"])*\"/ ;                                            \
-            comment : /;[^\\r\\n]*/ ;                                                   \
-        ",
-        Number, Symbol, Sexpr, Qexpr, Expr, Kovacs, String, Comment);
+    kout_init();
+
+    // Options come first, everything else is a file to run
+    char *image = NULL;
+    char *save_image = NULL;
+
+    int first_file = 1;
+    while (first_file < argc && strncmp(argv[first_file], "--", 2) == 0)
+    {
+        if (strcmp(argv[first_file], "--mpc") == 0)
+        {
+            kread_use_mpc = 1;
+        }
+        else if (strcmp(argv[first_file], "--no-cache") == 0)
+        {
+            kcache_enabled = 0;
+        }
+        else if (strcmp(argv[first_file], "--no-intern") == 0)
+        {
+            kintern_enabled = 0;
+        }
+        else if (strcmp(argv[first_file], "--no-simd") == 0)
+        {
+            kvec_simd_enabled = 0;
+        }
+        else if (strcmp(argv[first_file], "--jobs") == 0 && first_file + 1 < argc)
+        {
+            kload_jobs = atoi(argv[++first_file]);
+        }
+        else if (strcmp(argv[first_file], "--image") == 0 && first_file + 1 < argc)
+        {
+            image = argv[++first_file];
+        }
+        else if (strcmp(argv[first_file], "--save-image") == 0 && first_file + 1 < argc)
+        {
+            save_image = argv[++first_file];
+        }
+        else if (strcmp(argv[first_file], "--emit-stdlib") == 0 && first_file + 1 < argc)
+        {
+            return emit_stdlib(argv[first_file + 1]);
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option: %s\n", argv[first_file]);
+            return 1;
+        }
+
+        first_file++;
+    }
 
     puts("Kovacs Version 0.1");
     print_altered_carbon_quote();
     puts("Press Crtl+C to Exit\n");
 
-    // Build REPL Environment
+    // Build REPL Environment, from a saved image, the stdlib built into the binary, or stdlib.k
     kenv *e = kenv_init();
-    kenv_add_builtins(e);
 
-    char cwd[256];
-    if (getcwd(cwd, sizeof(cwd)) == NULL)
+    if (image)
     {
-        perror("getcwd() error");
-        return 1;
+        kval *x = kimage_load(e, image);
+        if (x->type == KVAL_ERR)
+        {
+            kval_println(x);
+            return 1;
+        }
+
+        kval_del(x);
     }
+    else
+    {
+#ifdef KOVACS_EMBED_STDLIB
+        kval_del(kimage_decode(e, kovacs_stdlib, kovacs_stdlib_len));
+#else
+        kenv_add_builtins(e);
 
-    char *stdlib_filepath = strcat(cwd, "/stdlib.k");
+        char cwd[256];
+        if (getcwd(cwd, sizeof(cwd)) == NULL)
+        {
+            perror("getcwd() error");
+            return 1;
+        }
 
-    kval *standard_libararies = kval_add(kval_sexpr(), kval_str(stdlib_filepath));
-    builtin_load(e, standard_libararies);
+        char *stdlib_filepath = strcat(cwd, "/stdlib.k");
 
-    // If there is only one argument, open the REPL
-    if (argc == 1)
+        kval *standard_libararies = kval_add(kval_sexpr(), kval_str(stdlib_filepath));
+        kval_del(builtin_load(e, standard_libararies));
+#endif
+    }
+
+    // If there are no files, open the REPL
+    if (first_file == argc && !save_image)
     {
         while (1)
         {
             // Prompt
+            kout_flush();
             char *input = readline("kovacs> ");
 
             // Give the REPL history, allowing a better UX
             add_history(input);
 
-            // Parse input into result
-            mpc_result_t result;
-            if (mpc_parse("<stdin>", input, Kovacs, &result)) // Passes r via memory address to be written directly to
-            {
-                // Uncomment below if you want to print parser results
-                // mpc_ast_print(result.output);
+            // Read the whole line as one S-Expression
+            kval *expr = kread_use_mpc
+                             ? parser_read("<stdin>", input)
+                             : kread("<stdin>", input, strlen(input));
 
-                kval *x = kval_eval(e, kval_read(result.output));
-                kval_println(x);
-                kval_del(x);
-
-                mpc_ast_delete(result.output);
+            if (expr->type == KVAL_ERR)
+            {
+                kout_puts(kval_err_msg(expr));
+                kout_newline();
+                kval_del(expr);
             }
             else
             {
-                mpc_err_print(result.error);
-                mpc_err_delete(result.error);
+                kval *x = kval_eval(e, expr);
+                kval_println(x);
+                kval_del(x);
             }
 
             free(input);
         }
     }
 
-    // If there is more than one argument, it's probably files to run
-    if (argc >= 2)
+    // Otherwise run the files in order, parsing ahead on other threads when there are several
+    int file_count = argc - first_file;
+
+    if (kloader_jobs(kload_jobs, file_count) == 1)
     {
-        for (int i = 1; i < argc; i++)
+        for (int i = first_file; i < argc; i++)
         {
 
             kval *file_arguments = kval_add(kval_sexpr(), kval_str(argv[i]));
@@ -109,9 +204,32 @@ int main(int argc, char **argv)
             kval_del(x);
         }
     }
+    else
+    {
+        kloader *l = kloader_start(argv + first_file, file_count, kload_jobs);
+
+        for (int i = 0; i < file_count; i++)
+        {
+            kval *x = builtin_load_forms(e, kloader_take(l, i));
+            if (x->type == KVAL_ERR)
+            {
+                kval_println(x);
+            }
+
+            kval_del(x);
+        }
+
+        kloader_stop(l);
+    }
+
+    if (save_image && !kimage_save(e, save_image))
+    {
+        fprintf(stderr, "Could not save image %s\n", save_image);
+        return 1;
+    }
 
     kenv_del(e);
-    mpc_cleanup(8, Number, Symbol, Sexpr, Qexpr, Expr, Kovacs, String, Comment);
+    parser_cleanup();
 
     return 0;
 }
@@ -0,0 +1,96 @@
+#include "parser.h"
+#include "kval.h"
+
+mpc_parser_t *Number;
+mpc_parser_t *Symbol;
+mpc_parser_t *String;
+mpc_parser_t *Comment;
+mpc_parser_t *Sexpr;
+mpc_parser_t *Qexpr;
+mpc_parser_t *Expr;
+mpc_parser_t *Kovacs;
+
+void parser_init(void)
+{
+    if (Kovacs)
+    {
+        return;
+    }
+
+    Number = mpc_new("number");
+    Symbol = mpc_new("symbol");
+    Sexpr = mpc_new("sexpr");
+    Expr = mpc_new("expr");
+    Kovacs = mpc_new("kovacs");
+    Qexpr = mpc_new("qexpr");
+    String = mpc_new("string");
+    Comment = mpc_new("comment");
+
+    mpca_lang(
+        MPCA_LANG_DEFAULT,
+        "                                                                               \
+            number  : /-?[0-9]+(\\.[0-9]+([eE][-+]?[0-9]+)?)?/ ;                          \
+            symbol  : /[a-zA-Z0-9_+\\-*\\/\\\\=<>!&]+/ ;                                \
+            sexpr   : '(' <expr>* ')' ;                                                 \
+            qexpr   : '{' <expr>* '}' ;                                                 \
+            expr    : <number> | <symbol> | <sexpr> | <qexpr> | <string> | <comment>;   \
+            kovacs  : /^/ <expr>+ /$/ ;                                                 \
+            string  : /\"(\\\\.|[^\"])*\"/ ;                                            \
+            comment : /;[^\\r\\n]*/ ;                                                   \
+        ",
+        Number, Symbol, Sexpr, Qexpr, Expr, Kovacs, String, Comment);
+}
+
+void parser_cleanup(void)
+{
+    if (!Kovacs)
+    {
+        return;
+    }
+
+    mpc_cleanup(8, Number, Symbol, Sexpr, Qexpr, Expr, Kovacs, String, Comment);
+    Kovacs = NULL;
+}
+
+// Parse a string with mpc and convert the AST into an S-Expression of forms
+kval *parser_read(const char *filename, const char *input)
+{
+    parser_init();
+
+    mpc_result_t r;
+    if (mpc_parse(filename, input, Kovacs, &r))
+    {
+        kval *x = kval_read(r.output);
+        mpc_ast_delete(r.output);
+        return x;
+    }
+
+    char *err_msg = mpc_err_string(r.error);
+    mpc_err_delete(r.error);
+
+    kval *err = kval_err("%s", err_msg);
+    free(err_msg);
+
+    return err;
+}
+
+kval *parser_read_file(const char *filename)
+{
+    parser_init();
+
+    mpc_result_t r;
+    if (mpc_parse_contents(filename, Kovacs, &r))
+    {
+        kval *x = kval_read(r.output);
+        mpc_ast_delete(r.output);
+        return x;
+    }
+
+    char *err_msg = mpc_err_string(r.error);
+    mpc_err_delete(r.error);
+
+    kval *err = kval_err("%s", err_msg);
+    free(err_msg);
+
+    return err;
+}
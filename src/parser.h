@@ -1,10 +1,31 @@
+#ifndef parser_h
+#define parser_h
+
 #include "mpc.h"
+#include "types.h"
+
+extern mpc_parser_t *Number;
+extern mpc_parser_t *Symbol;
+extern mpc_parser_t *String;
+extern mpc_parser_t *Comment;
+extern mpc_parser_t *Sexpr;
+extern mpc_parser_t *Qexpr;
+extern mpc_parser_t *Expr;
+extern mpc_parser_t *Kovacs;
+
+/*
+    The mpc grammar is only the fallback reader now (see reader.h),
+    so it is compiled lazily the first time it is needed.
+
+    parser_init is not thread safe, call it before starting any threads.
+    After that the grammar is only ever read, and every mpc_parse call
+    keeps its own input state, so parser_read/parser_read_file can run
+    on several threads at once.
+*/
+void parser_init(void);
+void parser_cleanup(void);
+
+kval *parser_read(const char *filename, const char *input);
+kval *parser_read_file(const char *filename);
 
-mpc_parser_t *Number;
-mpc_parser_t *Symbol;
-mpc_parser_t *String;
-mpc_parser_t *Comment;
-mpc_parser_t *Sexpr;
-mpc_parser_t *Qexpr;
-mpc_parser_t *Expr;
-mpc_parser_t *Kovacs;
\ No newline at end of file
+#endif
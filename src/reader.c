@@ -0,0 +1,781 @@
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "reader.h"
+#include "kval.h"
+#include "errors.h"
+#include "kcache.h"
+#include "kbig.h"
+
+int kread_use_mpc = 0;
+
+static kval *kreader_form(kreader *r);
+
+// ###############
+//  Helpers      #
+// ###############
+
+// Matches the mpc symbol regex: [a-zA-Z0-9_+\-*/\\=<>!&]
+static int is_symbol_char(unsigned char c)
+{
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))
+    {
+        return 1;
+    }
+
+    switch (c)
+    {
+    case '_':
+    case '+':
+    case '-':
+    case '*':
+    case '/':
+    case '\\':
+    case '=':
+    case '<':
+    case '>':
+    case '!':
+    case '&':
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static int is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+// Records a syntax error with its line and column, and stops the reader
+static kval *kreader_error(kreader *r, const char *at, const char *msg)
+{
+    int line = r->line + 1;
+    const char *line_start = r->src;
+
+    for (const char *p = r->src; p < at; p++)
+    {
+        if (*p == '\n')
+        {
+            line++;
+            line_start = p + 1;
+        }
+    }
+
+    r->error = kval_err("%s:%i:%i: error: %s",
+                        r->filename, line, (int)(at - line_start) + 1, msg);
+    r->cur = r->end;
+
+    return NULL;
+}
+
+// Skip whitespace and ';' comments
+static void kreader_skip(kreader *r)
+{
+    const char *p = r->cur;
+
+    while (p < r->end)
+    {
+        switch (*p)
+        {
+        case ' ':
+        case '\t':
+        case '\n':
+        case '\r':
+        case '\f':
+        case '\v':
+            p++;
+            break;
+
+        case ';':
+        {
+            const char *nl = memchr(p, '\n', r->end - p);
+            p = nl ? nl + 1 : r->end;
+            break;
+        }
+
+        default:
+            r->cur = p;
+            return;
+        }
+    }
+
+    r->cur = p;
+}
+
+// In-place version of mpcf_unescape. Unknown escapes are kept as written.
+static void unescape(char *s)
+{
+    char *out = s;
+
+    while (*s)
+    {
+        if (*s != '\\' || s[1] == '\0')
+        {
+            *out++ = *s++;
+            continue;
+        }
+
+        char c;
+        switch (s[1])
+        {
+        case 'a':
+            c = '\a';
+            break;
+        case 'b':
+            c = '\b';
+            break;
+        case 'f':
+            c = '\f';
+            break;
+        case 'n':
+            c = '\n';
+            break;
+        case 'r':
+            c = '\r';
+            break;
+        case 't':
+            c = '\t';
+            break;
+        case 'v':
+            c = '\v';
+            break;
+        case '\\':
+        case '\'':
+        case '"':
+            c = s[1];
+            break;
+        case '0':
+            c = '\0';
+            break;
+        default:
+            *out++ = *s++;
+            continue;
+        }
+
+        *out++ = c;
+        s += 2;
+    }
+
+    *out = '\0';
+}
+
+// ###############
+//  Forms        #
+// ###############
+static kval *kreader_number(kreader *r)
+{
+    const char *p = r->cur;
+    int negative = *p == '-';
+    if (negative)
+    {
+        p++;
+    }
+
+    // Accumulate as unsigned so LONG_MIN still fits
+    unsigned long limit = negative ? (unsigned long)LONG_MAX + 1 : (unsigned long)LONG_MAX;
+    unsigned long n = 0;
+    int out_of_range = 0;
+
+    while (p < r->end && is_digit(*p))
+    {
+        unsigned long d = *p - '0';
+        if (n > (limit - d) / 10)
+        {
+            out_of_range = 1;
+        }
+
+        n = n * 10 + d;
+        p++;
+    }
+
+    const char *start = r->cur;
+
+    // A fraction makes it a double, with an optional exponent after it
+    if (p + 1 < r->end && *p == '.' && is_digit(p[1]))
+    {
+        p++;
+        while (p < r->end && is_digit(*p))
+        {
+            p++;
+        }
+
+        const char *e = p;
+        if (e < r->end && (*e == 'e' || *e == 'E'))
+        {
+            e++;
+            if (e < r->end && (*e == '+' || *e == '-'))
+            {
+                e++;
+            }
+
+            if (e < r->end && is_digit(*e))
+            {
+                while (e < r->end && is_digit(*e))
+                {
+                    e++;
+                }
+                p = e;
+            }
+        }
+
+        // The source isn't NUL terminated, so strtod gets a copy
+        char small[64];
+        size_t len = p - start;
+        char *text = len < sizeof(small) ? small : malloc(len + 1);
+        memcpy(text, start, len);
+        text[len] = '\0';
+
+        kval *d = kval_dbl(strtod(text, NULL));
+        if (text != small)
+        {
+            free(text);
+        }
+
+        r->cur = p;
+        return d;
+    }
+
+    r->cur = p;
+
+    if (out_of_range)
+    {
+        return kval_big(kbig_from_str(start, p - start));
+    }
+
+    return kval_num(negative ? (long)(0 - n) : (long)n);
+}
+
+static kval *kreader_symbol(kreader *r)
+{
+    const char *start = r->cur;
+    const char *p = start;
+
+    while (p < r->end && is_symbol_char(*p))
+    {
+        p++;
+    }
+
+    r->cur = p;
+    return kval_sym_lit(start, p - start);
+}
+
+static kval *kreader_string(kreader *r)
+{
+    const char *open = r->cur;
+    const char *start = open + 1;
+    const char *p = start;
+    int escaped = 0;
+
+    // Jump between quotes, only stepping over a quote when a backslash precedes it
+    while (1)
+    {
+        const char *q = memchr(p, '"', r->end - p);
+        if (!q)
+        {
+            return kreader_error(r, open, "unterminated string");
+        }
+
+        const char *b = memchr(p, '\\', q - p);
+        if (!b)
+        {
+            p = q;
+            break;
+        }
+
+        escaped = 1;
+        p = b + 2;
+        if (p > r->end)
+        {
+            return kreader_error(r, open, "unterminated string");
+        }
+    }
+
+    r->cur = p + 1;
+
+    // Literals never change, every copy can share the interned bytes
+    if (!escaped)
+    {
+        return kval_str_lit(start, p - start);
+    }
+
+    kval *x = kval_str_n(start, p - start);
+    unescape(x->str);
+    x->len = strlen(x->str);
+
+    return kval_intern(x);
+}
+
+static kval *kreader_list(kreader *r, kval *x, char close)
+{
+    const char *open = r->cur++;
+
+    // Collect into a growing array, so big lists are not realloc'd per cell
+    int count = 0;
+    int cap = 0;
+    kval **cells = NULL;
+
+    while (1)
+    {
+        kreader_skip(r);
+
+        if (r->cur == r->end)
+        {
+            kreader_error(r, open, close == ')' ? "unmatched '('" : "unmatched '{'");
+            break;
+        }
+
+        if (*r->cur == close)
+        {
+            r->cur++;
+
+            x->count = count;
+            x->cells = realloc(cells, sizeof(kval *) * count);
+            return kval_pack(x);
+        }
+
+        if (*r->cur == ')' || *r->cur == '}')
+        {
+            kreader_error(r, r->cur, *r->cur == ')' ? "unexpected ')'" : "unexpected '}'");
+            break;
+        }
+
+        kval *y = kreader_form(r);
+        if (!y)
+        {
+            break;
+        }
+
+        if (count == cap)
+        {
+            cap = cap ? cap * 2 : 4;
+            cells = realloc(cells, sizeof(kval *) * cap);
+        }
+
+        cells[count++] = y;
+    }
+
+    x->count = count;
+    x->cells = cells;
+    kval_del(x);
+
+    return NULL;
+}
+
+static kval *kreader_form(kreader *r)
+{
+    const char *p = r->cur;
+
+    switch (*p)
+    {
+    case '(':
+        return kreader_list(r, kval_sexpr(), ')');
+
+    case '{':
+        return kreader_list(r, kval_qexpr(), '}');
+
+    case '"':
+        return kreader_string(r);
+
+    case ')':
+        return kreader_error(r, p, "unexpected ')'");
+
+    case '}':
+        return kreader_error(r, p, "unexpected '}'");
+    }
+
+    // Numbers win over symbols, exactly as in the mpc grammar
+    if (is_digit(*p) || (*p == '-' && p + 1 < r->end && is_digit(p[1])))
+    {
+        return kreader_number(r);
+    }
+
+    if (is_symbol_char(*p))
+    {
+        return kreader_symbol(r);
+    }
+
+    return kreader_error(r, p, "unexpected character");
+}
+
+// ###############
+//  Streaming    #
+// ###############
+#define KREADER_CHUNK 65536
+#define KREADER_RELEASE (4 * 1024 * 1024)
+
+/*
+    Scan forward from the start of the next form until one complete top
+    level form is in the buffer. The scan state is kept between calls, so
+    a huge form is only scanned once however many refills it takes.
+    Bad syntax also counts as complete; the parser reports it.
+*/
+static int kreader_framed(kreader *r)
+{
+    const char *p = r->cur + r->scan;
+    int done = 0;
+
+    while (p < r->end && !done)
+    {
+        if (r->in_string)
+        {
+            const char *q = memchr(p, '"', r->end - p);
+            const char *b = memchr(p, '\\', (q ? q : r->end) - p);
+
+            if (b)
+            {
+                if (b + 1 >= r->end)
+                {
+                    p = b;
+                    break;
+                }
+
+                p = b + 2;
+                continue;
+            }
+
+            if (!q)
+            {
+                p = r->end;
+                break;
+            }
+
+            r->in_string = 0;
+            p = q + 1;
+            done = r->depth == 0;
+            continue;
+        }
+
+        if (r->in_comment)
+        {
+            const char *nl = memchr(p, '\n', r->end - p);
+            if (!nl)
+            {
+                p = r->end;
+                break;
+            }
+
+            r->in_comment = 0;
+            p = nl + 1;
+            continue;
+        }
+
+        switch (*p)
+        {
+        case ' ':
+        case '\t':
+        case '\n':
+        case '\r':
+        case '\f':
+        case '\v':
+            p++;
+            break;
+
+        case '"':
+            r->in_string = 1;
+            p++;
+            break;
+
+        case ';':
+            r->in_comment = 1;
+            p++;
+            break;
+
+        case '(':
+        case '{':
+            r->depth++;
+            p++;
+            break;
+
+        case ')':
+        case '}':
+            r->depth--;
+            p++;
+            done = r->depth <= 0;
+            break;
+
+        default:
+            // Left for the reader to report, once the whole form is in
+            if (!is_symbol_char(*p))
+            {
+                p++;
+                done = r->depth == 0;
+                break;
+            }
+
+            // An atom is only complete once something follows it. One that
+            // starts like a number may go on with a fraction, as in kreader_number.
+            const char *start = p;
+            int number = is_digit(*p) || (*p == '-' && p + 1 < r->end && is_digit(p[1]));
+            while (p < r->end && (is_symbol_char(*p) || (number && *p == '.')))
+            {
+                p++;
+            }
+
+            if (p == r->end)
+            {
+                p = start;
+                r->scan = p - r->cur;
+                return 0;
+            }
+
+            done = r->depth == 0;
+            break;
+        }
+    }
+
+    if (done)
+    {
+        r->scan = 0;
+        r->depth = 0;
+        return 1;
+    }
+
+    r->scan = p - r->cur;
+    return 0;
+}
+
+// Drop everything already read and append the next chunk of the file
+static int kreader_refill(kreader *r)
+{
+    for (const char *p = r->src; p < r->cur; p++)
+    {
+        if (*p == '\n')
+        {
+            r->line++;
+        }
+    }
+
+    size_t keep = r->end - r->cur;
+    memmove(r->buf, r->cur, keep);
+
+    if (keep + KREADER_CHUNK > r->cap)
+    {
+        r->cap = r->cap * 2 > keep + KREADER_CHUNK ? r->cap * 2 : keep + KREADER_CHUNK;
+        r->buf = realloc(r->buf, r->cap);
+    }
+
+    size_t n = fread(r->buf + keep, 1, r->cap - keep, r->fp);
+
+    r->src = r->buf;
+    r->cur = r->buf;
+    r->end = r->buf + keep + n;
+
+    return n > 0;
+}
+
+// Hand pages we have already read back to the kernel, so RSS stays flat
+static void kreader_release(kreader *r)
+{
+    if ((size_t)(r->cur - r->released) < KREADER_RELEASE)
+    {
+        return;
+    }
+
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t len = ((r->cur - r->released) / page) * page;
+
+    madvise((void *)r->released, len, MADV_DONTNEED);
+    r->released += len;
+}
+
+/*
+    Regular files are mmap'd and read in place. Anything else (pipes,
+    empty files, failed maps) is streamed through a buffer instead.
+*/
+int kreader_open(kreader *r, const char *filename)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        return 0;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED)
+        {
+            close(fd);
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+            kreader_init(r, filename, map, st.st_size);
+            r->map = map;
+            r->released = map;
+
+            // A cache hit never looks at the source again after hashing it
+            r->cache = kcache_open(map, st.st_size);
+            if (r->cache && kcache_hit(r->cache))
+            {
+                madvise(map, st.st_size, MADV_DONTNEED);
+            }
+
+            return 1;
+        }
+    }
+
+    FILE *fp = fdopen(fd, "rb");
+    if (!fp)
+    {
+        close(fd);
+        return 0;
+    }
+
+    kreader_init(r, filename, NULL, 0);
+    r->fp = fp;
+
+    return 1;
+}
+
+void kreader_close(kreader *r)
+{
+    if (r->cache)
+    {
+        kcache_close(r->cache, !r->error && r->cur == r->end);
+    }
+
+    if (r->map)
+    {
+        munmap((void *)r->map, r->end - r->map);
+    }
+
+    if (r->fp)
+    {
+        fclose(r->fp);
+    }
+
+    free(r->buf);
+
+    if (r->error)
+    {
+        kval_del(r->error);
+    }
+}
+
+// ###############
+//  Reader       #
+// ###############
+void kreader_init(kreader *r, const char *filename, const char *src, size_t len)
+{
+    r->filename = filename;
+    r->src = src;
+    r->cur = src;
+    r->end = src + len;
+    r->error = NULL;
+
+    r->map = NULL;
+    r->released = NULL;
+    r->cache = NULL;
+    r->fp = NULL;
+    r->buf = NULL;
+    r->cap = 0;
+    r->line = 0;
+    r->scan = 0;
+    r->depth = 0;
+    r->in_string = 0;
+    r->in_comment = 0;
+}
+
+// Next form, or NULL at the end of input or on a syntax error
+static kval *kreader_read(kreader *r)
+{
+    kreader_skip(r);
+
+    if (r->cur == r->end)
+    {
+        return NULL;
+    }
+
+    return kreader_form(r);
+}
+
+kval *kreader_next(kreader *r)
+{
+    if (r->cache && kcache_hit(r->cache))
+    {
+        kval *x = kcache_next(r->cache);
+        if (!x && kcache_corrupt(r->cache))
+        {
+            r->error = kval_err("%s: error: corrupt parse cache entry", r->filename);
+        }
+
+        return x;
+    }
+
+    if (r->map)
+    {
+        kreader_release(r);
+    }
+
+    if (r->fp)
+    {
+        while (!kreader_framed(r) && kreader_refill(r))
+        {
+        }
+    }
+
+    kval *x = kreader_read(r);
+    if (x && r->cache)
+    {
+        kcache_put(r->cache, x);
+    }
+
+    return x;
+}
+
+kval *kread(const char *filename, const char *src, size_t len)
+{
+    kreader r;
+    kreader_init(&r, filename, src, len);
+
+    kval *x = kval_sexpr();
+    kval *form;
+
+    while ((form = kreader_read(&r)))
+    {
+        x = kval_add(x, form);
+    }
+
+    if (r.error)
+    {
+        kval_del(x);
+        return r.error;
+    }
+
+    return x;
+}
+
+kval *kread_file(const char *filename)
+{
+    kreader r;
+    if (!kreader_open(&r, filename))
+    {
+        return kval_err("%s: error: Unable to open file!", filename);
+    }
+
+    kval *x = kval_sexpr();
+    kval *form;
+
+    while ((form = kreader_next(&r)))
+    {
+        x = kval_add(x, form);
+    }
+
+    if (r.error)
+    {
+        kval_del(x);
+        x = r.error;
+        r.error = NULL;
+    }
+
+    kreader_close(&r);
+    return x;
+}
@@ -0,0 +1,57 @@
+#ifndef reader_h
+#define reader_h
+
+#include <stdio.h>
+#include <stddef.h>
+#include "types.h"
+#include "kcache.h"
+
+/*
+    Hand-written reader for the Kovacs grammar.
+
+    Goes straight from source bytes to kvals in a single pass,
+    without building an mpc AST first. The mpc grammar in parser.h
+    is kept as a fallback, selected with `kread_use_mpc`.
+*/
+typedef struct
+{
+    const char *filename;
+    const char *src;
+    const char *cur;
+    const char *end;
+
+    kval *error;
+
+    // Reading a mmap'd file in place
+    const char *map;
+    const char *released;
+    kcache *cache;
+
+    // Streaming from a pipe, only the current form is kept in memory
+    FILE *fp;
+    char *buf;
+    size_t cap;
+    int line;
+
+    // Where framing the next form got to before it ran out of input
+    size_t scan;
+    int depth;
+    int in_string;
+    int in_comment;
+} kreader;
+
+// Set by the --mpc command line flag
+extern int kread_use_mpc;
+
+void kreader_init(kreader *r, const char *filename, const char *src, size_t len);
+int kreader_open(kreader *r, const char *filename);
+void kreader_close(kreader *r);
+
+// Next top level form, or NULL at the end of input or on bad syntax (see r->error)
+kval *kreader_next(kreader *r);
+
+// Read every form in a buffer/file into a single S-Expression
+kval *kread(const char *filename, const char *src, size_t len);
+kval *kread_file(const char *filename);
+
+#endif
@@ -8,6 +8,24 @@ char *ktype_name(int t)
         return "Function";
     case KVAL_NUM:
         return "Number";
+    case KVAL_BIG:
+        return "Big Number";
+    case KVAL_DBL:
+        return "Double";
+    case KVAL_VEC:
+        return "Vector";
+    case KVAL_MAT:
+        return "Matrix";
+    case KVAL_TABLE:
+        return "Hash Table";
+    case KVAL_MAP:
+        return "Map";
+    case KVAL_SORTED:
+        return "Sorted Map";
+    case KVAL_SET:
+        return "Set";
+    case KVAL_RECORD:
+        return "Record";
     case KVAL_ERR:
         return "Error";
     case KVAL_SYM:
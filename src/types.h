@@ -1,12 +1,47 @@
 #ifndef types_h
 #define types_h
 
+#include <stddef.h>
+
 struct kval;
 typedef struct kval kval;
 
 struct kenv;
 typedef struct kenv kenv;
 
+struct krope;
+typedef struct krope krope;
+
+struct kerr_args;
+typedef struct kerr_args kerr_args;
+
+struct kbig;
+typedef struct kbig kbig;
+
+// Packed numeric vector, see kvec.h
+typedef struct kvec kvec;
+
+// Dense matrix of doubles, see kmat.h
+typedef struct kmat kmat;
+
+// Mutable hash table, see khash.h
+typedef struct khash khash;
+
+// Persistent hash map, see kmap.h
+typedef struct kmap kmap;
+typedef struct ksorted ksorted;
+typedef struct kset kset;
+
+// Record type, see krecord.h
+typedef struct krecord krecord;
+
+// An interned string in a packed Q-Expression
+typedef struct
+{
+    const char *str;
+    size_t len;
+} kstr_ref;
+
 enum
 {
     KVAL_NUM,
@@ -15,7 +50,24 @@ enum
     KVAL_SEXPR,
     KVAL_QEXPR,
     KVAL_FUN,
-    KVAL_STR
+    KVAL_STR,
+    KVAL_BIG,
+    KVAL_DBL,
+    KVAL_VEC,
+    KVAL_MAT,
+    KVAL_TABLE,
+    KVAL_MAP,
+    KVAL_SORTED,
+    KVAL_SET,
+    KVAL_RECORD
+};
+
+// Storage of a Q-Expression's elements
+enum
+{
+    KPACK_NONE,
+    KPACK_NUMS,
+    KPACK_STRS
 };
 
 /*
@@ -28,25 +80,80 @@ that takes an kenv* and a kval* and returns a kval*.
 
 typedef kval *(*kbuiltin)(kenv *, kval *);
 
-// Kovacs value
+// Symbols and strings shorter than this are stored inline in the kval
+#define KVAL_SMALL 16
+
+// Kovacs value. Everything but the expression fields is only meaningful for its type.
 struct kval
 {
     int type;
 
-    long num;
-    char *str;
-    char *err;
-    char *sym;
-
-    // Expression
+    // Expression, and the fields of a record. A Q-Expression of only numbers or
+    // only interned strings may keep them packed in nums/strs instead, see kval_pack
     int count;
+    int pack;
     struct kval **cells;
 
-    // Functions
-    kbuiltin fun;
-    kenv *fenv;
-    kval *formals;
-    kval *body;
+    union
+    {
+        long num;
+        kbig *big;
+        double dbl;
+        kvec *vec;
+        kmat *mat;
+        khash *table;
+        kmap *map;
+        ksorted *sorted;
+        kset *set;
+
+        long *nums;
+        kstr_ref *strs;
+
+        // Errors. err is rendered from eargs the first time it is needed, see kval_err_msg.
+        // err_static says err is static or interned rather than owned.
+        struct
+        {
+            int code;
+            int err_static;
+            char *err;
+            kerr_args *eargs;
+        };
+
+        // Symbols and strings
+        struct
+        {
+            // Strings are either flat bytes or a rope, see kval_str_flat
+            union
+            {
+                char *str;
+                char *sym;
+            };
+            krope *rope;
+
+            // Length and lazily computed hash, see kval_hash. Interned ones
+            // point into the table in kintern.h instead of owning their bytes
+            size_t len;
+            unsigned long hash;
+            int interned;
+
+            // Short ones live here instead of on the heap, with sym/str
+            // pointing into it, see kval_chars
+            char small[KVAL_SMALL];
+        };
+
+        // Functions, and the type of a record. The constructor and accessors
+        // of a record type are functions with rec set, and slot the field
+        // they read, or -1 for the constructor.
+        struct
+        {
+            krecord *rec;
+            int slot;
+            kbuiltin fun;
+            kenv *fenv;
+            kval *formals;
+            kval *body;
+        };
+    };
 };
 
 /*
@@ -62,6 +169,7 @@ struct kenv
 {
     int count;
     char **syms;
+    unsigned long *hashes;
     kval **vals;
 
     kenv *parent;